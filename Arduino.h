@@ -3,17 +3,19 @@
 #include <stdint.h>
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <chrono>
 
 class Serial_Object {
 public:
-	Serial_Object() {}
-	void print(const char* str) { printf("%s", str); }
-	void print(float val) { printf("%f", val); }
-	void print(int val) { printf("%d", val); }
-	void println(const char* str) { printf("%s\n", str); }
-	void println(float val) { printf("%f\n", val); }
-	void println(int val) { printf("%d\n", val); }
-	void println() { printf("\n"); }
+	Serial_Object() { muted = false; }
+	bool muted;		//Drop output, e.g. while benchmarking code with debug prints
+	void print(const char* str) { if (!muted) printf("%s", str); }
+	void print(float val) { if (!muted) printf("%f", val); }
+	void print(int val) { if (!muted) printf("%d", val); }
+	void println(const char* str) { if (!muted) printf("%s\n", str); }
+	void println(float val) { if (!muted) printf("%f\n", val); }
+	void println(int val) { if (!muted) printf("%d\n", val); }
+	void println() { if (!muted) printf("\n"); }
 	bool available() { return false; }
 	char read() { return '\0'; }
 	int parseInt() { return 0; }
@@ -32,8 +34,22 @@ inline int64_t systime_to_timestamp(SYSTEMTIME* curr_time)
 		(60 * 60 * 1000 * (int64_t)curr_time->wHour);
 	return ts;
 }
+//Virtual clock for deterministic runs (golden frames): when enabled delay()
+//returns immediately after advancing virtual_time_ms and rtc reads from it
+bool virtual_clock = false;
+int64_t virtual_time_ms = 0;
+inline void advanceVirtualClock(int ms)
+{
+	virtual_time_ms += ms;
+}
+
 inline void delay(int ms)
 {
+	if (virtual_clock)
+	{
+		advanceVirtualClock(ms);
+		return;
+	}
 	SYSTEMTIME ts;
 	GetSystemTime(&ts);
 
@@ -64,14 +80,22 @@ public:
 	int getMinutes();
 	int getHours() { return 8; }
 };
+//Seconds since startup. Not glfwGetTime(), the headless viewer never calls glfwInit()
+const std::chrono::steady_clock::time_point rtc_start = std::chrono::steady_clock::now();
+inline double rtcTime()
+{
+	if (virtual_clock)
+		return virtual_time_ms / 1000.0;
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - rtc_start).count();
+}
 int rtc_obj::getSeconds()
 {
-	int seconds = ((int)glfwGetTime()) % 60;
+	int seconds = ((int)rtcTime()) % 60;
 	return seconds;
 }
 int rtc_obj::getMinutes()
 {
-	int seconds = ((int)glfwGetTime()) % 3600;
+	int seconds = ((int)rtcTime()) % 3600;
 	int minutes = seconds / 60;
 	return minutes;
 }
@@ -0,0 +1,150 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <atomic>
+
+// Background loader for viewer assets. Jobs submitted with submit() run on a
+// small pool of worker threads (file IO, Assimp import, stb_image decode, mesh
+// optimisation). Anything that touches GL has to be handed back with
+// queueUpload() and is executed by the GL thread when it calls
+// processUploads() once per frame, so the render loop never blocks on disk.
+class AssetLoader {
+	public:
+		typedef std::function<void()> Job;
+
+		AssetLoader(int num_workers = 0);
+		~AssetLoader();
+
+		// Worker side
+		void submit(Job job);
+		void queueUpload(Job upload);
+
+		// GL thread side, returns number of uploads executed
+		int processUploads(int max_uploads = -1);
+		bool idle() { return pending == 0; }
+
+	private:
+		std::vector<std::thread> workers;
+		std::deque<Job> jobs;
+		std::deque<Job> uploads;
+		std::mutex job_mutex;
+		std::mutex upload_mutex;
+		std::condition_variable job_cv;
+		std::atomic<int> pending;
+		bool running;
+
+		void workerLoop();
+};
+
+AssetLoader::AssetLoader(int num_workers)
+{
+	pending = 0;
+	running = true;
+	if (num_workers <= 0)
+	{
+		num_workers = (int)std::thread::hardware_concurrency();
+		if (num_workers <= 0)
+			num_workers = 2;
+		if (num_workers > 4)
+			num_workers = 4;
+	}
+	for (int i = 0; i < num_workers; i++)
+	{
+		workers.push_back(std::thread(&AssetLoader::workerLoop, this));
+	}
+}
+AssetLoader::~AssetLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(job_mutex);
+		running = false;
+	}
+	job_cv.notify_all();
+	for (unsigned int i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+}
+void AssetLoader::submit(Job job)
+{
+	pending++;
+	{
+		std::lock_guard<std::mutex> lock(job_mutex);
+		jobs.push_back(job);
+	}
+	job_cv.notify_one();
+}
+void AssetLoader::queueUpload(Job upload)
+{
+	//Counted before the submitting job finishes so idle() never sees a gap
+	pending++;
+	std::lock_guard<std::mutex> lock(upload_mutex);
+	uploads.push_back(upload);
+}
+int AssetLoader::processUploads(int max_uploads)
+{
+	int count = 0;
+	while (max_uploads < 0 || count < max_uploads)
+	{
+		Job upload;
+		{
+			std::lock_guard<std::mutex> lock(upload_mutex);
+			if (uploads.empty())
+				break;
+			upload = uploads.front();
+			uploads.pop_front();
+		}
+		upload();
+		pending--;
+		count++;
+	}
+	return count;
+}
+void AssetLoader::workerLoop()
+{
+	while (1)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(job_mutex);
+			job_cv.wait(lock, [this] { return !running || !jobs.empty(); });
+			if (!running)
+				return;
+			job = jobs.front();
+			jobs.pop_front();
+		}
+		job();
+		pending--;
+	}
+}
+
+// Runs fn(0) .. fn(count - 1) spread over up to max_threads threads (one per
+// core) and returns once all of them are done. For the batch converters,
+// which want every core for a moment rather than the loader's small pool.
+void parallelFor(int count, int max_threads, const std::function<void(int)>& fn)
+{
+	int num_workers = (int)std::thread::hardware_concurrency();
+	num_workers = num_workers <= 0 ? 2 : num_workers > max_threads ? max_threads : num_workers;
+	num_workers = num_workers > count ? count : num_workers;
+	std::atomic<int> next(0);
+	std::vector<std::thread> workers;
+	for (int i = 0; i < num_workers; i++)
+	{
+		workers.push_back(std::thread([&]() {
+			for (int n = next++; n < count; n = next++)
+				fn(n);
+		}));
+	}
+	for (unsigned int i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+}
+
+#endif  //ASSET_LOADER_H
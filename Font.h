@@ -0,0 +1,301 @@
+#ifndef FONT_LIB
+#define FONT_LIB
+
+#include <stdint.h>
+#include <string.h>
+
+//Proportional font for the radial text, printable ASCII 32-126. Glyphs are
+//written below as rows of '#'/'.' separated by '|', top row first; the parser
+//turns them into one bit mask per column at compile time, bit 7 = top row.
+//Capitals are 7 rows (bits 7-1, baseline bit 1), descenders use bit 0, so the
+//glyphs fill all WIDTH = 8 radial rows. Widths are trimmed per glyph and one
+//blank column goes between glyphs unless the pair kerns (see fontKern).
+
+#define FONT_FIRST 32
+#define FONT_LAST 126
+#define FONT_GLYPHS (FONT_LAST - FONT_FIRST + 1)
+#define FONT_ROWS 8
+#define FONT_SPACING 1
+#define FONT_FALLBACK '?'
+
+constexpr const char* FONT_SOURCE[FONT_GLYPHS] = {
+    "..",                                          //space
+    "#|#|#|#|#|.|#",                               //!
+    "#.#|#.#",                                     //"
+    ".#.#.|.#.#.|#####|.#.#.|#####|.#.#.|.#.#.",   //#
+    "..#..|.####|#.#..|.###.|..#.#|####.|..#..",   //$
+    "##...|##..#|...#.|..#..|.#...|#..##|...##",   //%
+    ".##..|#..#.|#.#..|.#...|#.#.#|#..#.|.##.#",   //&
+    "#|#",                                         //'
+    ".#|#.|#.|#.|#.|#.|.#",                        //(
+    "#.|.#|.#|.#|.#|.#|#.",                        //)
+    "...|#.#|.#.|###|.#.|#.#",                     //*
+    "...|...|.#.|###|.#.",                         //+
+    "..|..|..|..|..|..|.#|#.",                     //,
+    "...|...|...|###",                             //-
+    ".|.|.|.|.|.|#",                               //.
+    "..#|..#|.#.|.#.|.#.|#..|#..",                 ///
+    ".##.|#..#|#..#|#..#|#..#|#..#|.##.",          //0
+    ".#.|##.|.#.|.#.|.#.|.#.|###",                 //1
+    ".##.|#..#|...#|..#.|.#..|#...|####",          //2
+    "###.|...#|...#|.##.|...#|...#|###.",          //3
+    "..#.|.##.|#.#.|#.#.|####|..#.|..#.",          //4
+    "####|#...|###.|...#|...#|#..#|.##.",          //5
+    ".##.|#...|#...|###.|#..#|#..#|.##.",          //6
+    "####|...#|..#.|..#.|.#..|.#..|.#..",          //7
+    ".##.|#..#|#..#|.##.|#..#|#..#|.##.",          //8
+    ".##.|#..#|#..#|.###|...#|...#|.##.",          //9
+    ".|.|#|.|.|#",                                 //:
+    "..|..|.#|..|..|.#|.#|#.",                     //;
+    "...|..#|.#.|#..|.#.|..#",                     //<
+    "...|...|###|...|###",                         //=
+    "...|#..|.#.|..#|.#.|#..",                     //>
+    ".##.|#..#|...#|..#.|.#..|....|.#..",          //?
+    ".###.|#...#|#.###|#.#.#|#.###|#....|.###.",   //@
+    ".##.|#..#|#..#|####|#..#|#..#|#..#",          //A
+    "###.|#..#|#..#|###.|#..#|#..#|###.",          //B
+    ".##.|#..#|#...|#...|#...|#..#|.##.",          //C
+    "###.|#..#|#..#|#..#|#..#|#..#|###.",          //D
+    "####|#...|#...|###.|#...|#...|####",          //E
+    "####|#...|#...|###.|#...|#...|#...",          //F
+    ".##.|#..#|#...|#.##|#..#|#..#|.###",          //G
+    "#..#|#..#|#..#|####|#..#|#..#|#..#",          //H
+    "###|.#.|.#.|.#.|.#.|.#.|###",                 //I
+    "..##|...#|...#|...#|...#|#..#|.##.",          //J
+    "#..#|#.#.|##..|#...|##..|#.#.|#..#",          //K
+    "#...|#...|#...|#...|#...|#...|####",          //L
+    "#...#|##.##|#.#.#|#.#.#|#...#|#...#|#...#",   //M
+    "#...#|##..#|#.#.#|#..##|#...#|#...#|#...#",   //N
+    ".##.|#..#|#..#|#..#|#..#|#..#|.##.",          //O
+    "###.|#..#|#..#|###.|#...|#...|#...",          //P
+    ".##..|#..#.|#..#.|#..#.|#.##.|#..#.|.##.#",   //Q
+    "###.|#..#|#..#|###.|#.#.|#..#|#..#",          //R
+    ".###|#...|#...|.##.|...#|...#|###.",          //S
+    "#####|..#..|..#..|..#..|..#..|..#..|..#..",   //T
+    "#..#|#..#|#..#|#..#|#..#|#..#|.##.",          //U
+    "#...#|#...#|#...#|#...#|.#.#.|.#.#.|..#..",   //V
+    "#...#|#...#|#...#|#.#.#|#.#.#|##.##|#...#",   //W
+    "#...#|#...#|.#.#.|..#..|.#.#.|#...#|#...#",   //X
+    "#...#|#...#|.#.#.|..#..|..#..|..#..|..#..",   //Y
+    "####|...#|..#.|..#.|.#..|#...|####",          //Z
+    "##|#.|#.|#.|#.|#.|##",                        //[
+    "#..|#..|.#.|.#.|.#.|..#|..#",                 //backslash
+    "##|.#|.#|.#|.#|.#|##",                        //]
+    ".#.|#.#",                                     //^
+    "....|....|....|....|....|....|####",          //_
+    "#.|.#",                                       //`
+    "....|....|.##.|...#|.###|#..#|.###",          //a
+    "#...|#...|###.|#..#|#..#|#..#|###.",          //b
+    "...|...|.##|#..|#..|#..|.##",                 //c
+    "...#|...#|.###|#..#|#..#|#..#|.###",          //d
+    "....|....|.##.|#..#|####|#...|.###",          //e
+    ".##|.#.|###|.#.|.#.|.#.|.#.",                 //f
+    "....|....|.###|#..#|#..#|.###|...#|.##.",     //g
+    "#...|#...|###.|#..#|#..#|#..#|#..#",          //h
+    "#|.|#|#|#|#|#",                               //i
+    ".#|..|.#|.#|.#|.#|.#|#.",                     //j
+    "#...|#...|#..#|#.#.|##..|#.#.|#..#",          //k
+    "#.|#.|#.|#.|#.|#.|.#",                        //l
+    ".....|.....|##.#.|#.#.#|#.#.#|#.#.#|#.#.#",   //m
+    "....|....|###.|#..#|#..#|#..#|#..#",          //n
+    "....|....|.##.|#..#|#..#|#..#|.##.",          //o
+    "....|....|###.|#..#|#..#|###.|#...|#...",     //p
+    "....|....|.###|#..#|#..#|.###|...#|...#",     //q
+    "...|...|#.#|##.|#..|#..|#..",                 //r
+    "...|...|.##|#..|.#.|..#|##.",                 //s
+    ".#.|.#.|###|.#.|.#.|.#.|..#",                 //t
+    "....|....|#..#|#..#|#..#|#..#|.###",          //u
+    "...|...|#.#|#.#|#.#|#.#|.#.",                 //v
+    ".....|.....|#...#|#...#|#.#.#|#.#.#|.#.#.",   //w
+    "...|...|#.#|#.#|.#.|#.#|#.#",                 //x
+    "....|....|#..#|#..#|#..#|.###|...#|.##.",     //y
+    "...|...|###|..#|.#.|#..|###",                 //z
+    "..#|.#.|.#.|#..|.#.|.#.|..#",                 //{
+    "#|#|#|#|#|#|#",                               //|
+    "#..|.#.|.#.|..#|.#.|.#.|#..",                 //}
+    "....|....|....|.#.#|#.#.",                    //~
+};
+
+//Upright font for text standing along HEIGHT, HEIGHT = 6 rows so bit 5 = top
+//row. Capitals, digits and a little punctuation; lowercase folds to capitals
+//and anything else without a glyph ("") falls back like the radial font.
+#define UPRIGHT_FONT_ROWS 6
+
+constexpr const char* UPRIGHT_FONT_SOURCE[FONT_GLYPHS] = {
+    "..",                                          //space
+    "#|#|#|#|.|#",                                 //!
+    "#.#|#.#",                                     //"
+    "", "", "", "",                                //# $ % &
+    "#|#",                                         //'
+    ".#|#.|#.|#.|#.|.#",                           //(
+    "#.|.#|.#|.#|.#|#.",                           //)
+    "",                                            //*
+    "...|...|.#.|###|.#.",                         //+
+    ".|.|.|.|#|#",                                 //,
+    "...|...|###",                                 //-
+    ".|.|.|.|.|#",                                 //.
+    "..#|..#|.#.|.#.|#..|#..",                     ///
+    "###|#.#|#.#|#.#|#.#|###",                     //0
+    ".#|##|.#|.#|.#|.#",                           //1
+    "##.|..#|..#|.#.|#..|###",                     //2
+    "##.|..#|.#.|..#|..#|##.",                     //3
+    "#.#|#.#|###|..#|..#|..#",                     //4
+    "###|#..|##.|..#|..#|##.",                     //5
+    ".##|#..|##.|#.#|#.#|.#.",                     //6
+    "###|..#|..#|.#.|.#.|.#.",                     //7
+    ".#.|#.#|.#.|#.#|#.#|.#.",                     //8
+    ".#.|#.#|#.#|.##|..#|##.",                     //9
+    ".|#|.|.|#|.",                                 //:
+    ".|#|.|.|#|#",                                 //;
+    "",                                            //<
+    "...|###|...|###",                             //=
+    "",                                            //>
+    "##.|..#|.#.|.#.|...|.#.",                     //?
+    "",                                            //@
+    ".#.|#.#|#.#|###|#.#|#.#",                     //A
+    "##.|#.#|##.|#.#|#.#|##.",                     //B
+    ".##|#..|#..|#..|#..|.##",                     //C
+    "##.|#.#|#.#|#.#|#.#|##.",                     //D
+    "###|#..|##.|#..|#..|###",                     //E
+    "###|#..|##.|#..|#..|#..",                     //F
+    ".##|#..|#..|#.#|#.#|.##",                     //G
+    "#.#|#.#|###|#.#|#.#|#.#",                     //H
+    "###|.#.|.#.|.#.|.#.|###",                     //I
+    "..#|..#|..#|..#|#.#|.#.",                     //J
+    "#.#|#.#|##.|#.#|#.#|#.#",                     //K
+    "#..|#..|#..|#..|#..|###",                     //L
+    "#...#|##.##|#.#.#|#...#|#...#|#...#",         //M
+    "#..#|##.#|#.##|#..#|#..#|#..#",               //N
+    ".#.|#.#|#.#|#.#|#.#|.#.",                     //O
+    "##.|#.#|#.#|##.|#..|#..",                     //P
+    ".#.|#.#|#.#|#.#|##.|.##",                     //Q
+    "##.|#.#|#.#|##.|#.#|#.#",                     //R
+    ".##|#..|.#.|..#|..#|##.",                     //S
+    "###|.#.|.#.|.#.|.#.|.#.",                     //T
+    "#.#|#.#|#.#|#.#|#.#|###",                     //U
+    "#.#|#.#|#.#|#.#|.#.|.#.",                     //V
+    "#...#|#...#|#...#|#.#.#|##.##|#...#",         //W
+    "#.#|#.#|.#.|.#.|#.#|#.#",                     //X
+    "#.#|#.#|.#.|.#.|.#.|.#.",                     //Y
+    "###|..#|.#.|.#.|#..|###",                     //Z
+    "", "", "", "", "", "",                        //[ \ ] ^ _ `
+    "", "", "", "", "", "", "", "", "", "", "", "", "",     //a-m fold to A-M
+    "", "", "", "", "", "", "", "", "", "", "", "", "",     //n-z fold to N-Z
+    "", "", "", "",                                //{ | } ~
+};
+
+constexpr int fontSourceWidth(const char* rows)
+{
+    int w = 0;
+    while (rows[w] != '\0' && rows[w] != '|')
+        w++;
+    return w;
+}
+constexpr int fontTotalColumns(const char* const* source)
+{
+    int total = 0;
+    for (int g = 0; g < FONT_GLYPHS; g++)
+        total += fontSourceWidth(source[g]);
+    return total;
+}
+
+//Column masks of one source table, bit rows - 1 = top row
+template <int COLUMNS>
+struct PropFont
+{
+    uint8_t width[FONT_GLYPHS];
+    uint16_t offset[FONT_GLYPHS];
+    uint8_t columns[COLUMNS];
+
+    constexpr PropFont(const char* const* source, int rows) : width(), offset(), columns()
+    {
+        int next = 0;
+        for (int g = 0; g < FONT_GLYPHS; g++)
+        {
+            const char* src = source[g];
+            int w = fontSourceWidth(src);
+            width[g] = (uint8_t)w;
+            offset[g] = (uint16_t)next;
+            //Walk the rows, each is w characters plus a '|' separator
+            int row = 0;
+            for (int i = 0; src[i] != '\0'; i++)
+            {
+                if (src[i] == '|')
+                {
+                    row++;
+                    continue;
+                }
+                int col = i - row * (w + 1);
+                if (src[i] == '#' && row < rows)
+                    columns[next + col] |= (uint8_t)(1 << (rows - 1 - row));
+            }
+            next += w;
+        }
+    }
+};
+
+constexpr PropFont<fontTotalColumns(FONT_SOURCE)> PROP_FONT(FONT_SOURCE, FONT_ROWS);
+constexpr PropFont<fontTotalColumns(UPRIGHT_FONT_SOURCE)> UPRIGHT_FONT(UPRIGHT_FONT_SOURCE, UPRIGHT_FONT_ROWS);
+
+//What the lookups below need from a font, independent of its column count
+struct FontRef
+{
+    const uint8_t* width;
+    const uint16_t* offset;
+    const uint8_t* columns;
+    uint8_t rows;
+};
+
+constexpr FontRef RADIAL_FONT_REF = { PROP_FONT.width, PROP_FONT.offset, PROP_FONT.columns, FONT_ROWS };
+constexpr FontRef UPRIGHT_FONT_REF = { UPRIGHT_FONT.width, UPRIGHT_FONT.offset, UPRIGHT_FONT.columns, UPRIGHT_FONT_ROWS };
+
+inline int fontGlyph(char c, const FontRef& font = RADIAL_FONT_REF)
+{
+    if (c < FONT_FIRST || c > FONT_LAST)
+        c = FONT_FALLBACK;
+    if (font.width[c - FONT_FIRST] == 0 && c >= 'a' && c <= 'z')
+        c -= 'a' - 'A';
+    if (font.width[c - FONT_FIRST] == 0)
+        c = FONT_FALLBACK;
+    if (font.width[c - FONT_FIRST] == 0)
+        c = ' ';
+    return c - FONT_FIRST;
+}
+inline int fontWidth(char c, const FontRef& font = RADIAL_FONT_REF)
+{
+    return font.width[fontGlyph(c, font)];
+}
+inline const uint8_t* fontColumns(char c, const FontRef& font = RADIAL_FONT_REF)
+{
+    return font.columns + font.offset[fontGlyph(c, font)];
+}
+
+//Spacing change between a and b: the blank column is dropped when the facing
+//edges have no lit rows within one row of each other, e.g. "LT", "r.", "Ty"
+inline int fontKern(char a, char b, const FontRef& font = RADIAL_FONT_REF)
+{
+    if (a == ' ' || b == ' ')
+        return 0;
+    int ga = fontGlyph(a, font), gb = fontGlyph(b, font);
+    uint8_t right = font.columns[font.offset[ga] + font.width[ga] - 1];
+    uint8_t left = font.columns[font.offset[gb]];
+    uint8_t edge = left | (uint8_t)(left << 1) | (left >> 1);
+    return (right & edge) == 0 ? -FONT_SPACING : 0;
+}
+
+//Advance from the start of a to the start of b
+inline int fontAdvance(char a, char b, const FontRef& font = RADIAL_FONT_REF)
+{
+    return fontWidth(a, font) + FONT_SPACING + fontKern(a, b, font);
+}
+
+//Columns str covers when drawn with font
+int measureString(const char* str, const FontRef& font = RADIAL_FONT_REF)
+{
+    int w = 0;
+    for (const char* p = str; *p; p++)
+        w += p[1] ? fontAdvance(p[0], p[1], font) : fontWidth(p[0], font);
+    return w;
+}
+
+#endif
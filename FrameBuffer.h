@@ -2,14 +2,26 @@
 #define FRAME_BUFFER_LIB
 
 #include "Vector3d.h"
+#include "Profiler.h"
 
 #ifdef CONFIG_POV_SIMULATOR
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include "Arduino.h"
+#include <atomic>
 #else
 #include<FastLED.h>
+#include <string.h>
+#endif
+
+//Orders the frame_seq bumps against the buffer swap for readers on another
+//thread (simulator) or in an interrupt (firmware)
+#ifdef CONFIG_POV_SIMULATOR
+#define FRAME_SEQ_FENCE() std::atomic_thread_fence(std::memory_order_seq_cst)
+#else
+#define FRAME_SEQ_FENCE() __asm__ __volatile__("" ::: "memory")
 #endif
 
 enum COLORS { RED, GREEN, BLUE, NUM_COLORS };
@@ -20,12 +32,63 @@ enum COLORS { RED, GREEN, BLUE, NUM_COLORS };
 
 #define DB_SUPPORT true
 
+//Pixel storage, pick a smaller one on low RAM controllers. Sizes are for
+//the whole doubleBuffer
+#define FB_RGB888 0     //3 bytes per LED, ~27 KB
+#define FB_RGB565 1     //2 bytes per LED, ~18 KB
+#define FB_PALETTE8 2   //1 byte per LED + 256 entry palette per frame, ~11 KB
+#ifndef FB_STORAGE
+#define FB_STORAGE FB_RGB888
+#endif
+
+#define PALETTE_SIZE 256
+#define PALETTE_HASH_BITS 9
+#define PALETTE_HASH_SIZE (1 << PALETTE_HASH_BITS)
+
+//One LED in the storage format, see packPixel
+#if FB_STORAGE == FB_RGB565
+typedef uint16_t fb_pixel_t;
+#elif FB_STORAGE == FB_PALETTE8
+typedef uint8_t fb_pixel_t;
+#else
+typedef uint32_t fb_pixel_t;    //r | g << 8 | b << 16
+#endif
+
 class frameBuffer
 {
 public:
+#if FB_STORAGE == FB_RGB565
+    uint16_t fbuf_[LENGTH][WIDTH][HEIGHT];
+#elif FB_STORAGE == FB_PALETTE8
+    uint8_t fbuf_[LENGTH][WIDTH][HEIGHT];
+    uint8_t palette_[PALETTE_SIZE][NUM_COLORS];     //Entry 0 is always black
+    uint16_t palette_size_;
+#else
     uint8_t fbuf_[LENGTH][WIDTH][HEIGHT][NUM_COLORS];
+#endif
     frameBuffer();
     void clear();
+
+    //No bounds checks here, doubleBuffer does them
+    void setPixel(int l, int w, int h, uint8_t r, uint8_t g, uint8_t b);
+    void getPixel(int l, int w, int h, uint8_t* r, uint8_t* g, uint8_t* b) const;
+    uint8_t getChannel(int l, int w, int h, int c) const;
+    void setChannel(int l, int w, int h, int c, uint8_t val);
+    //Colour conversion done once, e.g. for a sprite palette, then plain stores.
+    //With FB_PALETTE8 a packed value is only good until the next clear()
+    fb_pixel_t packPixel(uint8_t r, uint8_t g, uint8_t b);
+    void setPixelPacked(int l, int w, int h, fb_pixel_t v);
+
+    //RGB888 bytes of one slice laid out as [WIDTH][HEIGHT][NUM_COLORS]. Returns
+    //the storage itself for FB_RGB888, otherwise expands into tmp
+    const uint8_t* sliceRGB(int l, uint8_t* tmp) const;
+    bool sameAs(const frameBuffer* other) const;
+
+#if FB_STORAGE == FB_PALETTE8
+private:
+    uint8_t palette_hash_[PALETTE_HASH_SIZE];       //Palette index, 0 = empty slot
+    uint8_t paletteIndex(uint8_t r, uint8_t g, uint8_t b);
+#endif
 };
 
 frameBuffer::frameBuffer()
@@ -34,18 +97,174 @@ frameBuffer::frameBuffer()
 }
 void frameBuffer::clear()
 {
-    for (int i = 0; i < LENGTH; i++)
+    memset(fbuf_, 0, sizeof(fbuf_));
+#if FB_STORAGE == FB_PALETTE8
+    palette_[0][RED] = 0;
+    palette_[0][GREEN] = 0;
+    palette_[0][BLUE] = 0;
+    palette_size_ = 1;
+    memset(palette_hash_, 0, sizeof(palette_hash_));
+#endif
+}
+#if FB_STORAGE == FB_RGB565
+inline uint16_t packRGB565(uint8_t r, uint8_t g, uint8_t b)
+{
+    return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+}
+inline void unpackRGB565(uint16_t c, uint8_t* rgb)
+{
+    //Replicate the top bits so full scale stays 255
+    uint8_t r = (c >> 11) & 0x1F;
+    uint8_t g = (c >> 5) & 0x3F;
+    uint8_t b = c & 0x1F;
+    rgb[RED] = (r << 3) | (r >> 2);
+    rgb[GREEN] = (g << 2) | (g >> 4);
+    rgb[BLUE] = (b << 3) | (b >> 2);
+}
+#endif
+#if FB_STORAGE == FB_PALETTE8
+uint8_t frameBuffer::paletteIndex(uint8_t r, uint8_t g, uint8_t b)
+{
+    if ((r | g | b) == 0)
+        return 0;
+
+    uint32_t key = ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+    uint32_t slot = (key * 2654435761u) >> (32 - PALETTE_HASH_BITS);
+    while (palette_hash_[slot] != 0)
+    {
+        uint8_t idx = palette_hash_[slot];
+        if (palette_[idx][RED] == r && palette_[idx][GREEN] == g && palette_[idx][BLUE] == b)
+            return idx;
+        slot = (slot + 1) & (PALETTE_HASH_SIZE - 1);
+    }
+    if (palette_size_ < PALETTE_SIZE)
+    {
+        uint8_t idx = palette_size_++;
+        palette_[idx][RED] = r;
+        palette_[idx][GREEN] = g;
+        palette_[idx][BLUE] = b;
+        palette_hash_[slot] = idx;
+        return idx;
+    }
+
+    //Palette full for this frame, fall back to the closest colour
+    uint8_t best = 0;
+    int32_t best_dist = 0x7FFFFFFF;
+    for (int i = 0; i < PALETTE_SIZE; i++)
     {
-        for (int j = 0; j < WIDTH; j++)
+        int32_t dr = palette_[i][RED] - r;
+        int32_t dg = palette_[i][GREEN] - g;
+        int32_t db = palette_[i][BLUE] - b;
+        int32_t dist = dr * dr + dg * dg + db * db;
+        if (dist < best_dist)
         {
-            for (int k = 0; k < HEIGHT; k++)
-            {
-                fbuf_[i][j][k][RED] = 0;
-                fbuf_[i][j][k][GREEN] = 0;
-                fbuf_[i][j][k][BLUE] = 0;
-            }
+            best_dist = dist;
+            best = i;
         }
     }
+    return best;
+}
+#endif
+void frameBuffer::setPixel(int l, int w, int h, uint8_t r, uint8_t g, uint8_t b)
+{
+#if FB_STORAGE == FB_RGB565
+    fbuf_[l][w][h] = packRGB565(r, g, b);
+#elif FB_STORAGE == FB_PALETTE8
+    fbuf_[l][w][h] = paletteIndex(r, g, b);
+#else
+    fbuf_[l][w][h][RED] = r;
+    fbuf_[l][w][h][GREEN] = g;
+    fbuf_[l][w][h][BLUE] = b;
+#endif
+}
+inline fb_pixel_t frameBuffer::packPixel(uint8_t r, uint8_t g, uint8_t b)
+{
+#if FB_STORAGE == FB_RGB565
+    return packRGB565(r, g, b);
+#elif FB_STORAGE == FB_PALETTE8
+    return paletteIndex(r, g, b);
+#else
+    return (fb_pixel_t)r | ((fb_pixel_t)g << 8) | ((fb_pixel_t)b << 16);
+#endif
+}
+inline void frameBuffer::setPixelPacked(int l, int w, int h, fb_pixel_t v)
+{
+#if FB_STORAGE == FB_RGB888
+    fbuf_[l][w][h][RED] = (uint8_t)v;
+    fbuf_[l][w][h][GREEN] = (uint8_t)(v >> 8);
+    fbuf_[l][w][h][BLUE] = (uint8_t)(v >> 16);
+#else
+    fbuf_[l][w][h] = v;
+#endif
+}
+void frameBuffer::getPixel(int l, int w, int h, uint8_t* r, uint8_t* g, uint8_t* b) const
+{
+#if FB_STORAGE == FB_RGB565
+    uint8_t rgb[NUM_COLORS];
+    unpackRGB565(fbuf_[l][w][h], rgb);
+    const uint8_t* px = rgb;
+#elif FB_STORAGE == FB_PALETTE8
+    const uint8_t* px = palette_[fbuf_[l][w][h]];
+#else
+    const uint8_t* px = fbuf_[l][w][h];
+#endif
+    *r = px[RED];
+    *g = px[GREEN];
+    *b = px[BLUE];
+}
+uint8_t frameBuffer::getChannel(int l, int w, int h, int c) const
+{
+#if FB_STORAGE == FB_RGB888
+    return fbuf_[l][w][h][c];
+#else
+    uint8_t rgb[NUM_COLORS];
+    getPixel(l, w, h, &rgb[RED], &rgb[GREEN], &rgb[BLUE]);
+    return rgb[c];
+#endif
+}
+void frameBuffer::setChannel(int l, int w, int h, int c, uint8_t val)
+{
+#if FB_STORAGE == FB_RGB888
+    fbuf_[l][w][h][c] = val;
+#else
+    uint8_t rgb[NUM_COLORS];
+    getPixel(l, w, h, &rgb[RED], &rgb[GREEN], &rgb[BLUE]);
+    rgb[c] = val;
+    setPixel(l, w, h, rgb[RED], rgb[GREEN], rgb[BLUE]);
+#endif
+}
+const uint8_t* frameBuffer::sliceRGB(int l, uint8_t* tmp) const
+{
+#if FB_STORAGE == FB_RGB565
+    const uint16_t* src = &fbuf_[l][0][0];
+    for (int i = 0; i < WIDTH * HEIGHT; i++)
+    {
+        unpackRGB565(src[i], tmp + i * NUM_COLORS);
+    }
+    return tmp;
+#elif FB_STORAGE == FB_PALETTE8
+    const uint8_t* src = &fbuf_[l][0][0];
+    for (int i = 0; i < WIDTH * HEIGHT; i++)
+    {
+        const uint8_t* px = palette_[src[i]];
+        tmp[i * NUM_COLORS + RED] = px[RED];
+        tmp[i * NUM_COLORS + GREEN] = px[GREEN];
+        tmp[i * NUM_COLORS + BLUE] = px[BLUE];
+    }
+    return tmp;
+#else
+    (void)tmp;
+    return &fbuf_[l][0][0][0];
+#endif
+}
+bool frameBuffer::sameAs(const frameBuffer* other) const
+{
+#if FB_STORAGE == FB_PALETTE8
+    //Same drawing calls build the same palette, anything else counts as changed
+    if (palette_size_ != other->palette_size_ || memcmp(palette_, other->palette_, palette_size_ * NUM_COLORS) != 0)
+        return false;
+#endif
+    return memcmp(fbuf_, other->fbuf_, sizeof(fbuf_)) == 0;
 }
 
 class doubleBuffer
@@ -58,6 +277,17 @@ private:
 #if DB_SUPPORT
     frameBuffer buf2;
 #endif
+    volatile uint32_t frame_seq;
+
+#ifdef CONFIG_POV_SIMULATOR
+public:
+    //Called from update() with each new frame, on the thread that drew it
+    typedef void (*UpdateHook)(const frameBuffer* frame, void* ctx);
+    void setUpdateHook(UpdateHook hook, void* ctx) { update_ctx = ctx; update_hook = hook; }
+private:
+    UpdateHook volatile update_hook;
+    void* volatile update_ctx;
+#endif
 
 public:
     doubleBuffer();
@@ -71,6 +301,10 @@ public:
     void update();
     frameBuffer* getWriteBuffer() { return write_buffer; }
     frameBuffer* getReadBuffer() { return read_buffer; }
+    //Seqlock style: odd while update() swaps in a new frame, even otherwise,
+    //so it goes up by 2 per presented frame. A reader that sees the same even
+    //value before and after copying out of getReadBuffer() got one whole frame
+    uint32_t getFrameSequence() { return frame_seq; }
 
     static void randColor(uint8_t* r, uint8_t* g, uint8_t* b);
 
@@ -82,6 +316,11 @@ public:
 
 doubleBuffer::doubleBuffer()
 {
+    frame_seq = 0;
+#ifdef CONFIG_POV_SIMULATOR
+    update_hook = NULL;
+    update_ctx = NULL;
+#endif
 #if DB_SUPPORT
     read_buffer = &buf1;
     write_buffer = &buf2;
@@ -100,20 +339,30 @@ void doubleBuffer::reset()
     write_buffer = &buf1;
 #endif
 
+    frame_seq++;
+    FRAME_SEQ_FENCE();
     read_buffer->clear();
     write_buffer->clear();
+    FRAME_SEQ_FENCE();
+    frame_seq++;
 }
 void doubleBuffer::forceSingleBuffer()
 {
+    frame_seq++;
+    FRAME_SEQ_FENCE();
 #if DB_SUPPORT
     read_buffer = &buf1;
     write_buffer = &buf1;
 #endif
 
     write_buffer->clear();
+    FRAME_SEQ_FENCE();
+    frame_seq++;
 }
 void doubleBuffer::forceDoubleBuffer()
 {
+    frame_seq++;
+    FRAME_SEQ_FENCE();
 #if DB_SUPPORT
     read_buffer = &buf1;
     write_buffer = &buf2;
@@ -121,6 +370,8 @@ void doubleBuffer::forceDoubleBuffer()
     read_buffer = &buf1;
     write_buffer = &buf1;
 #endif
+    FRAME_SEQ_FENCE();
+    frame_seq++;
 }
 void doubleBuffer::clear()
 {
@@ -133,7 +384,7 @@ void doubleBuffer::setColorChannel(int l, int w, int h, uint8_t c_idx, uint8_t c
     if (l >= LENGTH || w >= WIDTH || h >= HEIGHT || c_idx >= 3)
         return;
 
-    write_buffer->fbuf_[l][w][h][c_idx] = c_val;
+    write_buffer->setChannel(l, w, h, c_idx, c_val);
 }
 void doubleBuffer::setColors(int l, int w, int h, uint8_t rVal, uint8_t gVal, uint8_t bVal)
 {
@@ -142,15 +393,30 @@ void doubleBuffer::setColors(int l, int w, int h, uint8_t rVal, uint8_t gVal, ui
     if (l >= LENGTH || w >= WIDTH || h >= HEIGHT || rVal >= 256 || gVal >= 256 || bVal >= 256)
         return;
 
-    write_buffer->fbuf_[l][w][h][RED] = rVal;
-    write_buffer->fbuf_[l][w][h][GREEN] = gVal;
-    write_buffer->fbuf_[l][w][h][BLUE] = bVal;
+    write_buffer->setPixel(l, w, h, rVal, gVal, bVal);
 }
 void doubleBuffer::update()
 {
+    PROFILE_ZONE("doubleBuffer::update");
+#ifdef CONFIG_POV_SIMULATOR
+    //Same frame again, keep presenting the current buffer so a paused scene
+    //doesn't wake the viewer every tick
+    if (read_buffer != write_buffer && write_buffer->sameAs(read_buffer))
+        return;
+#endif
+    frame_seq++;
+    FRAME_SEQ_FENCE();
     frameBuffer* temp = read_buffer;
     read_buffer = write_buffer;
     write_buffer = temp;
+    FRAME_SEQ_FENCE();
+    frame_seq++;
+
+#ifdef CONFIG_POV_SIMULATOR
+    UpdateHook hook = update_hook;
+    if (hook != NULL)
+        hook(read_buffer, update_ctx);
+#endif
 }
 
 void doubleBuffer::randColor(uint8_t* r, uint8_t* g, uint8_t* b)
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <pov_display/FrameBuffer.h>
+
+// Frame codec shared by the recorder, the golden frame harness and the sprite
+// atlas: a PackBits style RLE and the RGB888 copy of a frame they all encode.
+// Platform neutral, so the harness builds where the recorder (POSIX) doesn't.
+
+#define FRAME_RGB_BYTES (LENGTH * WIDTH * HEIGHT * NUM_COLORS)
+//Worst case rleEncode output for n input bytes
+#define FRAME_RLE_MAX_ENCODED(n) ((n) + (n) / 128 + 16)
+
+//Control byte < 0x80: (c + 1) literal bytes follow. >= 0x80: next byte
+//repeated (c - 0x80 + 3) times
+inline size_t rleEncode(const uint8_t* in, size_t n, uint8_t* out)
+{
+	size_t i = 0, o = 0;
+	while (i < n)
+	{
+		size_t run = 1;
+		while (i + run < n && run < 130 && in[i + run] == in[i])
+			run++;
+		if (run >= 3)
+		{
+			out[o++] = (uint8_t)(0x80 + run - 3);
+			out[o++] = in[i];
+			i += run;
+			continue;
+		}
+		//Literals until the next run of 3 or the 128 byte limit
+		size_t start = i;
+		while (i < n && i - start < 128)
+		{
+			if (i + 2 < n && in[i] == in[i + 1] && in[i] == in[i + 2])
+				break;
+			i++;
+		}
+		out[o++] = (uint8_t)(i - start - 1);
+		memcpy(out + o, in + start, i - start);
+		o += i - start;
+	}
+	return o;
+}
+//Returns false on a corrupt stream or a size mismatch
+inline bool rleDecode(const uint8_t* in, size_t n, uint8_t* out, size_t out_size)
+{
+	size_t i = 0, o = 0;
+	while (i < n)
+	{
+		uint8_t c = in[i++];
+		if (c < 0x80)
+		{
+			size_t len = c + 1;
+			if (i + len > n || o + len > out_size)
+				return false;
+			memcpy(out + o, in + i, len);
+			i += len;
+			o += len;
+		}
+		else
+		{
+			size_t len = c - 0x80 + 3;
+			if (i >= n || o + len > out_size)
+				return false;
+			memset(out + o, in[i++], len);
+			o += len;
+		}
+	}
+	return o == out_size;
+}
+//RGB888 copy of a frame whatever FB_STORAGE is
+inline void frameToRGB(const frameBuffer* frame, uint8_t* out)
+{
+	const int slice = WIDTH * HEIGHT * NUM_COLORS;
+	for (int l = 0; l < LENGTH; l++)
+	{
+		const uint8_t* src = frame->sliceRGB(l, out + l * slice);
+		if (src != out + l * slice)
+			memcpy(out + l * slice, src, slice);
+	}
+}
+
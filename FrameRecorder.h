@@ -0,0 +1,666 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <pov_display/FrameBuffer.h>
+#include "FrameCodec.h"
+
+// Records what the display showed and plays it back later without the scene
+// code. Frames are stored as RGB888; every REC_KEYFRAME_INTERVAL-th frame is a
+// keyframe, the rest are XORed against the previous frame so unchanged LEDs
+// become zero runs. Both kinds go through a PackBits style RLE, which is what
+// makes the deltas tiny. Only frames that differ from the last one reach the
+// recorder (see doubleBuffer::update), timestamps keep the timing.
+//
+// File layout (little endian):
+//   RecFileHeader
+//   records: RecFrameHeader + RLE payload, one per frame
+//   index:   RecIndexEntry per keyframe, header.index_offset points here
+// The player takes keyframe offsets from the index and only walks the delta
+// records after one as it decodes them. A file from a crashed session has
+// index_offset == 0 and is reindexed by scanning the records on open.
+
+#define REC_MAGIC 0x52564F50            //"POVR"
+#define REC_VERSION 1
+#define REC_KEYFRAME_INTERVAL 256       //Worst case seek decodes this many frames
+#define REC_QUEUE_FRAMES 64             //Frames buffered for the writer thread before dropping
+#define REC_FRAME_BYTES FRAME_RGB_BYTES
+#define REC_MAX_ENCODED FRAME_RLE_MAX_ENCODED(REC_FRAME_BYTES)
+
+enum REC_FRAME_TYPE { REC_KEYFRAME = 1, REC_DELTA = 2 };
+
+struct RecFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint16_t length;
+	uint16_t width;
+	uint16_t height;
+	uint16_t colors;
+	uint32_t keyframe_interval;
+	uint32_t frame_count;
+	uint64_t index_offset;
+	uint32_t index_count;
+	uint32_t reserved;
+};
+struct RecFrameHeader {
+	uint32_t payload_size;
+	uint32_t type;
+	uint64_t timestamp_us;
+};
+struct RecIndexEntry {
+	uint32_t frame;
+	uint32_t reserved;
+	uint64_t timestamp_us;
+	uint64_t offset;
+};
+
+class FrameRecorder {
+	public:
+		FrameRecorder();
+		~FrameRecorder() { stop(); }
+
+		//Hooks frame_buffer->update() and records until stop()
+		bool start(const char* path, doubleBuffer* frame_buffer);
+		//Offline writing instead, e.g. baked imports: frames go in through
+		//append() on the calling thread until stop()
+		bool create(const char* path);
+		//False once any write to the file has failed
+		bool append(const uint8_t* rgb, uint64_t timestamp_us);
+		//False if the recording on disk is incomplete
+		bool stop();
+		bool recording() { return file != NULL; }
+
+		uint32_t framesWritten() { return frames_written; }
+		uint32_t framesDropped() { return frames_dropped; }
+		uint64_t bytesWritten() { return bytes_written; }
+
+	private:
+		struct QueuedFrame {
+			uint64_t timestamp_us;
+			std::vector<uint8_t> rgb;
+		};
+
+		FILE* file;
+		doubleBuffer* frame_buffer;
+		std::chrono::steady_clock::time_point start_time;
+		std::thread writer;
+		std::mutex queue_mutex;
+		std::condition_variable queue_cv;
+		std::deque<QueuedFrame> queue;
+		std::vector<std::vector<uint8_t> > free_frames;
+		bool writer_running;
+		bool write_failed;
+
+		RecFileHeader header;
+		std::vector<RecIndexEntry> index;
+		std::vector<uint8_t> prev;
+		std::vector<uint8_t> delta;
+		std::vector<uint8_t> encoded;
+		uint32_t frames_written;
+		uint32_t frames_dropped;
+		uint64_t bytes_written;
+
+		static void onUpdate(const frameBuffer* frame, void* ctx);
+		void capture(const frameBuffer* frame);
+		void writerLoop();
+		void writeFrame(QueuedFrame& f);
+};
+
+FrameRecorder::FrameRecorder()
+{
+	file = NULL;
+	frame_buffer = NULL;
+	writer_running = false;
+	write_failed = false;
+	frames_written = 0;
+	frames_dropped = 0;
+	bytes_written = 0;
+}
+bool FrameRecorder::start(const char* path, doubleBuffer* frame_buffer)
+{
+	if (!create(path))
+		return false;
+	writer_running = true;
+	writer = std::thread(&FrameRecorder::writerLoop, this);
+	this->frame_buffer = frame_buffer;
+	frame_buffer->setUpdateHook(&FrameRecorder::onUpdate, this);
+	printf("Recording to %s\n", path);
+	return true;
+}
+bool FrameRecorder::create(const char* path)
+{
+	stop();
+	file = fopen(path, "wb");
+	if (file == NULL)
+	{
+		printf("Error::RECORDER::Can't open %s\n", path);
+		return false;
+	}
+	memset(&header, 0, sizeof(header));
+	header.magic = REC_MAGIC;
+	header.version = REC_VERSION;
+	header.length = LENGTH;
+	header.width = WIDTH;
+	header.height = HEIGHT;
+	header.colors = NUM_COLORS;
+	header.keyframe_interval = REC_KEYFRAME_INTERVAL;
+	write_failed = fwrite(&header, sizeof(header), 1, file) != 1;
+	bytes_written = sizeof(header);
+
+	index.clear();
+	prev.assign(REC_FRAME_BYTES, 0);
+	delta.resize(REC_FRAME_BYTES);
+	encoded.resize(REC_MAX_ENCODED);
+	frames_written = 0;
+	frames_dropped = 0;
+	start_time = std::chrono::steady_clock::now();
+	return true;
+}
+bool FrameRecorder::append(const uint8_t* rgb, uint64_t timestamp_us)
+{
+	if (file == NULL || writer_running)
+		return false;
+	QueuedFrame f;
+	f.timestamp_us = timestamp_us;
+	f.rgb.assign(rgb, rgb + REC_FRAME_BYTES);
+	writeFrame(f);
+	return !write_failed;
+}
+bool FrameRecorder::stop()
+{
+	if (file == NULL)
+		return false;
+	if (frame_buffer != NULL)
+	{
+		frame_buffer->setUpdateHook(NULL, NULL);
+		frame_buffer = NULL;
+	}
+	if (writer.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(queue_mutex);
+			writer_running = false;
+		}
+		queue_cv.notify_one();
+		writer.join();
+	}
+
+	header.frame_count = frames_written;
+	header.index_offset = bytes_written;
+	header.index_count = (uint32_t)index.size();
+	if (!index.empty() && fwrite(&index[0], sizeof(RecIndexEntry), index.size(), file) != index.size())
+		write_failed = true;
+	if (fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1)
+		write_failed = true;
+	if (fclose(file) != 0)
+		write_failed = true;
+	file = NULL;
+	if (write_failed)
+	{
+		printf("Error::RECORDER::Write failed, the recording is incomplete\n");
+		return false;
+	}
+	printf("Recorded %u frames (%u dropped), %.1f KB\n", frames_written, frames_dropped, bytes_written / 1024.0);
+	return true;
+}
+void FrameRecorder::onUpdate(const frameBuffer* frame, void* ctx)
+{
+	((FrameRecorder*)ctx)->capture(frame);
+}
+void FrameRecorder::capture(const frameBuffer* frame)
+{
+	//Runs on the animation thread, so only copy and hand off
+	uint64_t ts = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+	std::vector<uint8_t> rgb;
+	std::unique_lock<std::mutex> lock(queue_mutex);
+	if (queue.size() >= REC_QUEUE_FRAMES)
+	{
+		frames_dropped++;
+		return;
+	}
+	if (!free_frames.empty())
+	{
+		rgb.swap(free_frames.back());
+		free_frames.pop_back();
+	}
+	lock.unlock();
+
+	rgb.resize(REC_FRAME_BYTES);
+	frameToRGB(frame, &rgb[0]);
+
+	lock.lock();
+	queue.push_back(QueuedFrame());
+	queue.back().timestamp_us = ts;
+	queue.back().rgb.swap(rgb);
+	lock.unlock();
+	queue_cv.notify_one();
+}
+void FrameRecorder::writerLoop()
+{
+	while (1)
+	{
+		QueuedFrame f;
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			queue_cv.wait(lock, [this] { return !writer_running || !queue.empty(); });
+			if (queue.empty())
+				return;
+			f.timestamp_us = queue.front().timestamp_us;
+			f.rgb.swap(queue.front().rgb);
+			queue.pop_front();
+		}
+		writeFrame(f);
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		free_frames.push_back(std::vector<uint8_t>());
+		free_frames.back().swap(f.rgb);
+	}
+}
+void FrameRecorder::writeFrame(QueuedFrame& f)
+{
+	RecFrameHeader fh;
+	fh.timestamp_us = f.timestamp_us;
+	const uint8_t* src = &f.rgb[0];
+	if (frames_written % REC_KEYFRAME_INTERVAL == 0)
+	{
+		fh.type = REC_KEYFRAME;
+		RecIndexEntry entry;
+		entry.frame = frames_written;
+		entry.reserved = 0;
+		entry.timestamp_us = f.timestamp_us;
+		entry.offset = bytes_written;
+		index.push_back(entry);
+	}
+	else
+	{
+		fh.type = REC_DELTA;
+		for (int i = 0; i < REC_FRAME_BYTES; i++)
+		{
+			delta[i] = f.rgb[i] ^ prev[i];
+		}
+		src = &delta[0];
+	}
+	fh.payload_size = (uint32_t)rleEncode(src, REC_FRAME_BYTES, &encoded[0]);
+	if (fwrite(&fh, sizeof(fh), 1, file) != 1 || fwrite(&encoded[0], 1, fh.payload_size, file) != fh.payload_size)
+		write_failed = true;
+	bytes_written += sizeof(fh) + fh.payload_size;
+	prev.swap(f.rgb);
+	frames_written++;
+}
+
+
+class FramePlayer {
+	public:
+		FramePlayer();
+		~FramePlayer() { close(); }
+
+		bool open(const char* path);
+		void close();
+
+		uint32_t frameCount() { return frame_count; }
+		uint64_t durationMicros() { return last_timestamp; }
+
+		//Random access, decodes forward from the nearest keyframe
+		bool seekFrame(uint32_t frame);
+		bool seekTime(uint64_t timestamp_us);
+		//Decodes the next frame, false at the end
+		bool nextFrame();
+		const uint8_t* currentRGB() { return &current[0]; }
+		uint32_t currentFrame() { return cur_frame; }
+		uint64_t currentTimestamp() { return cur_timestamp; }
+		void writeTo(doubleBuffer* frame_buffer);
+
+		//Animation thread side: shows the frame due at wall clock `now`, playing at
+		//`speed`. Returns false once playback finished (loop = false)
+		bool tick(doubleBuffer* frame_buffer, float speed = 1.0f, bool loop = true);
+		//Blocking, speed <= 0 plays as fast as possible. Calls update() per frame
+		void playAll(doubleBuffer* frame_buffer, float speed);
+
+	private:
+		uint8_t* base;
+		size_t size;
+		uint64_t end;                           //Records stop here, the index or file end
+		RecFileHeader header;
+		std::vector<RecIndexEntry> keyframes;
+		uint32_t frame_count;
+		uint64_t last_timestamp;
+		std::vector<uint8_t> current;
+		uint32_t cur_frame;
+		uint64_t cur_offset;
+		uint64_t cur_timestamp;
+		bool have_frame;
+		bool tick_started;
+		std::chrono::steady_clock::time_point tick_start;
+
+		//NULL unless a whole record fits before end
+		const RecFrameHeader* record(uint64_t offset);
+		uint64_t nextRecord(uint64_t offset) { return offset + sizeof(RecFrameHeader) + record(offset)->payload_size; }
+		bool loadIndex(const char* path);
+		void scanRecords(const char* path);
+		bool decode(const RecFrameHeader* fh);
+};
+
+FramePlayer::FramePlayer()
+{
+	base = NULL;
+	size = 0;
+	end = 0;
+	frame_count = 0;
+	last_timestamp = 0;
+	cur_frame = 0;
+	cur_offset = 0;
+	cur_timestamp = 0;
+	have_frame = false;
+	tick_started = false;
+}
+const RecFrameHeader* FramePlayer::record(uint64_t offset)
+{
+	if (offset < sizeof(RecFileHeader) || offset > end || end - offset < sizeof(RecFrameHeader))
+		return NULL;
+	const RecFrameHeader* fh = (const RecFrameHeader*)(base + offset);
+	if (fh->payload_size > end - offset - sizeof(RecFrameHeader))
+		return NULL;
+	return fh;
+}
+bool FramePlayer::open(const char* path)
+{
+	close();
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		printf("Error::PLAYER::Can't open %s\n", path);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		printf("Error::PLAYER::Can't stat %s\n", path);
+		::close(fd);
+		return false;
+	}
+	size = st.st_size;
+	if (size < sizeof(RecFileHeader))
+	{
+		printf("Error::PLAYER::%s is too small\n", path);
+		::close(fd);
+		return false;
+	}
+	void* mem = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mem == MAP_FAILED)
+	{
+		printf("Error::PLAYER::mmap failed\n");
+		return false;
+	}
+	base = (uint8_t*)mem;
+	memcpy(&header, base, sizeof(header));
+	if (header.magic != REC_MAGIC || header.version != REC_VERSION ||
+		header.length != LENGTH || header.width != WIDTH || header.height != HEIGHT || header.colors != NUM_COLORS)
+	{
+		printf("Error::PLAYER::%s isn't a recording for this display\n", path);
+		close();
+		return false;
+	}
+	if (header.index_offset != 0 && (header.index_offset < sizeof(RecFileHeader) || header.index_offset > size))
+	{
+		printf("Error::PLAYER::%s has an index outside the file\n", path);
+		close();
+		return false;
+	}
+
+	if (header.index_offset != 0)
+	{
+		if (!loadIndex(path))
+		{
+			close();
+			return false;
+		}
+	}
+	else
+		scanRecords(path);
+	current.assign(REC_FRAME_BYTES, 0);
+	have_frame = false;
+	tick_started = false;
+	printf("Player: %s, %u frames, %.1f s\n", path, frameCount(), durationMicros() / 1e6);
+	return frame_count > 0;
+}
+//Keyframes come straight from the index, delta records are only found by
+//walking forward from one when they are decoded. The last stretch is walked
+//here for the frame count and duration
+bool FramePlayer::loadIndex(const char* path)
+{
+	end = header.index_offset;
+	uint64_t index_bytes = (uint64_t)header.index_count * sizeof(RecIndexEntry);
+	if (header.index_count == 0 || index_bytes > size - end)
+	{
+		printf("Error::PLAYER::%s has a truncated index\n", path);
+		return false;
+	}
+	//Records have any length, so the index isn't aligned
+	keyframes.resize(header.index_count);
+	memcpy(&keyframes[0], base + end, index_bytes);
+	for (size_t i = 0; i < keyframes.size(); i++)
+	{
+		const RecFrameHeader* fh = record(keyframes[i].offset);
+		bool ordered = i == 0 ? keyframes[i].frame == 0 :
+			keyframes[i].frame > keyframes[i - 1].frame && keyframes[i].offset > keyframes[i - 1].offset;
+		if (fh == NULL || fh->type != REC_KEYFRAME || !ordered || keyframes[i].frame >= header.frame_count)
+		{
+			printf("Error::PLAYER::%s has a bad index entry %zu\n", path, i);
+			return false;
+		}
+		keyframes[i].timestamp_us = fh->timestamp_us;
+	}
+
+	const RecIndexEntry& last = keyframes.back();
+	uint64_t off = last.offset;
+	for (uint32_t f = last.frame; f + 1 < header.frame_count; f++)
+	{
+		off = nextRecord(off);
+		const RecFrameHeader* fh = record(off);
+		if (fh == NULL || fh->type != REC_DELTA)
+		{
+			printf("Error::PLAYER::%s ends before frame %u\n", path, f + 1);
+			return false;
+		}
+	}
+	frame_count = header.frame_count;
+	last_timestamp = record(off)->timestamp_us;
+	return true;
+}
+//No index, the recorder never finished. Walk the record chain once, it's
+//only headers, and stop at the first truncated or unknown record
+void FramePlayer::scanRecords(const char* path)
+{
+	end = size;
+	uint64_t off = sizeof(RecFileHeader);
+	for (const RecFrameHeader* fh = record(off); fh != NULL; fh = record(off))
+	{
+		if (fh->type == REC_KEYFRAME)
+		{
+			RecIndexEntry entry;
+			entry.frame = frame_count;
+			entry.reserved = 0;
+			entry.timestamp_us = fh->timestamp_us;
+			entry.offset = off;
+			keyframes.push_back(entry);
+		}
+		else if (fh->type != REC_DELTA || frame_count == 0)
+			break;
+		frame_count++;
+		last_timestamp = fh->timestamp_us;
+		off = nextRecord(off);
+	}
+	end = off;
+	printf("Player: %s wasn't closed cleanly, recovered %u frames\n", path, frame_count);
+}
+void FramePlayer::close()
+{
+	if (base != NULL)
+		munmap(base, size);
+	base = NULL;
+	end = 0;
+	keyframes.clear();
+	frame_count = 0;
+	last_timestamp = 0;
+	have_frame = false;
+}
+bool FramePlayer::decode(const RecFrameHeader* fh)
+{
+	const uint8_t* payload = (const uint8_t*)(fh + 1);
+	if (fh->type == REC_KEYFRAME)
+		return rleDecode(payload, fh->payload_size, &current[0], REC_FRAME_BYTES);
+	if (fh->type != REC_DELTA)
+		return false;
+
+	uint8_t delta[REC_FRAME_BYTES];
+	if (!rleDecode(payload, fh->payload_size, delta, REC_FRAME_BYTES))
+		return false;
+	for (int i = 0; i < REC_FRAME_BYTES; i++)
+	{
+		current[i] ^= delta[i];
+	}
+	return true;
+}
+bool FramePlayer::seekFrame(uint32_t frame)
+{
+	if (frame >= frameCount())
+		return false;
+	if (have_frame && frame == cur_frame)
+		return true;
+	uint32_t f;
+	uint64_t off;
+	if (have_frame && frame > cur_frame && frame - cur_frame < REC_KEYFRAME_INTERVAL)
+	{
+		//Closer to roll forward from where we are
+		f = cur_frame + 1;
+		off = nextRecord(cur_offset);
+	}
+	else
+	{
+		RecIndexEntry key;
+		key.frame = frame;
+		std::vector<RecIndexEntry>::iterator it = std::upper_bound(keyframes.begin(), keyframes.end(), key,
+			[](const RecIndexEntry& a, const RecIndexEntry& b) { return a.frame < b.frame; });
+		--it;
+		f = it->frame;
+		off = it->offset;
+	}
+	for (;; f++)
+	{
+		const RecFrameHeader* fh = record(off);
+		if (fh == NULL || !decode(fh))
+		{
+			printf("Error::PLAYER::Frame %u is corrupt\n", f);
+			have_frame = false;
+			return false;
+		}
+		cur_frame = f;
+		cur_offset = off;
+		cur_timestamp = fh->timestamp_us;
+		if (f == frame)
+			break;
+		off = nextRecord(off);
+	}
+	have_frame = true;
+	return true;
+}
+bool FramePlayer::seekTime(uint64_t timestamp_us)
+{
+	if (frame_count == 0)
+		return false;
+	//Last keyframe at or before the timestamp, then walk the headers after it
+	//(or after the current frame if that is closer)
+	RecIndexEntry key;
+	key.timestamp_us = timestamp_us;
+	std::vector<RecIndexEntry>::iterator it = std::upper_bound(keyframes.begin(), keyframes.end(), key,
+		[](const RecIndexEntry& a, const RecIndexEntry& b) { return a.timestamp_us < b.timestamp_us; });
+	if (it != keyframes.begin())
+		--it;
+	uint32_t f = it->frame;
+	uint64_t off = it->offset;
+	if (have_frame && cur_frame >= f && cur_timestamp <= timestamp_us)
+	{
+		f = cur_frame;
+		off = cur_offset;
+	}
+	while (f + 1 < frame_count)
+	{
+		const RecFrameHeader* next = record(nextRecord(off));
+		if (next == NULL || next->timestamp_us > timestamp_us)
+			break;
+		off = nextRecord(off);
+		f++;
+	}
+	return seekFrame(f);
+}
+bool FramePlayer::nextFrame()
+{
+	if (!have_frame)
+		return seekFrame(0);
+	return seekFrame(cur_frame + 1);
+}
+void FramePlayer::writeTo(doubleBuffer* frame_buffer)
+{
+	const uint8_t* px = &current[0];
+	for (int i = 0; i < LENGTH; i++)
+	{
+		for (int j = 0; j < WIDTH; j++)
+		{
+			for (int k = 0; k < HEIGHT; k++, px += NUM_COLORS)
+			{
+				frame_buffer->setColors(i, j, k, px[RED], px[GREEN], px[BLUE]);
+			}
+		}
+	}
+}
+bool FramePlayer::tick(doubleBuffer* frame_buffer, float speed, bool loop)
+{
+	if (frame_count == 0)
+		return false;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (!tick_started)
+	{
+		tick_start = now;
+		tick_started = true;
+	}
+	uint64_t t = (uint64_t)(std::chrono::duration<double, std::micro>(now - tick_start).count() * speed) + keyframes[0].timestamp_us;
+	if (t > durationMicros())
+	{
+		if (!loop)
+			return false;
+		tick_start = now;
+		t = keyframes[0].timestamp_us;
+	}
+	seekTime(t);
+	writeTo(frame_buffer);
+	return true;
+}
+void FramePlayer::playAll(doubleBuffer* frame_buffer, float speed)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t f = 0; f < frameCount(); f++)
+	{
+		if (!seekFrame(f))
+			return;
+		if (speed > 0.0f)
+		{
+			uint64_t due = (uint64_t)((currentTimestamp() - keyframes[0].timestamp_us) / speed);
+			std::this_thread::sleep_until(start + std::chrono::microseconds(due));
+		}
+		frame_buffer->clear();
+		writeTo(frame_buffer);
+		frame_buffer->update();
+	}
+}
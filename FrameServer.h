@@ -0,0 +1,402 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <new>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <pov_display/FrameBuffer.h>
+
+// Shares the LED frame with other processes through a POSIX shared memory
+// segment, so external renderers can drive the display without going
+// through main_exec or the serial style event path.
+//
+// Segment layout (all little endian, offsets from the start of the mapping):
+//   FrameShmHeader                       at 0
+//   FrameShmSlot[FRAME_SHM_SLOTS]        at header.slot_offset, slot_stride apart
+// Each slot holds seq, publish time (CLOCK_MONOTONIC ns) and the pixels as
+// RGB888 [LENGTH][WIDTH][HEIGHT][3], the same layout as frameBuffer::fbuf_.
+//
+// The slots form a triple buffer. The producer owns one slot, the consumer
+// one, and `ready` holds the third plus a fresh bit. Publishing swaps the
+// producer slot into `ready`, acquiring swaps the consumer slot out of it, so
+// neither side ever waits and the consumer reads pixels in place.
+
+#define FRAME_SHM_NAME "/pov_display_frames"
+#define FRAME_SHM_MAGIC 0x46564F50      //"POVF"
+#define FRAME_SHM_VERSION 1
+#define FRAME_SHM_SLOTS 3
+#define FRAME_SHM_FRESH 0x4
+#define FRAME_SERVER_TIMEOUT_MS 500     //Fall back to main_exec after this long without frames
+
+struct FrameShmHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t length;
+	uint32_t width;
+	uint32_t height;
+	uint32_t colors;
+	uint32_t slot_offset;
+	uint32_t slot_stride;
+	std::atomic<uint32_t> ready;            //Slot index | FRAME_SHM_FRESH
+	std::atomic<uint32_t> front;            //Slot the display is reading
+	std::atomic<int32_t> producer_pid;      //0 = no client attached
+	std::atomic<uint32_t> published;        //Frames published since creation
+};
+
+static_assert(sizeof(FrameShmHeader) <= 64, "slots start at offset 64");
+
+struct FrameShmSlot {
+	uint64_t seq;
+	uint64_t publish_ns;
+	uint8_t pixels[LENGTH][WIDTH][HEIGHT][NUM_COLORS];
+};
+
+inline uint64_t monotonicNanos()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+inline size_t frameShmSlotStride()
+{
+	return (sizeof(FrameShmSlot) + 63) & ~(size_t)63;
+}
+inline size_t frameShmSize()
+{
+	return 64 + FRAME_SHM_SLOTS * frameShmSlotStride();
+}
+//From our own constants, slot_offset/slot_stride in the header are client writable
+inline FrameShmSlot* frameShmSlot(uint8_t* base, uint32_t idx)
+{
+	return (FrameShmSlot*)(base + 64 + idx * frameShmSlotStride());
+}
+
+
+// Display side, owns the segment
+class FrameServer {
+	public:
+		FrameServer() : header(NULL), base(NULL), size(0), front(0) {}
+		~FrameServer() { destroy(); }
+
+		bool create(const char* name = FRAME_SHM_NAME);
+		void destroy();
+		bool isOpen() { return base != NULL; }
+
+		//Latest client frame if one arrived within FRAME_SERVER_TIMEOUT_MS, else
+		//NULL. The returned frame stays valid and untouched until the next call
+		const frameBuffer* acquire(uint32_t* seq = NULL, uint64_t* publish_ns = NULL);
+
+	private:
+		FrameShmHeader* header;
+		uint8_t* base;
+		size_t size;
+		std::string shm_name;
+		uint32_t front;                 //Our copy, header->front is only published for clients
+
+		FrameShmSlot* slot(uint32_t idx) { return frameShmSlot(base, idx); }
+};
+
+// Producer side, for external renderers
+class FrameClient {
+	public:
+		FrameClient() : header(NULL), base(NULL), size(0), back(0), seq(0) {}
+		~FrameClient() { disconnect(); }
+
+		bool connect(const char* name = FRAME_SHM_NAME);
+		void disconnect();
+
+		//Pixels of the slot being drawn, RGB888 [LENGTH][WIDTH][HEIGHT][3]
+		uint8_t* pixels() { return &slot(back)->pixels[0][0][0][0]; }
+		void setColors(int l, int w, int h, uint8_t r, uint8_t g, uint8_t b);
+		void clear() { memset(slot(back)->pixels, 0, sizeof(slot(back)->pixels)); }
+		//Hands the slot to the display and starts a new one
+		void publish();
+
+	private:
+		FrameShmHeader* header;
+		uint8_t* base;
+		size_t size;
+		uint32_t back;
+		uint64_t seq;
+
+		FrameShmSlot* slot(uint32_t idx) { return frameShmSlot(base, idx); }
+};
+
+
+bool FrameServer::create(const char* name)
+{
+#if FB_STORAGE != FB_RGB888
+	//Slots are handed out as frameBuffers, which only match in RGB888 mode
+	printf("Error::FRAME_SERVER::Needs FB_STORAGE == FB_RGB888\n");
+	return false;
+#endif
+	destroy();
+	//Owner only, clients run as the same user as the viewer. Never take over
+	//an existing name, it may be another viewer's or someone else's segment
+	int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0)
+	{
+		if (errno == EEXIST)
+			printf("Error::FRAME_SERVER::%s already exists, another viewer running or left over from a crash\n", name);
+		else
+			printf("Error::FRAME_SERVER::shm_open %s failed\n", name);
+		return false;
+	}
+	size = frameShmSize();
+	if (ftruncate(fd, size) != 0)
+	{
+		printf("Error::FRAME_SERVER::ftruncate failed\n");
+		close(fd);
+		shm_unlink(name);
+		return false;
+	}
+	void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED)
+	{
+		printf("Error::FRAME_SERVER::mmap failed\n");
+		shm_unlink(name);
+		return false;
+	}
+	base = (uint8_t*)mem;
+	shm_name = name;
+	memset(base, 0, size);
+
+	header = new (base) FrameShmHeader();
+	header->version = FRAME_SHM_VERSION;
+	header->length = LENGTH;
+	header->width = WIDTH;
+	header->height = HEIGHT;
+	header->colors = NUM_COLORS;
+	header->slot_offset = 64;
+	header->slot_stride = (uint32_t)frameShmSlotStride();
+	front = 0;
+	header->front.store(front);
+	header->ready.store(1);
+	header->producer_pid.store(0);
+	header->published.store(0);
+	//Clients check magic last, so it goes in once everything else is valid
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = FRAME_SHM_MAGIC;
+	printf("Frame server: %s, %zu bytes\n", name, size);
+	return true;
+}
+void FrameServer::destroy()
+{
+	if (base == NULL)
+		return;
+	munmap(base, size);
+	shm_unlink(shm_name.c_str());
+	base = NULL;
+	header = NULL;
+}
+const frameBuffer* FrameServer::acquire(uint32_t* seq, uint64_t* publish_ns)
+{
+	if (base == NULL)
+		return NULL;
+
+	if (header->ready.load(std::memory_order_relaxed) & FRAME_SHM_FRESH)
+	{
+		//Our old slot becomes the new (stale) ready one
+		uint32_t prev = header->ready.exchange(front, std::memory_order_acq_rel);
+		uint32_t next = prev & ~(uint32_t)FRAME_SHM_FRESH;
+		if (next >= FRAME_SHM_SLOTS)
+			return NULL;        //Garbage from the client, keep our slot and treat as stale
+		front = next;
+		header->front.store(front, std::memory_order_relaxed);
+	}
+
+	FrameShmSlot* s = slot(front);
+	if (s->seq == 0)
+		return NULL;
+	if (monotonicNanos() - s->publish_ns > FRAME_SERVER_TIMEOUT_MS * 1000000ull)
+		return NULL;
+	if (seq)
+		*seq = (uint32_t)s->seq;
+	if (publish_ns)
+		*publish_ns = s->publish_ns;
+	return (const frameBuffer*)s->pixels;
+}
+
+bool FrameClient::connect(const char* name)
+{
+	disconnect();
+	int fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0)
+	{
+		printf("Error::FRAME_CLIENT::No frame server at %s\n", name);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < frameShmSize())
+	{
+		printf("Error::FRAME_CLIENT::Segment too small\n");
+		close(fd);
+		return false;
+	}
+	size = st.st_size;
+	void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED)
+	{
+		printf("Error::FRAME_CLIENT::mmap failed\n");
+		return false;
+	}
+	base = (uint8_t*)mem;
+	header = (FrameShmHeader*)base;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (header->magic != FRAME_SHM_MAGIC || header->version != FRAME_SHM_VERSION ||
+		header->length != LENGTH || header->width != WIDTH || header->height != HEIGHT || header->colors != NUM_COLORS)
+	{
+		printf("Error::FRAME_CLIENT::Layout mismatch\n");
+		disconnect();
+		return false;
+	}
+
+	//One producer at a time, take over from one that died without detaching
+	int32_t pid = getpid();
+	int32_t owner = header->producer_pid.load();
+	while (owner != pid)
+	{
+		if (owner != 0 && kill(owner, 0) == 0)
+		{
+			printf("Error::FRAME_CLIENT::Already driven by pid %d\n", owner);
+			munmap(base, size);
+			base = NULL;
+			header = NULL;
+			return false;
+		}
+		if (header->producer_pid.compare_exchange_weak(owner, pid))
+			break;
+	}
+
+	//The display only ever swaps front and ready, so the third slot is ours.
+	//Re-read until we didn't land in the middle of an acquire()
+	uint32_t front, ready;
+	while (1)
+	{
+		uint32_t r1 = header->ready.load();
+		front = header->front.load();
+		uint32_t r2 = header->ready.load();
+		ready = r2 & 0x3;
+		if (r1 == r2 && front == header->front.load() && ready != front)
+			break;
+	}
+	back = 3 - front - ready;
+	seq = 0;
+	for (uint32_t i = 0; i < FRAME_SHM_SLOTS; i++)
+	{
+		if (slot(i)->seq > seq)
+			seq = slot(i)->seq;
+	}
+	clear();
+	return true;
+}
+void FrameClient::disconnect()
+{
+	if (base == NULL)
+		return;
+	int32_t pid = getpid();
+	header->producer_pid.compare_exchange_strong(pid, 0);
+	munmap(base, size);
+	base = NULL;
+	header = NULL;
+}
+void FrameClient::setColors(int l, int w, int h, uint8_t r, uint8_t g, uint8_t b)
+{
+	if (l < 0 || w < 0 || h < 0 || l >= LENGTH || w >= WIDTH || h >= HEIGHT)
+		return;
+	uint8_t* px = slot(back)->pixels[l][w][h];
+	px[RED] = r;
+	px[GREEN] = g;
+	px[BLUE] = b;
+}
+void FrameClient::publish()
+{
+	FrameShmSlot* s = slot(back);
+	s->seq = ++seq;
+	s->publish_ns = monotonicNanos();
+	uint32_t prev = header->ready.exchange(back | FRAME_SHM_FRESH, std::memory_order_acq_rel);
+	back = prev & 0x3;
+	header->published.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+// Producer and consumer on separate threads through a real segment. First
+// publishes flat out for raw handoff throughput, then at a fixed interval so
+// the display thread sees every frame, for publish -> acquire latency
+void benchFrameServer(int frames = 20000, int paced_frames = 2000, int pace_us = 500)
+{
+	const char* name = "/pov_display_bench";
+	FrameServer server;
+	if (!server.create(name))
+		return;
+	FrameClient client;
+	if (!client.connect(name))
+		return;
+
+	uint64_t t0 = monotonicNanos();
+	for (int f = 0; f < frames; f++)
+	{
+		memset(client.pixels(), f & 0xFF, LENGTH * WIDTH * HEIGHT * NUM_COLORS);
+		client.publish();
+	}
+	uint64_t t1 = monotonicNanos();
+	double secs = (t1 - t0) / 1e9;
+	printf("Frame server: %d frames published in %.1f ms (%.0f frames/s, %.0f MB/s)\n",
+		frames, secs * 1000.0, frames / secs, frames * (double)sizeof(FrameShmSlot) / secs / 1e6);
+
+	std::atomic<bool> done(false);
+	std::vector<double> latency_us;
+	latency_us.reserve(paced_frames);
+	std::thread consumer([&]() {
+		uint32_t last = 0;
+		server.acquire(&last);
+		while (!done.load())
+		{
+			uint32_t seq;
+			uint64_t publish_ns;
+			const frameBuffer* fb = server.acquire(&seq, &publish_ns);
+			if (fb == NULL || seq == last)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			latency_us.push_back((monotonicNanos() - publish_ns) / 1000.0);
+			//Touch the frame like the scan-out would
+			volatile uint8_t sink = fb->getChannel(seq % LENGTH, 0, 0, RED);
+			(void)sink;
+			last = seq;
+		}
+	});
+	for (int f = 0; f < paced_frames; f++)
+	{
+		memset(client.pixels(), f & 0xFF, LENGTH * WIDTH * HEIGHT * NUM_COLORS);
+		client.publish();
+		std::this_thread::sleep_for(std::chrono::microseconds(pace_us));
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	done = true;
+	consumer.join();
+	client.disconnect();
+
+	std::sort(latency_us.begin(), latency_us.end());
+	printf("Frame server: paced %d frames every %d us, %zu seen by display\n", paced_frames, pace_us, latency_us.size());
+	if (!latency_us.empty())
+	{
+		printf("Frame server: latency p50 %.1f us, p99 %.1f us, max %.1f us\n",
+			latency_us[latency_us.size() / 2], latency_us[latency_us.size() * 99 / 100], latency_us.back());
+	}
+}
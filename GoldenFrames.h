@@ -0,0 +1,413 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include <vector>
+#include "Arduino.h"
+#include "Shell.h"
+#include "FrameCodec.h"
+#include <pov_display/FrameBuffer.h>
+#include <pov_display/Events.h>
+#include <pov_display/test_animations.h>
+#include <pov_display/Space_Game.h>
+
+// Golden frame regression harness. Every tick-style scene is run for a fixed
+// number of ticks from a fixed rand() seed, with the Arduino virtual clock on
+// and scripted button events instead of the controller. Each frame is hashed
+// (goldenHash) and compared with the hash sequence stored for that scene.
+// The golden file also keeps the frames themselves, XOR delta + RLE like the
+// recorder (FrameCodec.h), so a mismatch can dump the expected, actual and
+// diff frames.
+//
+// File layout (little endian):
+//   GoldenFileHeader
+//   uint64_t hash[ticks]
+//   per tick: uint32_t payload_size + RLE(frame XOR previous frame)
+//
+// Scenes keep their state in function statics, so each scene can only be run
+// once per process: the harness has to run before anything else draws.
+// Golden files depend on FB_STORAGE and on the C library's rand().
+
+#define GOLDEN_MAGIC 0x47564F50         //"POVG"
+#define GOLDEN_VERSION 1
+#define GOLDEN_SEED 1234
+#define GOLDEN_TICKS 1200               //6 s of animation at TICK_DELAY
+#define GOLDEN_TICK_MS 5                //Virtual time per tick, TICK_DELAY
+#define GOLDEN_DUMP_SCALE 4             //Pixel size of the PPM diff dumps
+#define GOLDEN_FRAME_BYTES FRAME_RGB_BYTES
+#define GOLDEN_MAX_ENCODED FRAME_RLE_MAX_ENCODED(GOLDEN_FRAME_BYTES)
+
+struct GoldenFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint16_t length;
+	uint16_t width;
+	uint16_t height;
+	uint16_t colors;
+	uint32_t storage;
+	uint32_t seed;
+	uint32_t ticks;
+	uint32_t reserved;
+};
+
+//Button event pushed into eventBuffer before the given tick
+struct GoldenInput {
+	uint32_t tick;
+	Event::EVENT type;
+	uint8_t button;
+};
+
+struct GoldenScene {
+	const char* name;
+	void (*tick)(doubleBuffer* frame_buffer);
+	const GoldenInput* inputs;
+	int num_inputs;
+};
+
+enum GOLDEN_MODE { GOLDEN_CHECK, GOLDEN_UPDATE };
+
+//64-bit hash over whole words, the frame is a multiple of 8 bytes
+inline uint64_t goldenHash(const uint8_t* data, size_t n)
+{
+	const uint64_t k0 = 0x9E3779B97F4A7C15ull;
+	const uint64_t k1 = 0xBF58476D1CE4E5B9ull;
+	uint64_t h = k0 ^ (n * k1);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		uint64_t w;
+		memcpy(&w, data + i, 8);
+		w *= k1;
+		w ^= w >> 31;
+		h = (h ^ w) * k0;
+		h = (h << 27) | (h >> 37);
+	}
+	for (; i < n; i++)
+		h = (h ^ data[i]) * k0;
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+inline void goldenMakeDir(const char* dir)
+{
+#ifdef _WIN32
+	_mkdir(dir);
+#else
+	mkdir(dir, 0755);
+#endif
+}
+
+//Scene wrappers, games are created on the first tick so they see the seed
+void goldenSpaceGame(doubleBuffer* frame_buffer)
+{
+	static SpaceGame game;
+	game.update();
+	game.draw(frame_buffer);
+}
+void goldenMazeGame(doubleBuffer* frame_buffer)
+{
+	static MazeGame game;
+	static bool started = false;
+	if (!started)
+	{
+		game.init();
+		started = true;
+	}
+	game.update();
+	game.draw(frame_buffer);
+}
+
+//Scripted controller input. Space game: DLEFT/DRIGHT steer, SQUARE fires,
+//OPTIONS pauses. Maze game uses raw button numbers 1-7 (see MazeGame)
+static const GoldenInput space_game_inputs[] = {
+	{ 50, Event::ON_PRESS, SQUARE }, { 60, Event::ON_RELEASE, SQUARE },
+	{ 100, Event::ON_PRESS, DRIGHT }, { 300, Event::ON_RELEASE, DRIGHT },
+	{ 320, Event::ON_PRESS, LBUMP }, { 400, Event::ON_RELEASE, LBUMP },
+	{ 420, Event::ON_PRESS, SQUARE }, { 430, Event::ON_RELEASE, SQUARE },
+	{ 500, Event::ON_PRESS, DLEFT }, { 650, Event::ON_RELEASE, DLEFT },
+	{ 700, Event::ON_PRESS, OPTIONS }, { 710, Event::ON_RELEASE, OPTIONS },
+	{ 800, Event::ON_PRESS, OPTIONS }, { 810, Event::ON_RELEASE, OPTIONS },
+	{ 900, Event::ON_PRESS, RBUMP }, { 1000, Event::ON_RELEASE, RBUMP },
+};
+static const GoldenInput maze_game_inputs[] = {
+	{ 20, Event::ON_PRESS, 3 }, { 300, Event::ON_RELEASE, 3 },
+	{ 320, Event::ON_PRESS, 4 }, { 360, Event::ON_RELEASE, 4 },
+	{ 380, Event::ON_PRESS, 6 }, { 420, Event::ON_RELEASE, 6 },
+	{ 440, Event::ON_PRESS, 1 }, { 600, Event::ON_RELEASE, 1 },
+	{ 620, Event::ON_PRESS, 5 }, { 660, Event::ON_RELEASE, 5 },
+	{ 680, Event::ON_PRESS, 7 }, { 720, Event::ON_RELEASE, 7 },
+	{ 740, Event::ON_PRESS, 3 }, { 1100, Event::ON_RELEASE, 3 },
+};
+
+//Scenes that block in delay() (wobbly_words, random_walk, ...) run their
+//own loop and can't be ticked, they are left out
+static const GoldenScene golden_scenes[] = {
+	{ "textAnimation", textAnimation, NULL, 0 },
+	{ "pinWheelAnimation_0", pinWheelAnimation_0, NULL, 0 },
+	{ "vortexAnimation", vortexAnimation, NULL, 0 },
+	{ "pulseAnimation", pulseAnimation, NULL, 0 },
+	{ "pinWheelAnimation_1", pinWheelAnimation_1, NULL, 0 },
+	{ "rainbow_swirl", rainbow_swirl, NULL, 0 },
+	{ "uprightTextAnimation", uprightTextAnimation, NULL, 0 },
+	{ "SpaceGame", goldenSpaceGame, space_game_inputs, sizeof(space_game_inputs) / sizeof(space_game_inputs[0]) },
+	{ "MazeGame", goldenMazeGame, maze_game_inputs, sizeof(maze_game_inputs) / sizeof(maze_game_inputs[0]) },
+};
+static const int NUM_GOLDEN_SCENES = sizeof(golden_scenes) / sizeof(golden_scenes[0]);
+
+//Unrolled frame: x = slice, y = width rows of HEIGHT, top row is h = HEIGHT - 1
+bool writeGoldenPPM(const char* path, const uint8_t* rgb)
+{
+	const int w = LENGTH * GOLDEN_DUMP_SCALE;
+	const int h = WIDTH * (HEIGHT + 1) * GOLDEN_DUMP_SCALE;
+	std::vector<uint8_t> img(w * h * 3, 40);
+	for (int l = 0; l < LENGTH; l++)
+	{
+		for (int j = 0; j < WIDTH; j++)
+		{
+			for (int k = 0; k < HEIGHT; k++)
+			{
+				const uint8_t* px = rgb + ((l * WIDTH + j) * HEIGHT + k) * NUM_COLORS;
+				int y0 = (j * (HEIGHT + 1) + HEIGHT - 1 - k) * GOLDEN_DUMP_SCALE;
+				for (int dy = 0; dy < GOLDEN_DUMP_SCALE; dy++)
+					for (int dx = 0; dx < GOLDEN_DUMP_SCALE; dx++)
+						memcpy(&img[((y0 + dy) * w + l * GOLDEN_DUMP_SCALE + dx) * 3], px, 3);
+			}
+		}
+	}
+	FILE* f = fopen(path, "wb");
+	if (f == NULL)
+		return false;
+	fprintf(f, "P6\n%d %d\n255\n", w, h);
+	size_t written = fwrite(&img[0], 1, img.size(), f);
+	fclose(f);
+	return written == img.size();
+}
+
+//Writes <dir>/<scene>_<tick>_{expected,actual,diff}.ppm, diff is white where LEDs differ
+int dumpGoldenMismatch(const char* dir, const char* scene, uint32_t tick, const uint8_t* expected, const uint8_t* actual)
+{
+	static uint8_t diff[GOLDEN_FRAME_BYTES];
+	int leds = 0;
+	for (int i = 0; i < GOLDEN_FRAME_BYTES; i += NUM_COLORS)
+	{
+		bool differs = memcmp(expected + i, actual + i, NUM_COLORS) != 0;
+		memset(diff + i, differs ? 0xFF : 0x00, NUM_COLORS);
+		leds += differs;
+	}
+	char path[512];
+	snprintf(path, sizeof(path), "%s/%s_%u_expected.ppm", dir, scene, tick);
+	writeGoldenPPM(path, expected);
+	snprintf(path, sizeof(path), "%s/%s_%u_actual.ppm", dir, scene, tick);
+	writeGoldenPPM(path, actual);
+	snprintf(path, sizeof(path), "%s/%s_%u_diff.ppm", dir, scene, tick);
+	writeGoldenPPM(path, diff);
+	return leds;
+}
+
+bool readGoldenFile(const char* path, std::vector<uint8_t>& data)
+{
+	FILE* f = fopen(path, "rb");
+	if (f == NULL)
+		return false;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data.resize(size > 0 ? size : 0);
+	bool ok = size > 0 && fread(&data[0], 1, size, f) == (size_t)size;
+	fclose(f);
+	return ok;
+}
+
+//Runs one scene and checks or rewrites its golden file, true = pass
+bool runGoldenScene(const GoldenScene& scene, GOLDEN_MODE mode, const char* dir, uint32_t ticks)
+{
+	char path[512];
+	snprintf(path, sizeof(path), "%s/%s.golden", dir, scene.name);
+
+	std::vector<uint8_t> golden;
+	const GoldenFileHeader* header = NULL;
+	const uint64_t* golden_hash = NULL;
+	size_t read_pos = 0;
+	if (mode == GOLDEN_CHECK)
+	{
+		if (!readGoldenFile(path, golden) || golden.size() < sizeof(GoldenFileHeader))
+		{
+			printf("Error::Golden::Can't read %s, run --golden update first\n", path);
+			return false;
+		}
+		header = (const GoldenFileHeader*)&golden[0];
+		if (header->magic != GOLDEN_MAGIC || header->version != GOLDEN_VERSION ||
+			header->length != LENGTH || header->width != WIDTH || header->height != HEIGHT ||
+			header->colors != NUM_COLORS || header->storage != FB_STORAGE || header->seed != GOLDEN_SEED ||
+			golden.size() < sizeof(GoldenFileHeader) + header->ticks * sizeof(uint64_t))
+		{
+			printf("Error::Golden::%s was made for a different build, run --golden update\n", path);
+			return false;
+		}
+		ticks = header->ticks;
+		golden_hash = (const uint64_t*)&golden[sizeof(GoldenFileHeader)];
+		read_pos = sizeof(GoldenFileHeader) + ticks * sizeof(uint64_t);
+	}
+
+	//Same starting point every run, and no timing dependent quality steps
+	srand(GOLDEN_SEED);
+	scene_budget.setAdaptive(false);
+	virtual_clock = true;
+	virtual_time_ms = 0;
+	Event e;
+	while (eventBuffer.pop(e))
+		;
+
+	static doubleBuffer frame_buffer;
+	static uint8_t rgb[GOLDEN_FRAME_BYTES];
+	static uint8_t prev[GOLDEN_FRAME_BYTES];
+	static uint8_t expected[GOLDEN_FRAME_BYTES];
+	static uint8_t delta[GOLDEN_FRAME_BYTES];
+	static uint8_t encoded[GOLDEN_MAX_ENCODED];
+	memset(prev, 0, sizeof(prev));
+	memset(expected, 0, sizeof(expected));
+
+	std::vector<uint64_t> hashes;
+	std::vector<uint8_t> frames;
+	uint32_t mismatches = 0;
+	uint32_t first_mismatch = 0;
+	int input = 0;
+	for (uint32_t t = 0; t < ticks; t++)
+	{
+		while (input < scene.num_inputs && scene.inputs[input].tick <= t)
+		{
+			eventBuffer.push(Event(scene.inputs[input].type, scene.inputs[input].button));
+			input++;
+		}
+		frame_buffer.clear();
+		scene.tick(&frame_buffer);
+		frame_buffer.update();
+		advanceVirtualClock(GOLDEN_TICK_MS);
+
+		frameToRGB(frame_buffer.getReadBuffer(), rgb);
+		uint64_t hash = goldenHash(rgb, GOLDEN_FRAME_BYTES);
+
+		if (mode == GOLDEN_UPDATE)
+		{
+			for (int i = 0; i < GOLDEN_FRAME_BYTES; i++)
+				delta[i] = rgb[i] ^ prev[i];
+			uint32_t size = (uint32_t)rleEncode(delta, GOLDEN_FRAME_BYTES, encoded);
+			frames.insert(frames.end(), (uint8_t*)&size, (uint8_t*)&size + sizeof(size));
+			frames.insert(frames.end(), encoded, encoded + size);
+			hashes.push_back(hash);
+			memcpy(prev, rgb, sizeof(prev));
+			continue;
+		}
+
+		//Expected frames are only needed up to the first mismatch
+		if (mismatches == 0)
+		{
+			uint32_t size = 0;
+			if (read_pos + sizeof(size) <= golden.size())
+				memcpy(&size, &golden[read_pos], sizeof(size));
+			read_pos += sizeof(size);
+			if (read_pos + size > golden.size() || !rleDecode(&golden[read_pos], size, delta, GOLDEN_FRAME_BYTES))
+			{
+				printf("Error::Golden::%s is corrupt at tick %u\n", path, t);
+				return false;
+			}
+			read_pos += size;
+			for (int i = 0; i < GOLDEN_FRAME_BYTES; i++)
+				expected[i] ^= delta[i];
+		}
+		if (hash != golden_hash[t])
+		{
+			if (mismatches++ == 0)
+			{
+				first_mismatch = t;
+				int leds = dumpGoldenMismatch(dir, scene.name, t, expected, rgb);
+				printf("Golden: %s differs at tick %u, %d LEDs, dumped %s/%s_%u_*.ppm\n", scene.name, t, leds, dir, scene.name, t);
+			}
+		}
+	}
+	virtual_clock = false;
+
+	if (mode == GOLDEN_UPDATE)
+	{
+		GoldenFileHeader h;
+		memset(&h, 0, sizeof(h));
+		h.magic = GOLDEN_MAGIC;
+		h.version = GOLDEN_VERSION;
+		h.length = LENGTH;
+		h.width = WIDTH;
+		h.height = HEIGHT;
+		h.colors = NUM_COLORS;
+		h.storage = FB_STORAGE;
+		h.seed = GOLDEN_SEED;
+		h.ticks = ticks;
+		FILE* f = fopen(path, "wb");
+		if (f == NULL)
+		{
+			printf("Error::Golden::Can't write %s\n", path);
+			return false;
+		}
+		bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+			fwrite(&hashes[0], sizeof(uint64_t), hashes.size(), f) == hashes.size() &&
+			fwrite(&frames[0], 1, frames.size(), f) == frames.size();
+		fclose(f);
+		printf("Golden: %s %u ticks written to %s (%zu bytes)\n", scene.name, ticks, path, sizeof(h) + hashes.size() * sizeof(uint64_t) + frames.size());
+		return ok;
+	}
+	if (mismatches > 0)
+	{
+		printf("Golden: %s FAILED, %u of %u ticks differ, first at %u\n", scene.name, mismatches, ticks, first_mismatch);
+		return false;
+	}
+	printf("Golden: %s ok, %u ticks\n", scene.name, ticks);
+	return true;
+}
+
+//Entry point for --golden check|update [dir] [scene], returns the process exit code
+int runGoldenFrames(GOLDEN_MODE mode, const char* dir, const char* only_scene = NULL)
+{
+	goldenMakeDir(dir);
+	int failed = 0, run = 0;
+	for (int i = 0; i < NUM_GOLDEN_SCENES; i++)
+	{
+		if (only_scene != NULL && strcmp(only_scene, golden_scenes[i].name) != 0)
+			continue;
+		run++;
+		if (!runGoldenScene(golden_scenes[i], mode, dir, GOLDEN_TICKS))
+			failed++;
+	}
+	if (run == 0)
+	{
+		printf("Error::Golden::No scene named %s\n", only_scene);
+		return 1;
+	}
+	printf("Golden: %d of %d scenes %s\n", run - failed, run, mode == GOLDEN_CHECK ? "match" : "written");
+	return failed ? 1 : 0;
+}
+
+//Parses --golden check|update [dir] [scene], false if --golden isn't argv[1].
+//dir is NULL after a usage error
+bool parseGoldenArgs(int argc, char** argv, GOLDEN_MODE& mode, const char*& dir, const char*& scene)
+{
+	if (argc < 2 || strcmp(argv[1], "--golden") != 0)
+		return false;
+	if (argc < 3 || (strcmp(argv[2], "check") != 0 && strcmp(argv[2], "update") != 0))
+	{
+		printf("Usage: --golden check|update [dir] [scene]\n");
+		dir = NULL;
+		return true;
+	}
+	mode = strcmp(argv[2], "update") == 0 ? GOLDEN_UPDATE : GOLDEN_CHECK;
+	dir = argc > 3 ? argv[3] : "golden";
+	scene = argc > 4 ? argv[4] : NULL;
+	return true;
+}
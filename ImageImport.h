@@ -0,0 +1,303 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include "AssetLoader.h"
+#include "SpriteAtlas.h"
+#include "FrameRecorder.h"
+#include <pov_display/Sprite.h>
+
+// Image import. Photos and frame sequences are resampled onto one surface of
+// the drum and baked into a recording (.povr, plays with PLAYBACK_FILE) or a
+// sprite atlas (.povs, one frame per image):
+//   IMPORT_OUTER  the outer wall, LENGTH x HEIGHT, the image wraps once around
+//                 the drum with its top on the top layer
+//   IMPORT_TOP    the top disc, LENGTH x WIDTH, the largest centred circle of
+//                 the image, slice 0 along +x and slices counter clockwise
+// Frames are stored in sprite layout (row 0 is the top layer, or the outer
+// ring of the disc), so an atlas frame is drawn with blitSprite on
+// SPRITE_FACE_UPRIGHT at plane WIDTH - 1, or SPRITE_FACE_RADIAL at plane
+// HEIGHT - 1.
+//
+// Each voxel averages the source pixels under its footprint, weighted by the
+// area they cover. The weights are worked out once per surface and source
+// size into a ResampleTable, so converting a frame is a gather over the table.
+// --import-image outer|top out.povr|out.povs fps image [image...] converts a
+// batch on all cores. Video has to be split into images first.
+
+#define IMPORT_WEIGHT_BITS 15           //Weights of one voxel sum to 1 << IMPORT_WEIGHT_BITS
+#define IMPORT_DISC_SAMPLES 8           //Samples per voxel and axis over a disc sector
+#define IMPORT_MAX_THREADS 16
+
+enum IMPORT_SURFACE { IMPORT_OUTER, IMPORT_TOP };
+
+//Voxel v takes src[start[v]] .. src[start[v + 1] - 1] with their weights
+struct ResampleTable {
+	int surface;
+	int src_w, src_h;
+	int out_w, out_h;
+	std::vector<uint32_t> start;
+	std::vector<uint32_t> src;              //Source pixel index
+	std::vector<uint16_t> weight;
+};
+
+inline int importSurfaceHeight(int surface)
+{
+	return surface == IMPORT_TOP ? WIDTH : HEIGHT;
+}
+
+//Quantizes one voxel's weights, rounding error goes to the largest
+void addResampleVoxel(ResampleTable& t, const std::vector<std::pair<uint32_t, float> >& taps)
+{
+	float total = 0;
+	for (size_t i = 0; i < taps.size(); i++)
+		total += taps[i].second;
+	size_t first = t.src.size();
+	size_t largest = first;
+	int sum = 0;
+	for (size_t i = 0; i < taps.size() && total > 0; i++)
+	{
+		int w = (int)(taps[i].second / total * (1 << IMPORT_WEIGHT_BITS) + 0.5f);
+		if (w == 0)
+			continue;
+		t.src.push_back(taps[i].first);
+		t.weight.push_back((uint16_t)w);
+		sum += w;
+		if (w > t.weight[largest])
+			largest = t.weight.size() - 1;
+	}
+	if (t.src.size() > first)
+		t.weight[largest] = (uint16_t)(t.weight[largest] + (1 << IMPORT_WEIGHT_BITS) - sum);
+	t.start.push_back((uint32_t)t.src.size());
+}
+
+//Source pixels under output cell i of n along an axis of size, with coverage
+void boxCoverage(int i, int n, int size, std::vector<std::pair<int, float> >& out)
+{
+	out.clear();
+	float a = (float)i * size / n;
+	float b = (float)(i + 1) * size / n;
+	for (int p = (int)a; p < size && p < b; p++)
+	{
+		float lo = a > p ? a : p;
+		float hi = b < p + 1 ? b : p + 1;
+		if (hi > lo)
+			out.push_back(std::make_pair(p, hi - lo));
+	}
+}
+
+void buildResampleTable(ResampleTable& t, int surface, int src_w, int src_h)
+{
+	t.surface = surface;
+	t.src_w = src_w;
+	t.src_h = src_h;
+	t.out_w = LENGTH;
+	t.out_h = importSurfaceHeight(surface);
+	t.start.assign(1, 0);
+	t.src.clear();
+	t.weight.clear();
+
+	std::vector<std::pair<uint32_t, float> > taps;
+	if (surface == IMPORT_OUTER)
+	{
+		//Footprints are axis aligned rectangles, coverage is exact
+		std::vector<std::pair<int, float> > xs, ys;
+		for (int row = 0; row < t.out_h; row++)
+		{
+			boxCoverage(row, t.out_h, src_h, ys);
+			for (int l = 0; l < LENGTH; l++)
+			{
+				boxCoverage(l, LENGTH, src_w, xs);
+				taps.clear();
+				for (size_t y = 0; y < ys.size(); y++)
+					for (size_t x = 0; x < xs.size(); x++)
+						taps.push_back(std::make_pair((uint32_t)(ys[y].first * src_w + xs[x].first), ys[y].second * xs[x].second));
+				addResampleVoxel(t, taps);
+			}
+		}
+		return;
+	}
+
+	//Disc sectors are sampled, each sample weighted by the area it stands for
+	float cx = src_w * 0.5f, cy = src_h * 0.5f;
+	float radius = (src_w < src_h ? src_w : src_h) * 0.5f;
+	for (int row = 0; row < t.out_h; row++)
+	{
+		int ring = WIDTH - 1 - row;
+		for (int l = 0; l < LENGTH; l++)
+		{
+			taps.clear();
+			for (int a = 0; a < IMPORT_DISC_SAMPLES; a++)
+			{
+				float theta = 2.0f * (float)M_PI * (l + (a + 0.5f) / IMPORT_DISC_SAMPLES) / LENGTH;
+				for (int r = 0; r < IMPORT_DISC_SAMPLES; r++)
+				{
+					float rho = (ring + (r + 0.5f) / IMPORT_DISC_SAMPLES) / WIDTH * radius;
+					int x = (int)(cx + rho * cosf(theta));
+					int y = (int)(cy - rho * sinf(theta));
+					x = x < 0 ? 0 : x >= src_w ? src_w - 1 : x;
+					y = y < 0 ? 0 : y >= src_h ? src_h - 1 : y;
+					uint32_t p = (uint32_t)(y * src_w + x);
+					size_t k = 0;
+					while (k < taps.size() && taps[k].first != p)
+						k++;
+					if (k == taps.size())
+						taps.push_back(std::make_pair(p, 0.0f));
+					taps[k].second += rho;
+				}
+			}
+			addResampleVoxel(t, taps);
+		}
+	}
+}
+
+//Tables are built on first use and kept for the process, one per surface and
+//source size. Safe to call from the batch workers
+const ResampleTable& resampleTable(int surface, int src_w, int src_h)
+{
+	static std::mutex mutex;
+	static std::deque<ResampleTable> tables;
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i = 0; i < tables.size(); i++)
+	{
+		if (tables[i].surface == surface && tables[i].src_w == src_w && tables[i].src_h == src_h)
+			return tables[i];
+	}
+	tables.push_back(ResampleTable());
+	buildResampleTable(tables.back(), surface, src_w, src_h);
+	return tables.back();
+}
+
+//src is src_w x src_h RGB888, out gets out_w x out_h RGB888
+void resampleImage(const ResampleTable& t, const uint8_t* src, uint8_t* out)
+{
+	int voxels = t.out_w * t.out_h;
+	for (int v = 0; v < voxels; v++)
+	{
+		uint32_t r = 0, g = 0, b = 0;
+		for (uint32_t k = t.start[v]; k < t.start[v + 1]; k++)
+		{
+			const uint8_t* px = src + t.src[k] * 3;
+			uint32_t w = t.weight[k];
+			r += px[0] * w;
+			g += px[1] * w;
+			b += px[2] * w;
+		}
+		const uint32_t half = 1 << (IMPORT_WEIGHT_BITS - 1);
+		out[v * 3] = (uint8_t)((r + half) >> IMPORT_WEIGHT_BITS);
+		out[v * 3 + 1] = (uint8_t)((g + half) >> IMPORT_WEIGHT_BITS);
+		out[v * 3 + 2] = (uint8_t)((b + half) >> IMPORT_WEIGHT_BITS);
+	}
+}
+
+//Decodes and resamples every image on a pool of threads. frames[i] is left
+//empty for an image that fails to load
+bool importImages(int surface, const char* const* paths, int count, std::vector<std::vector<uint8_t> >& frames)
+{
+	frames.assign(count, std::vector<uint8_t>());
+	std::atomic<int> failed(0);
+	stbi_set_flip_vertically_on_load(false);
+	parallelFor(count, IMPORT_MAX_THREADS, [&](int f) {
+		int w, h, n;
+		uint8_t* img = stbi_load(paths[f], &w, &h, &n, 3);
+		if (img == NULL)
+		{
+			printf("Error::IMPORT::Can't load %s: %s\n", paths[f], stbi_failure_reason());
+			failed++;
+			return;
+		}
+		const ResampleTable& table = resampleTable(surface, w, h);
+		frames[f].resize(table.out_w * table.out_h * 3);
+		resampleImage(table, img, &frames[f][0]);
+		stbi_image_free(img);
+	});
+	return failed == 0;
+}
+
+//Whole display frame with one surface filled in, RGB888 in frameToRGB layout
+void surfaceToFrame(int surface, const uint8_t* surface_rgb, uint8_t* frame)
+{
+	memset(frame, 0, REC_FRAME_BYTES);
+	int rows = importSurfaceHeight(surface);
+	for (int row = 0; row < rows; row++)
+	{
+		for (int l = 0; l < LENGTH; l++)
+		{
+			int w = surface == IMPORT_TOP ? WIDTH - 1 - row : WIDTH - 1;
+			int h = surface == IMPORT_TOP ? HEIGHT - 1 : HEIGHT - 1 - row;
+			memcpy(frame + ((l * WIDTH + w) * HEIGHT + h) * NUM_COLORS, surface_rgb + (row * LENGTH + l) * 3, 3);
+		}
+	}
+}
+
+bool bakeImport(int surface, const char* out_path, float fps, const char* const* paths, int count)
+{
+	std::vector<std::vector<uint8_t> > frames;
+	bool ok = importImages(surface, paths, count, frames);
+
+	size_t len = strlen(out_path);
+	if (len > 5 && strcmp(out_path + len - 5, ".povs") == 0)
+	{
+		AtlasBuilder builder;
+		std::vector<uint8_t> rgba(LENGTH * importSurfaceHeight(surface) * 4);
+		for (int f = 0; f < count; f++)
+		{
+			if (frames[f].empty())
+				continue;
+			for (size_t p = 0; p < rgba.size() / 4; p++)
+			{
+				memcpy(&rgba[p * 4], &frames[f][p * 3], 3);
+				rgba[p * 4 + 3] = 255;
+			}
+			//Room for any int, addFrame cuts it to ATLAS_NAME_LENGTH
+			char name[sizeof("import_-2147483648")];
+			snprintf(name, sizeof(name), "import_%d", f);
+			builder.addFrame(name, &rgba[0], LENGTH, importSurfaceHeight(surface), false);
+		}
+		return builder.write(out_path) && ok;
+	}
+
+	FrameRecorder recorder;
+	if (!recorder.create(out_path))
+		return false;
+	std::vector<uint8_t> frame(REC_FRAME_BYTES);
+	uint64_t frame_us = (uint64_t)(1000000.0f / (fps > 0 ? fps : 1.0f));
+	uint64_t ts = 0;
+	for (int f = 0; f < count; f++)
+	{
+		if (frames[f].empty())
+			continue;
+		surfaceToFrame(surface, &frames[f][0], &frame[0]);
+		if (!recorder.append(&frame[0], ts))
+			break;
+		ts += frame_us;
+	}
+	return recorder.stop() && ok;
+}
+
+//Parses --import-image outer|top out fps image [image...], false if it isn't argv[1].
+//out_path is NULL after a usage error
+bool parseImportArgs(int argc, char** argv, int& surface, const char*& out_path, float& fps, const char* const*& paths, int& count)
+{
+	if (argc < 2 || strcmp(argv[1], "--import-image") != 0)
+		return false;
+	out_path = NULL;
+	if (argc < 6 || (strcmp(argv[2], "outer") != 0 && strcmp(argv[2], "top") != 0))
+	{
+		printf("Usage: --import-image outer|top out.povr|out.povs fps image [image...]\n");
+		return true;
+	}
+	surface = strcmp(argv[2], "top") == 0 ? IMPORT_TOP : IMPORT_OUTER;
+	out_path = argv[3];
+	fps = (float)atof(argv[4]);
+	paths = argv + 5;
+	count = argc - 5;
+	return true;
+}
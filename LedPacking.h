@@ -0,0 +1,256 @@
+#ifndef LED_PACKING_LIB
+#define LED_PACKING_LIB
+
+//#include "FrameBuffer.h"
+#include <pov_display/FrameBuffer.h>
+#include <string.h>
+
+#ifdef CONFIG_POV_SIMULATOR
+#include <chrono>
+#endif
+
+//Physical wiring of one slice: the strip runs along HEIGHT for one WIDTH
+//position, then steps to the next WIDTH position. With serpentine wiring
+//every other run goes back down instead of returning to the bottom.
+#define STRIP_SERPENTINE true
+#define STRIP_START_BOTTOM true     //First LED on the strip is h = 0
+#define STRIP_START_INNER true      //First run is w = 0
+#define APA102_BRIGHTNESS 31        //Global brightness field, 0-31
+
+#define SLICE_LEDS (WIDTH * HEIGHT)
+#define SLICE_BYTES (SLICE_LEDS * NUM_COLORS)
+#define WS2812_SLICE_BYTES (SLICE_LEDS * 3)
+#define APA102_END_BYTES ((SLICE_LEDS + 15) / 16)
+#define APA102_SLICE_BYTES (4 + SLICE_LEDS * 4 + APA102_END_BYTES)
+
+enum LED_ORDER { ORDER_RGB, ORDER_GRB, ORDER_BGR };
+
+//Strip position -> fbuf_ coordinates
+constexpr int stripW(int n)
+{
+    return STRIP_START_INNER ? (n / HEIGHT) : (WIDTH - 1 - n / HEIGHT);
+}
+constexpr bool stripRunUp(int run)
+{
+    return STRIP_START_BOTTOM != (STRIP_SERPENTINE && (run & 1));
+}
+constexpr int stripH(int n)
+{
+    return stripRunUp(n / HEIGHT) ? (n % HEIGHT) : (HEIGHT - 1 - n % HEIGHT);
+}
+//Wire byte c of a pixel -> COLORS channel
+constexpr int orderChannel(LED_ORDER order, int c)
+{
+    return order == ORDER_RGB ? c : (order == ORDER_GRB ? (c == 0 ? GREEN : (c == 1 ? RED : BLUE)) : (NUM_COLORS - 1 - c));
+}
+
+//Byte offset inside an RGB888 slice (frameBuffer::sliceRGB) for every wire byte
+template <LED_ORDER order>
+struct LedRemap
+{
+    uint16_t src[WS2812_SLICE_BYTES];
+
+    constexpr LedRemap() : src()
+    {
+        for (int n = 0; n < SLICE_LEDS; n++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                src[n * 3 + c] = (uint16_t)((stripW(n) * HEIGHT + stripH(n)) * NUM_COLORS + orderChannel(order, c));
+            }
+        }
+    }
+};
+
+constexpr LedRemap<ORDER_GRB> GRB_REMAP;
+constexpr LedRemap<ORDER_BGR> BGR_REMAP;
+
+//Gathers one slice into wire order, table is 3 entries per LED
+static_assert(WS2812_SLICE_BYTES % 4 == 0, "gatherSlice copies 4 bytes per step");
+inline void gatherSlice(const uint8_t* slice, const uint16_t* remap, uint8_t* out)
+{
+    for (int i = 0; i < WS2812_SLICE_BYTES; i += 4)
+    {
+        out[i] = slice[remap[i]];
+        out[i + 1] = slice[remap[i + 1]];
+        out[i + 2] = slice[remap[i + 2]];
+        out[i + 3] = slice[remap[i + 3]];
+    }
+}
+
+//WS2812: GRB, no framing. out needs WS2812_SLICE_BYTES
+inline void packSliceWS2812(const frameBuffer* fb, int l, uint8_t* out)
+{
+    uint8_t tmp[SLICE_BYTES];
+    gatherSlice(fb->sliceRGB(l, tmp), GRB_REMAP.src, out);
+}
+//Whole buffer, slices back to back. out needs LENGTH * WS2812_SLICE_BYTES
+inline void packFrameWS2812(const frameBuffer* fb, uint8_t* out)
+{
+    for (int l = 0; l < LENGTH; l++)
+    {
+        packSliceWS2812(fb, l, out + l * WS2812_SLICE_BYTES);
+    }
+}
+
+//APA102: 32 zero bits, 111bbbbb+B+G+R per LED, then one 1 bit per two LEDs
+//to clock the data through. out needs APA102_SLICE_BYTES
+inline void packSliceAPA102(const frameBuffer* fb, int l, uint8_t* out, uint8_t brightness = APA102_BRIGHTNESS)
+{
+    uint8_t tmp[SLICE_BYTES];
+    uint8_t bgr[WS2812_SLICE_BYTES];
+    gatherSlice(fb->sliceRGB(l, tmp), BGR_REMAP.src, bgr);
+
+    out[0] = out[1] = out[2] = out[3] = 0x00;
+    uint8_t header = 0xE0 | (brightness & 0x1F);
+    uint8_t* led = out + 4;
+    for (int n = 0; n < SLICE_LEDS; n++)
+    {
+        led[n * 4] = header;
+        led[n * 4 + 1] = bgr[n * 3];
+        led[n * 4 + 2] = bgr[n * 3 + 1];
+        led[n * 4 + 3] = bgr[n * 3 + 2];
+    }
+    memset(out + 4 + SLICE_LEDS * 4, 0xFF, APA102_END_BYTES);
+}
+inline void packFrameAPA102(const frameBuffer* fb, uint8_t* out, uint8_t brightness = APA102_BRIGHTNESS)
+{
+    for (int l = 0; l < LENGTH; l++)
+    {
+        packSliceAPA102(fb, l, out + l * APA102_SLICE_BYTES, brightness);
+    }
+}
+
+
+#ifdef CONFIG_POV_SIMULATOR
+//Walks the strip the slow way and compares against the table driven packers
+bool verifyLedPacking(const frameBuffer* fb)
+{
+    uint8_t ws[WS2812_SLICE_BYTES];
+    uint8_t apa[APA102_SLICE_BYTES];
+    for (int l = 0; l < LENGTH; l++)
+    {
+        packSliceWS2812(fb, l, ws);
+        packSliceAPA102(fb, l, apa);
+
+        int n = 0;
+        for (int run = 0; run < WIDTH; run++)
+        {
+            int w = STRIP_START_INNER ? run : WIDTH - 1 - run;
+            bool up = STRIP_START_BOTTOM;
+            if (STRIP_SERPENTINE && (run & 1))
+                up = !up;
+            for (int step = 0; step < HEIGHT; step++, n++)
+            {
+                int h = up ? step : HEIGHT - 1 - step;
+                uint8_t px[NUM_COLORS];
+                fb->getPixel(l, w, h, &px[RED], &px[GREEN], &px[BLUE]);
+                if (ws[n * 3] != px[GREEN] || ws[n * 3 + 1] != px[RED] || ws[n * 3 + 2] != px[BLUE])
+                {
+                    printf("LED packing: WS2812 mismatch at slice %d, led %d\n", l, n);
+                    return false;
+                }
+                const uint8_t* a = apa + 4 + n * 4;
+                if (a[0] != (0xE0 | APA102_BRIGHTNESS) || a[1] != px[BLUE] || a[2] != px[GREEN] || a[3] != px[RED])
+                {
+                    printf("LED packing: APA102 mismatch at slice %d, led %d\n", l, n);
+                    return false;
+                }
+            }
+        }
+        if (apa[0] | apa[1] | apa[2] | apa[3])
+        {
+            printf("LED packing: APA102 start frame not zero\n");
+            return false;
+        }
+        for (int i = 0; i < APA102_END_BYTES; i++)
+        {
+            if (apa[4 + SLICE_LEDS * 4 + i] != 0xFF)
+            {
+                printf("LED packing: APA102 end frame wrong\n");
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+//Packs a frame with six lit LEDs in slice 5 and compares it with the wire
+//bytes worked out by hand for the default wiring. Only full or zero channels
+//are used so every FB_STORAGE stores them exactly
+bool verifyWS2812Bytes()
+{
+#if STRIP_SERPENTINE && STRIP_START_BOTTOM && STRIP_START_INNER && WIDTH == 8 && HEIGHT == 6
+    static const uint8_t expected[WS2812_SLICE_BYTES] = {
+        0x00, 0xFF, 0x00,  0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,  0xFF, 0x00, 0x00,   //Run 0 up: red at h 0, green at h 5
+        0x00, 0x00, 0xFF,  0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,  0xFF, 0xFF, 0x00,   //Run 1 down: blue at h 5, yellow at h 0
+        0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,
+        0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,
+        0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,
+        0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,
+        0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,
+        0xFF, 0x00, 0xFF,  0, 0, 0,  0, 0, 0,  0, 0, 0,  0, 0, 0,  0x00, 0xFF, 0xFF,   //Run 7 down: cyan at h 5, magenta at h 0
+    };
+    static frameBuffer fb;
+    static uint8_t ws[LENGTH * WS2812_SLICE_BYTES];
+    fb.clear();
+    fb.setPixel(5, 0, 0, 0xFF, 0x00, 0x00);
+    fb.setPixel(5, 0, 5, 0x00, 0xFF, 0x00);
+    fb.setPixel(5, 1, 5, 0x00, 0x00, 0xFF);
+    fb.setPixel(5, 1, 0, 0xFF, 0xFF, 0x00);
+    fb.setPixel(5, 7, 5, 0x00, 0xFF, 0xFF);
+    fb.setPixel(5, 7, 0, 0xFF, 0x00, 0xFF);
+    packFrameWS2812(&fb, ws);
+    for (int i = 0; i < (int)sizeof(ws); i++)
+    {
+        int l = i / WS2812_SLICE_BYTES;
+        uint8_t want = l == 5 ? expected[i % WS2812_SLICE_BYTES] : 0;
+        if (ws[i] != want)
+        {
+            printf("LED packing: WS2812 byte %d of slice %d is 0x%02X, expected 0x%02X\n", i % WS2812_SLICE_BYTES, l, ws[i], want);
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+//Times the packers on random data, rpm sets the per slice budget to compare with
+void benchLedPacking(float rpm, int iterations = 2000)
+{
+    typedef std::chrono::steady_clock clock;
+    static frameBuffer fb;
+    static uint8_t ws[LENGTH * WS2812_SLICE_BYTES];
+    static uint8_t apa[LENGTH * APA102_SLICE_BYTES];
+    for (int i = 0; i < LENGTH; i++)
+        for (int j = 0; j < WIDTH; j++)
+            for (int k = 0; k < HEIGHT; k++)
+                fb.setPixel(i, j, k, rand() & 0xFF, rand() & 0xFF, rand() & 0xFF);
+
+    printf("LED packing: %s\n", verifyWS2812Bytes() && verifyLedPacking(&fb) ? "byte exact" : "FAILED");
+
+    uint32_t check = 0;
+    clock::time_point t0 = clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        packFrameWS2812(&fb, ws);
+        check += ws[i % sizeof(ws)];
+    }
+    clock::time_point t1 = clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        packFrameAPA102(&fb, apa);
+        check += apa[i % sizeof(apa)];
+    }
+    clock::time_point t2 = clock::now();
+
+    double slices = (double)iterations * LENGTH;
+    double ws_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / slices;
+    double apa_ns = std::chrono::duration<double, std::nano>(t2 - t1).count() / slices;
+    double slot_ns = 60.0e9 / ((double)rpm * LENGTH);
+    printf("LED packing: WS2812 %.1f ns/slice, APA102 %.1f ns/slice, slot at %.0f RPM %.0f ns (check %u)\n",
+        ws_ns, apa_ns, rpm, slot_ns, check);
+}
+#endif
+
+#endif
@@ -0,0 +1,455 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+// Mesh post-processing for imported models. STL files store every triangle
+// with three private vertices, so the enclosure meshes come out of Assimp with
+// a sequential index buffer and no vertex reuse at all. The helpers here weld
+// those duplicates back together, reorder triangles for the post-transform
+// vertex cache and optionally pack vertices down to 16-bit components.
+//
+// The functions are templated on the vertex type so they only depend on the
+// Position/Normal/TexCoords members of the viewer's Vertex struct.
+
+#define MESH_OPT_CACHE_SIZE 32		//LRU size used while reordering
+#define MESH_OPT_FIFO_SIZE 16		//FIFO size used when reporting ACMR
+
+struct MeshStats {
+	size_t num_vertices;
+	size_t num_indices;
+	size_t vertex_bytes;
+	size_t index_bytes;
+	float acmr;		//Average cache miss ratio (transformed vertices per triangle)
+};
+
+// 16-bit packed vertex, position is snorm relative to the mesh bounds and
+// normal is a plain snorm direction. The 4th component keeps 8 byte alignment.
+struct QuantizedVertex {
+	int16_t Position[4];
+	int16_t Normal[4];
+};
+
+namespace MeshOptimizer {
+
+	inline int16_t quantizeSnorm(float v)
+	{
+		if (v > 1.0f)
+			v = 1.0f;
+		else if (v < -1.0f)
+			v = -1.0f;
+		return (int16_t)(v * 32767.0f + (v >= 0.0f ? 0.5f : -0.5f));
+	}
+
+	// Simulate a FIFO post-transform cache, returns vertex shader invocations per triangle
+	inline float computeACMR(const std::vector<unsigned int>& indices, size_t num_vertices, int cache_size = MESH_OPT_FIFO_SIZE)
+	{
+		if (indices.size() < 3)
+			return 0.0f;
+
+		std::vector<unsigned int> timestamps(num_vertices, 0);
+		unsigned int time = cache_size + 1;
+		size_t misses = 0;
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			unsigned int v = indices[i];
+			if (time - timestamps[v] > (unsigned int)cache_size)
+			{
+				timestamps[v] = time++;
+				misses++;
+			}
+		}
+		return (float)misses / (float)(indices.size() / 3);
+	}
+
+	template <typename VertexT>
+	MeshStats getStats(const std::vector<VertexT>& vertices, const std::vector<unsigned int>& indices, size_t vertex_size = sizeof(VertexT), size_t index_size = sizeof(unsigned int))
+	{
+		MeshStats stats;
+		stats.num_vertices = vertices.size();
+		stats.num_indices = indices.size();
+		stats.vertex_bytes = vertices.size() * vertex_size;
+		stats.index_bytes = indices.size() * index_size;
+		stats.acmr = computeACMR(indices, vertices.size());
+		return stats;
+	}
+
+	// Merge vertices that share a position (within pos_epsilon), texture coordinate
+	// and whose normals differ by less than angle_deg. Merged normals are averaged,
+	// so curved surfaces get smooth shading while hard edges stay split.
+	// Returns the number of vertices left.
+	template <typename VertexT>
+	size_t weldVertices(std::vector<VertexT>& vertices, std::vector<unsigned int>& indices, float angle_deg, float pos_epsilon = 1e-4f)
+	{
+		if (vertices.empty())
+			return 0;
+
+		const float cos_threshold = cosf(angle_deg * 3.14159265f / 180.0f);
+		//Cells are 2 * pos_epsilon wide, so everything within pos_epsilon of a
+		//vertex lies in the (at most) 2x2x2 cells its +/- pos_epsilon box touches
+		const float inv_cell = 0.5f / pos_epsilon;
+
+		std::vector<VertexT> welded;
+		std::vector<unsigned int> remap(vertices.size());
+		std::unordered_map<uint64_t, std::vector<unsigned int>> grid;
+		welded.reserve(vertices.size() / 2);
+		grid.reserve(vertices.size());
+
+		auto cellKey = [](int64_t cx, int64_t cy, int64_t cz) {
+			return ((uint64_t)(cx & 0x1FFFFF) << 42) | ((uint64_t)(cy & 0x1FFFFF) << 21) | (uint64_t)(cz & 0x1FFFFF);
+		};
+
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			const VertexT& v = vertices[i];
+			int64_t lo[3], hi[3];
+			const float pos[3] = { v.Position.x, v.Position.y, v.Position.z };
+			for (int a = 0; a < 3; a++)
+			{
+				lo[a] = (int64_t)floorf((pos[a] - pos_epsilon) * inv_cell);
+				hi[a] = (int64_t)floorf((pos[a] + pos_epsilon) * inv_cell);
+			}
+
+			int match = -1;
+			for (int64_t cx = lo[0]; cx <= hi[0] && match < 0; cx++)
+			for (int64_t cy = lo[1]; cy <= hi[1] && match < 0; cy++)
+			for (int64_t cz = lo[2]; cz <= hi[2] && match < 0; cz++)
+			{
+				std::unordered_map<uint64_t, std::vector<unsigned int>>::const_iterator it = grid.find(cellKey(cx, cy, cz));
+				if (it == grid.end())
+					continue;
+				const std::vector<unsigned int>& cell = it->second;
+				for (size_t c = 0; c < cell.size(); c++)
+				{
+					const VertexT& w = welded[cell[c]];
+					if (fabsf(w.Position.x - v.Position.x) > pos_epsilon ||
+						fabsf(w.Position.y - v.Position.y) > pos_epsilon ||
+						fabsf(w.Position.z - v.Position.z) > pos_epsilon)
+						continue;
+					if (w.TexCoords.x != v.TexCoords.x || w.TexCoords.y != v.TexCoords.y)
+						continue;
+
+					//Compare against the running (unnormalised) average normal
+					float wl = sqrtf(w.Normal.x * w.Normal.x + w.Normal.y * w.Normal.y + w.Normal.z * w.Normal.z);
+					float vl = sqrtf(v.Normal.x * v.Normal.x + v.Normal.y * v.Normal.y + v.Normal.z * v.Normal.z);
+					if (wl == 0.0f || vl == 0.0f)
+						continue;
+					float d = (w.Normal.x * v.Normal.x + w.Normal.y * v.Normal.y + w.Normal.z * v.Normal.z) / (wl * vl);
+					if (d >= cos_threshold)
+					{
+						match = cell[c];
+						break;
+					}
+				}
+			}
+
+			if (match < 0)
+			{
+				match = (int)welded.size();
+				welded.push_back(v);
+				grid[cellKey((int64_t)floorf(pos[0] * inv_cell), (int64_t)floorf(pos[1] * inv_cell), (int64_t)floorf(pos[2] * inv_cell))].push_back(match);
+			}
+			else
+			{
+				welded[match].Normal.x += v.Normal.x;
+				welded[match].Normal.y += v.Normal.y;
+				welded[match].Normal.z += v.Normal.z;
+			}
+			remap[i] = match;
+		}
+
+		for (size_t i = 0; i < welded.size(); i++)
+		{
+			VertexT& w = welded[i];
+			float l = sqrtf(w.Normal.x * w.Normal.x + w.Normal.y * w.Normal.y + w.Normal.z * w.Normal.z);
+			if (l > 0.0f)
+			{
+				w.Normal.x /= l;
+				w.Normal.y /= l;
+				w.Normal.z /= l;
+			}
+		}
+
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			indices[i] = remap[indices[i]];
+		}
+
+		//Welding can collapse slivers into degenerate triangles, drop them
+		size_t out = 0;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+			if (a == b || b == c || a == c)
+				continue;
+			indices[out++] = a;
+			indices[out++] = b;
+			indices[out++] = c;
+		}
+		indices.resize(out);
+
+		vertices.swap(welded);
+		return vertices.size();
+	}
+
+	// Tom Forsyth's linear-speed vertex cache optimisation
+	// (https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html)
+	inline float forsythScore(int cache_pos, int active_tris)
+	{
+		if (active_tris == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cache_pos >= 0)
+		{
+			if (cache_pos < 3)
+			{
+				//Last triangle's verts get a fixed score so they aren't reused straight away
+				score = 0.75f;
+			}
+			else
+			{
+				float s = 1.0f - (float)(cache_pos - 3) / (float)(MESH_OPT_CACHE_SIZE - 3);
+				score = powf(s, 1.5f);
+			}
+		}
+		//Boost vertices with few triangles left so lone triangles are finished off
+		score += 2.0f * powf((float)active_tris, -0.5f);
+		return score;
+	}
+
+	inline void optimizeVertexCache(std::vector<unsigned int>& indices, size_t num_vertices)
+	{
+		size_t num_tris = indices.size() / 3;
+		if (num_tris == 0)
+			return;
+
+		std::vector<int> active_tris(num_vertices, 0);
+		std::vector<int> cache_pos(num_vertices, -1);
+		std::vector<float> vertex_score(num_vertices, 0.0f);
+		std::vector<unsigned int> adj_offset(num_vertices + 1, 0);
+		std::vector<unsigned int> adj_tris(indices.size());
+
+		//Build vertex->triangle adjacency
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			active_tris[indices[i]]++;
+		}
+		for (size_t v = 0; v < num_vertices; v++)
+		{
+			adj_offset[v + 1] = adj_offset[v] + active_tris[v];
+		}
+		std::vector<unsigned int> adj_fill(adj_offset.begin(), adj_offset.end() - 1);
+		for (size_t t = 0; t < num_tris; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int v = indices[t * 3 + k];
+				adj_tris[adj_fill[v]++] = (unsigned int)t;
+			}
+		}
+
+		for (size_t v = 0; v < num_vertices; v++)
+		{
+			vertex_score[v] = forsythScore(-1, active_tris[v]);
+		}
+
+		std::vector<float> tri_score(num_tris);
+		std::vector<bool> tri_added(num_tris, false);
+		for (size_t t = 0; t < num_tris; t++)
+		{
+			tri_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+		}
+
+		std::vector<unsigned int> output;
+		output.reserve(indices.size());
+
+		int cache[MESH_OPT_CACHE_SIZE + 3];
+		int cache_size = 0;
+		size_t scan_pos = 0;
+
+		int best_tri = 0;
+		for (size_t t = 1; t < num_tris; t++)
+		{
+			if (tri_score[t] > tri_score[best_tri])
+				best_tri = (int)t;
+		}
+
+		while (best_tri >= 0)
+		{
+			tri_added[best_tri] = true;
+			unsigned int tri_verts[3] = { indices[best_tri * 3], indices[best_tri * 3 + 1], indices[best_tri * 3 + 2] };
+
+			//Emit triangle and take it out of its vertices' adjacency lists
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int v = tri_verts[k];
+				output.push_back(v);
+
+				unsigned int begin = adj_offset[v];
+				unsigned int end = begin + active_tris[v];
+				for (unsigned int a = begin; a < end; a++)
+				{
+					if (adj_tris[a] == (unsigned int)best_tri)
+					{
+						adj_tris[a] = adj_tris[end - 1];
+						break;
+					}
+				}
+				active_tris[v]--;
+			}
+
+			//Move the triangle's vertices to the front of the LRU cache
+			int new_cache[MESH_OPT_CACHE_SIZE + 3];
+			int new_size = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				new_cache[new_size++] = tri_verts[k];
+			}
+			for (int c = 0; c < cache_size; c++)
+			{
+				int v = cache[c];
+				if (v == (int)tri_verts[0] || v == (int)tri_verts[1] || v == (int)tri_verts[2])
+					continue;
+				new_cache[new_size++] = v;
+			}
+			for (int c = MESH_OPT_CACHE_SIZE; c < new_size; c++)
+			{
+				cache_pos[new_cache[c]] = -1;
+				vertex_score[new_cache[c]] = forsythScore(-1, active_tris[new_cache[c]]);
+			}
+			cache_size = (new_size > MESH_OPT_CACHE_SIZE) ? MESH_OPT_CACHE_SIZE : new_size;
+			memcpy(cache, new_cache, cache_size * sizeof(int));
+
+			//Rescore the cached vertices and the triangles that use them
+			for (int c = 0; c < cache_size; c++)
+			{
+				int v = cache[c];
+				cache_pos[v] = c;
+				vertex_score[v] = forsythScore(c, active_tris[v]);
+			}
+
+			best_tri = -1;
+			float best_score = -1.0f;
+			for (int c = 0; c < cache_size; c++)
+			{
+				int v = cache[c];
+				unsigned int begin = adj_offset[v];
+				unsigned int end = begin + active_tris[v];
+				for (unsigned int a = begin; a < end; a++)
+				{
+					unsigned int t = adj_tris[a];
+					float s = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+					tri_score[t] = s;
+					if (s > best_score)
+					{
+						best_score = s;
+						best_tri = (int)t;
+					}
+				}
+			}
+
+			//Cache ran dry, continue with the next unused triangle in input order
+			if (best_tri < 0)
+			{
+				while (scan_pos < num_tris && tri_added[scan_pos])
+				{
+					scan_pos++;
+				}
+				if (scan_pos < num_tris)
+					best_tri = (int)scan_pos;
+			}
+		}
+
+		indices.swap(output);
+	}
+
+	// Renumber vertices in first-use order so vertex fetch walks memory linearly
+	template <typename VertexT>
+	void optimizeVertexFetch(std::vector<VertexT>& vertices, std::vector<unsigned int>& indices)
+	{
+		std::vector<unsigned int> remap(vertices.size(), 0xFFFFFFFF);
+		std::vector<VertexT> reordered;
+		reordered.reserve(vertices.size());
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			unsigned int v = indices[i];
+			if (remap[v] == 0xFFFFFFFF)
+			{
+				remap[v] = (unsigned int)reordered.size();
+				reordered.push_back(vertices[v]);
+			}
+			indices[i] = remap[v];
+		}
+		vertices.swap(reordered);
+	}
+
+	// Pack vertices to 16 bits per component. Positions are stored relative to
+	// the mesh bounds, the caller has to apply pos_offset + pos_scale * p in the
+	// vertex shader (posOffset/posScale uniforms in model_loading.vs).
+	template <typename VertexT, typename Vec3T>
+	void quantizeVertices(const std::vector<VertexT>& vertices, std::vector<QuantizedVertex>& out, Vec3T& pos_offset, Vec3T& pos_scale)
+	{
+		out.resize(vertices.size());
+		if (vertices.empty())
+			return;
+
+		float min_p[3] = { vertices[0].Position.x, vertices[0].Position.y, vertices[0].Position.z };
+		float max_p[3] = { min_p[0], min_p[1], min_p[2] };
+		for (size_t i = 1; i < vertices.size(); i++)
+		{
+			const float p[3] = { vertices[i].Position.x, vertices[i].Position.y, vertices[i].Position.z };
+			for (int a = 0; a < 3; a++)
+			{
+				if (p[a] < min_p[a])
+					min_p[a] = p[a];
+				if (p[a] > max_p[a])
+					max_p[a] = p[a];
+			}
+		}
+
+		float offset[3], scale[3];
+		for (int a = 0; a < 3; a++)
+		{
+			offset[a] = 0.5f * (min_p[a] + max_p[a]);
+			scale[a] = 0.5f * (max_p[a] - min_p[a]);
+			if (scale[a] <= 0.0f)
+				scale[a] = 1.0f;
+		}
+		pos_offset.x = offset[0];
+		pos_offset.y = offset[1];
+		pos_offset.z = offset[2];
+		pos_scale.x = scale[0];
+		pos_scale.y = scale[1];
+		pos_scale.z = scale[2];
+
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			const VertexT& v = vertices[i];
+			QuantizedVertex& q = out[i];
+			q.Position[0] = quantizeSnorm((v.Position.x - offset[0]) / scale[0]);
+			q.Position[1] = quantizeSnorm((v.Position.y - offset[1]) / scale[1]);
+			q.Position[2] = quantizeSnorm((v.Position.z - offset[2]) / scale[2]);
+			q.Position[3] = 0;
+			q.Normal[0] = quantizeSnorm(v.Normal.x);
+			q.Normal[1] = quantizeSnorm(v.Normal.y);
+			q.Normal[2] = quantizeSnorm(v.Normal.z);
+			q.Normal[3] = 0;
+		}
+	}
+
+	// Weld + cache reorder + fetch reorder in one go
+	template <typename VertexT>
+	void optimizeMesh(std::vector<VertexT>& vertices, std::vector<unsigned int>& indices, float weld_angle_deg)
+	{
+		weldVertices(vertices, indices, weld_angle_deg);
+		optimizeVertexCache(indices, vertices.size());
+		optimizeVertexFetch(vertices, indices);
+	}
+}
+
+#endif  //MESH_OPTIMIZER_H
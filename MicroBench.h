@@ -0,0 +1,333 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "Arduino.h"
+#include <pov_display/FrameBuffer.h>
+#include <pov_display/Text.h>
+#include <pov_display/test_animations.h>
+#include <pov_display/Space_Game.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MB_HAS_TSC 1
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define MB_HAS_TSC 1
+#else
+#define MB_HAS_TSC 0
+#endif
+#if !defined(_WIN32)
+#include <sched.h>
+#endif
+
+// Micro-benchmarks for the drawing primitives and one tick of each scene.
+// Every case is warmed up first, then timed as MB_SAMPLES samples of a batch
+// sized so one sample lasts at least MB_MIN_SAMPLE_US (keeps clock overhead
+// out of the numbers). Reported per call: min/median/p99/mean ns and TSC
+// cycles per voxel touched. TSC ticks are reference cycles, not core cycles,
+// so compare runs on the same machine with turbo settings unchanged.
+// Run with --microbench [out.json] [name filter].
+
+#define MB_SAMPLES 200
+#define MB_WARMUP_MS 100.0
+#define MB_MIN_SAMPLE_US 50.0
+#define MB_PIN_CPU 0                    //Core to pin the benchmark thread to, -1 = don't pin
+#define MB_VOXELS (LENGTH * WIDTH * HEIGHT)
+
+struct MicroBenchResult {
+	std::string name;
+	uint64_t batch;                 //Calls per sample
+	int samples;
+	double min_ns;
+	double median_ns;
+	double p99_ns;
+	double mean_ns;
+	int voxels;                     //Voxels one call touches
+	double cycles_per_voxel;        //Median TSC cycles / voxels, 0 without a TSC
+};
+
+class MicroBench {
+	public:
+		MicroBench(const char* filter = NULL);
+
+		//f is one call of the code under test, voxels what that call touches
+		template <typename F>
+		void run(const char* name, int voxels, F f);
+
+		bool pinned() { return pinned_cpu >= 0; }
+		void print();
+		bool writeJson(const char* path);
+
+	private:
+		typedef std::chrono::steady_clock clock;
+
+		const char* filter;
+		int pinned_cpu;
+		std::vector<MicroBenchResult> results;
+
+		static uint64_t ticks();
+		static bool pinToCpu(int cpu);
+};
+
+volatile uint32_t microbench_sink;
+
+uint64_t MicroBench::ticks()
+{
+#if MB_HAS_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+bool MicroBench::pinToCpu(int cpu)
+{
+	if (cpu < 0)
+		return false;
+#ifdef _WIN32
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
+
+MicroBench::MicroBench(const char* filter)
+{
+	this->filter = filter;
+	pinned_cpu = pinToCpu(MB_PIN_CPU) ? MB_PIN_CPU : -1;
+	if (MB_PIN_CPU >= 0 && pinned_cpu < 0)
+		printf("Microbench: couldn't pin to cpu %d, timings will be noisier\n", MB_PIN_CPU);
+}
+
+template <typename F>
+void MicroBench::run(const char* name, int voxels, F f)
+{
+	if (filter != NULL && strstr(name, filter) == NULL)
+		return;
+
+	//Warm up caches, branch predictors and clocks, and size the batch on the way
+	uint64_t warm_calls = 0;
+	clock::time_point start = clock::now();
+	clock::time_point now = start;
+	while (std::chrono::duration<double, std::milli>(now - start).count() < MB_WARMUP_MS)
+	{
+		f();
+		warm_calls++;
+		now = clock::now();
+	}
+	double warm_ns = std::chrono::duration<double, std::nano>(now - start).count() / warm_calls;
+	uint64_t batch = (uint64_t)(MB_MIN_SAMPLE_US * 1000.0 / warm_ns) + 1;
+
+	std::vector<double> ns(MB_SAMPLES);
+	std::vector<double> cyc(MB_SAMPLES);
+	for (int s = 0; s < MB_SAMPLES; s++)
+	{
+		uint64_t c0 = ticks();
+		clock::time_point t0 = clock::now();
+		for (uint64_t i = 0; i < batch; i++)
+			f();
+		clock::time_point t1 = clock::now();
+		uint64_t c1 = ticks();
+		ns[s] = std::chrono::duration<double, std::nano>(t1 - t0).count() / batch;
+		cyc[s] = (double)(c1 - c0) / batch;
+	}
+
+	MicroBenchResult r;
+	r.name = name;
+	r.batch = batch;
+	r.samples = MB_SAMPLES;
+	r.voxels = voxels;
+	r.mean_ns = 0.0;
+	for (int s = 0; s < MB_SAMPLES; s++)
+		r.mean_ns += ns[s] / MB_SAMPLES;
+	std::sort(ns.begin(), ns.end());
+	std::sort(cyc.begin(), cyc.end());
+	r.min_ns = ns[0];
+	r.median_ns = ns[MB_SAMPLES / 2];
+	r.p99_ns = ns[(MB_SAMPLES * 99) / 100];
+	r.cycles_per_voxel = (MB_HAS_TSC && voxels > 0) ? cyc[MB_SAMPLES / 2] / voxels : 0.0;
+	results.push_back(r);
+	printf("Microbench: %-32s min %10.1f  med %10.1f  p99 %10.1f ns  %7.2f cyc/voxel\n",
+		name, r.min_ns, r.median_ns, r.p99_ns, r.cycles_per_voxel);
+}
+
+void MicroBench::print()
+{
+	printf("Microbench: %zu cases, %d samples each, %s\n", results.size(), MB_SAMPLES,
+		pinned() ? "pinned" : "not pinned");
+}
+
+bool MicroBench::writeJson(const char* path)
+{
+	FILE* f = fopen(path, "w");
+	if (f == NULL)
+	{
+		printf("Error::MicroBench::Can't write %s\n", path);
+		return false;
+	}
+	fprintf(f, "{\n  \"config\": {\"length\": %d, \"width\": %d, \"height\": %d, \"storage\": %d, "
+		"\"samples\": %d, \"warmup_ms\": %.0f, \"pinned_cpu\": %d, \"tsc\": %s},\n  \"results\": [\n",
+		LENGTH, WIDTH, HEIGHT, FB_STORAGE, MB_SAMPLES, MB_WARMUP_MS, pinned_cpu, MB_HAS_TSC ? "true" : "false");
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const MicroBenchResult& r = results[i];
+		fprintf(f, "    {\"name\": \"%s\", \"batch\": %llu, \"min_ns\": %.2f, \"median_ns\": %.2f, \"p99_ns\": %.2f, "
+			"\"mean_ns\": %.2f, \"voxels\": %d, \"cycles_per_voxel\": %.3f}%s\n",
+			r.name.c_str(), (unsigned long long)r.batch, r.min_ns, r.median_ns, r.p99_ns, r.mean_ns,
+			r.voxels, r.cycles_per_voxel, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+	fclose(f);
+	return true;
+}
+
+//The suite. Scenes run one tick per call the way thread_loop does it: clear,
+//then the scene. Scene state carries over between calls, so like the golden
+//harness this wants a fresh process
+int runMicroBenchmarks(const char* json_path, const char* filter = NULL)
+{
+	srand(1234);
+	virtual_clock = true;
+	scene_budget.setAdaptive(false);
+	//drawLine and the games print debug lines, time the drawing not the terminal
+	Serial1.muted = true;
+	SerialUSB.muted = true;
+	MicroBench bench(filter);
+
+	static doubleBuffer db;
+	static frameBuffer fb;
+	frameBuffer* fbp = &fb;
+	doubleBuffer* dbp = &db;
+
+	bench.run("frameBuffer::clear", MB_VOXELS, [fbp]() {
+		fbp->clear();
+		microbench_sink += fbp->getChannel(0, 0, 0, RED);
+	});
+	bench.run("doubleBuffer::setColors", MB_VOXELS, [dbp]() {
+		for (int i = 0; i < LENGTH; i++)
+			for (int j = 0; j < WIDTH; j++)
+				for (int k = 0; k < HEIGHT; k++)
+					dbp->setColors(i, j, k, i, j, k);
+	});
+	bench.run("doubleBuffer::drawBlock", 20 * WIDTH * HEIGHT, [dbp]() {
+		dbp->drawBlock(10, 0, 0, 29, WIDTH - 1, HEIGHT - 1, 200, 100, 50);
+	});
+	bench.run("doubleBuffer::drawBlock outline", 20 * WIDTH * HEIGHT, [dbp]() {
+		dbp->drawBlock(10, 0, 0, 29, WIDTH - 1, HEIGHT - 1, 200, 100, 50, false);
+	});
+	bench.run("doubleBuffer::drawLine", LENGTH / 2, [dbp]() {
+		dbp->drawLine(Vector3d(0, 0, 0), Vector3d(LENGTH / 2 - 1, WIDTH - 1, HEIGHT - 1), 255, 255, 255);
+	});
+	bench.run("writeString", MB_VOXELS, [dbp]() {
+		writeString("HELLO WORLD", 10, 0, 255, 0, 0, dbp);
+	});
+	bench.run("writePropString", MB_VOXELS, [dbp]() {
+		writePropString("Hello, World!", 10, 0, 255, 0, 0, dbp);
+	});
+	bench.run("writeStringCached", MB_VOXELS, [dbp]() {
+		writeStringCached("HELLO WORLD", 10, 0, 255, 0, 0, dbp);
+	});
+	TextLayout wobbly = textLayout(TEXT_RADIAL, 255, 0, 0);
+	wobbly.effect = TEXT_FX_DEPTH_WAVE;
+	wobbly.amplitude = 5;
+	wobbly.period = 20;
+	bench.run("layoutText depth wave", MB_VOXELS, [dbp, wobbly]() {
+		layoutText("HELLO WORLD", 10, wobbly, dbp);
+	});
+	TextLayout upright = textLayout(TEXT_UPRIGHT, 0, 255, 255);
+	upright.base = WIDTH - 2;
+	upright.depth = 2;
+	upright.effect = TEXT_FX_WAVE;
+	upright.amplitude = 1;
+	upright.wrap = true;
+	bench.run("layoutText upright wave", MB_VOXELS, [dbp, upright]() {
+		layoutText("POV DISPLAY", 80, upright, dbp);
+	});
+	const TextStrip* marquee = getTextStrip("DONT LET YOUR DREAMS BE DREAMS", 0, 255, 0);
+	bench.run("blitTextStrip wrap", MB_VOXELS, [dbp, marquee]() {
+		blitTextStrip(marquee, 17, 0, dbp, true, 8);
+	});
+
+	static Animation mono(RAW_SPRITE, 18 * 6, 6);
+	static Animation rgb(BANANA_SPRITE, 64 * 3, 64 * 3, true);
+	mono.startAnimation(13, 5, 3, -1);
+	rgb.startAnimation(0, 1, 1, -1);
+	bench.run("Animation::draw", WIDTH * HEIGHT, [dbp]() {
+		mono.update();
+		mono.draw(dbp, 20, 0, 255, 0);
+	});
+	bench.run("Animation::draw_rgb", 64, [dbp]() {
+		rgb.draw_rgb(dbp, 40);
+	});
+	SpriteView axe = ITEM_SPRITES.view(23, 8, 8);
+	bench.run("blitSprite indexed", 64, [dbp, axe]() {
+		blitSprite(dbp, axe, 40);
+	});
+	static SpriteView item_frames[ITEM_SPRITE_COUNT];
+	for (int i = 0; i < ITEM_SPRITE_COUNT; i++)
+		item_frames[i] = ITEM_SPRITES.view(i, 8, 8);
+	static const SpriteClip clips[2] = {
+		spriteClip(item_frames, 12, 40),
+		spriteClip(item_frames + 12, 12, 70, SPRITE_LOOP_PINGPONG),
+	};
+	static SpriteInstances<256> swarm;
+	for (int i = swarm.size(); i < 256; i++)
+		swarm.spawn(&clips[i & 1], i * 3, i % WIDTH, SPRITE_FACE_RADIAL, i % HEIGHT, SPRITE_KEYED | SPRITE_WRAP);
+	bench.run("SpriteInstances::update 256", 256, []() {
+		swarm.update(16);
+	});
+
+	struct { const char* name; void (*tick)(doubleBuffer*); } scenes[] = {
+		{ "scene textAnimation", textAnimation },
+		{ "scene pinWheelAnimation_0", pinWheelAnimation_0 },
+		{ "scene vortexAnimation", vortexAnimation },
+		{ "scene pulseAnimation", pulseAnimation },
+		{ "scene pinWheelAnimation_1", pinWheelAnimation_1 },
+		{ "scene rainbow_swirl", rainbow_swirl },
+		{ "scene uprightTextAnimation", uprightTextAnimation },
+		{ "scene draw_triange_wave", draw_triange_wave },
+	};
+	for (size_t i = 0; i < sizeof(scenes) / sizeof(scenes[0]); i++)
+	{
+		void (*tick)(doubleBuffer*) = scenes[i].tick;
+		bench.run(scenes[i].name, MB_VOXELS, [dbp, tick]() {
+			dbp->clear();
+			tick(dbp);
+		});
+	}
+	static SpaceGame game;
+	bench.run("scene SpaceGame", MB_VOXELS, [dbp]() {
+		dbp->clear();
+		game.update();
+		game.draw(dbp);
+	});
+	virtual_clock = false;
+	Serial1.muted = false;
+	SerialUSB.muted = false;
+
+	bench.print();
+	if (json_path != NULL && json_path[0] != '\0' && !bench.writeJson(json_path))
+		return 1;
+	return 0;
+}
+
+//Parses --microbench [out.json] [filter], false if it isn't argv[1]
+bool parseMicroBenchArgs(int argc, char** argv, const char*& json_path, const char*& filter)
+{
+	if (argc < 2 || strcmp(argv[1], "--microbench") != 0)
+		return false;
+	json_path = argc > 2 ? argv[2] : NULL;
+	filter = argc > 3 ? argv[3] : NULL;
+	return true;
+}
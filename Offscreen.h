@@ -0,0 +1,503 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Headless rendering for the viewer. Creates a GL 3.3 core context through EGL
+// (surfaceless if the driver supports it, a 1x1 pbuffer otherwise) so the
+// viewer runs on machines without a display, including Mesa's llvmpipe.
+// Frames are rendered into an FBO and read back asynchronously through a ring
+// of pixel pack buffers; a writer thread encodes them to PNG or raw RGBA files.
+
+#define PBO_RING_SIZE 3
+
+struct HeadlessOptions {
+	int frames = 360;
+	int width = 800;
+	int height = 600;
+	std::string out_dir = ".";
+	bool raw = false;				//Write .rgba dumps instead of PNGs
+	bool write_frames = true;		//false = render throughput benchmark only
+	float yaw_start = 0.0f;
+	float yaw_step = 1.0f;			//Degrees of yaw_alt per frame
+	float pitch_center = 0.0f;
+	float pitch_amplitude = 0.0f;	//pitch_alt swings +/- this over the capture
+	float fps = 0.0f;				//Capture rate in scene time, 0 = as fast as frames render
+};
+
+// Sets headless if --headless was given, remaining flags fill in opts.
+// Returns false on an argument nothing understands
+bool parseHeadlessArgs(int argc, char** argv, HeadlessOptions& opts, bool& headless)
+{
+	headless = false;
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		bool has_val = (i + 1 < argc);
+		if (strcmp(arg, "--headless") == 0)
+			headless = true;
+		else if (strcmp(arg, "--frames") == 0 && has_val)
+			opts.frames = atoi(argv[++i]);
+		else if (strcmp(arg, "--size") == 0 && has_val)
+			sscanf(argv[++i], "%dx%d", &opts.width, &opts.height);
+		else if (strcmp(arg, "--out") == 0 && has_val)
+			opts.out_dir = argv[++i];
+		else if (strcmp(arg, "--raw") == 0)
+			opts.raw = true;
+		else if (strcmp(arg, "--bench") == 0)
+			opts.write_frames = false;
+		else if (strcmp(arg, "--yaw-start") == 0 && has_val)
+			opts.yaw_start = (float)atof(argv[++i]);
+		else if (strcmp(arg, "--yaw-step") == 0 && has_val)
+			opts.yaw_step = (float)atof(argv[++i]);
+		else if (strcmp(arg, "--pitch") == 0 && has_val)
+			opts.pitch_center = (float)atof(argv[++i]);
+		else if (strcmp(arg, "--pitch-swing") == 0 && has_val)
+			opts.pitch_amplitude = (float)atof(argv[++i]);
+		else if (strcmp(arg, "--fps") == 0 && has_val)
+			opts.fps = (float)atof(argv[++i]);
+		else
+		{
+			printf("Error::HEADLESS::Unknown argument: %s\n", arg);
+			return false;
+		}
+	}
+	if (opts.frames < 1)
+		opts.frames = 1;
+	return true;
+}
+
+// Camera path: constant yaw rate, sinusoidal pitch, clamped like processInput()
+void headlessCameraPath(const HeadlessOptions& opts, int frame, float* yaw, float* pitch)
+{
+	float y = opts.yaw_start + opts.yaw_step * frame;
+	y = fmodf(y, 360.0f);
+	if (y < 0.0f)
+		y += 360.0f;
+	float p = opts.pitch_center + opts.pitch_amplitude * sinf(6.2831853f * frame / opts.frames);
+	if (p > 85.0f)
+		p = 85.0f;
+	else if (p < -85.0f)
+		p = -85.0f;
+	*yaw = y;
+	*pitch = p;
+}
+
+
+class HeadlessContext {
+	public:
+		HeadlessContext() : display(EGL_NO_DISPLAY), surface(EGL_NO_SURFACE), context(EGL_NO_CONTEXT) {}
+		~HeadlessContext() { destroy(); }
+		bool create();
+		void destroy();
+
+	private:
+		EGLDisplay display;
+		EGLSurface surface;
+		EGLContext context;
+};
+bool HeadlessContext::create()
+{
+	EGLint major, minor;
+	display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+	{
+		//No X/Wayland server, ask Mesa for its surfaceless platform instead
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		display = EGL_NO_DISPLAY;
+		if (getPlatformDisplay != NULL)
+			display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (display == EGL_NO_DISPLAY)
+		{
+			printf("Error::EGL::No display\n");
+			return false;
+		}
+		if (!eglInitialize(display, &major, &minor))
+		{
+			printf("Error::EGL::Initialize failed (0x%x)\n", eglGetError());
+			display = EGL_NO_DISPLAY;
+			return false;
+		}
+	}
+	printf("EGL %d.%d, vendor: %s\n", major, minor, eglQueryString(display, EGL_VENDOR));
+
+	const EGLint config_attribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint num_configs = 0;
+	if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs < 1)
+	{
+		printf("Error::EGL::No matching config\n");
+		return false;
+	}
+	eglBindAPI(EGL_OPENGL_API);
+
+	const EGLint context_attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+	if (context == EGL_NO_CONTEXT)
+	{
+		printf("Error::EGL::Context creation failed (0x%x)\n", eglGetError());
+		return false;
+	}
+
+	//Everything is drawn into our own FBO, the default surface is never used
+	const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+	if (extensions == NULL || strstr(extensions, "EGL_KHR_surfaceless_context") == NULL)
+	{
+		const EGLint pbuffer_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+		if (surface == EGL_NO_SURFACE)
+		{
+			printf("Error::EGL::Pbuffer creation failed (0x%x)\n", eglGetError());
+			return false;
+		}
+	}
+	if (!eglMakeCurrent(display, surface, surface, context))
+	{
+		printf("Error::EGL::MakeCurrent failed (0x%x)\n", eglGetError());
+		return false;
+	}
+	return true;
+}
+void HeadlessContext::destroy()
+{
+	if (display == EGL_NO_DISPLAY)
+		return;
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (context != EGL_NO_CONTEXT)
+		eglDestroyContext(display, context);
+	if (surface != EGL_NO_SURFACE)
+		eglDestroySurface(display, surface);
+	eglTerminate(display);
+	display = EGL_NO_DISPLAY;
+	surface = EGL_NO_SURFACE;
+	context = EGL_NO_CONTEXT;
+}
+
+
+// Minimal PNG encoder, stored (uncompressed) deflate blocks so no zlib is needed
+namespace PngWriter {
+	inline uint32_t crc32(const uint8_t* data, size_t len, uint32_t crc = 0)
+	{
+		static uint32_t table[256];
+		static bool table_init = false;
+		if (!table_init)
+		{
+			for (uint32_t n = 0; n < 256; n++)
+			{
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++)
+					c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+				table[n] = c;
+			}
+			table_init = true;
+		}
+		crc = ~crc;
+		for (size_t i = 0; i < len; i++)
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+	inline void put32(std::vector<uint8_t>& out, uint32_t v)
+	{
+		out.push_back((v >> 24) & 0xFF);
+		out.push_back((v >> 16) & 0xFF);
+		out.push_back((v >> 8) & 0xFF);
+		out.push_back(v & 0xFF);
+	}
+	inline void chunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data)
+	{
+		put32(out, (uint32_t)data.size());
+		size_t start = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), data.begin(), data.end());
+		put32(out, crc32(&out[start], out.size() - start));
+	}
+
+	// rgba is bottom-up as returned by glReadPixels
+	bool write(const char* filename, int width, int height, const uint8_t* rgba)
+	{
+		size_t row_bytes = (size_t)width * 4;
+		std::vector<uint8_t> raw;
+		raw.reserve((row_bytes + 1) * height);
+		for (int y = height - 1; y >= 0; y--)
+		{
+			raw.push_back(0);	//Filter type: none
+			const uint8_t* row = rgba + (size_t)y * row_bytes;
+			raw.insert(raw.end(), row, row + row_bytes);
+		}
+
+		std::vector<uint8_t> zdata;
+		zdata.push_back(0x78);
+		zdata.push_back(0x01);
+		size_t pos = 0;
+		do
+		{
+			size_t block = raw.size() - pos;
+			if (block > 65535)
+				block = 65535;
+			bool last = (pos + block == raw.size());
+			zdata.push_back(last ? 1 : 0);
+			zdata.push_back(block & 0xFF);
+			zdata.push_back((block >> 8) & 0xFF);
+			zdata.push_back(~block & 0xFF);
+			zdata.push_back((~block >> 8) & 0xFF);
+			zdata.insert(zdata.end(), raw.begin() + pos, raw.begin() + pos + block);
+			pos += block;
+		} while (pos < raw.size());
+
+		uint32_t a = 1, b = 0;
+		for (size_t i = 0; i < raw.size(); i++)
+		{
+			a = (a + raw[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		put32(zdata, (b << 16) | a);
+
+		std::vector<uint8_t> png;
+		const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		png.insert(png.end(), signature, signature + 8);
+
+		std::vector<uint8_t> ihdr;
+		put32(ihdr, width);
+		put32(ihdr, height);
+		ihdr.push_back(8);	//Bit depth
+		ihdr.push_back(6);	//Color type RGBA
+		ihdr.push_back(0);
+		ihdr.push_back(0);
+		ihdr.push_back(0);
+		chunk(png, "IHDR", ihdr);
+		chunk(png, "IDAT", zdata);
+		chunk(png, "IEND", std::vector<uint8_t>());
+
+		FILE* f = fopen(filename, "wb");
+		if (f == NULL)
+			return false;
+		size_t written = fwrite(&png[0], 1, png.size(), f);
+		fclose(f);
+		return written == png.size();
+	}
+}
+
+
+// Offscreen render target plus asynchronous readback. Usage per frame:
+// begin() -> draw -> end(frame_number). end() kicks off a DMA into the next
+// PBO and maps the oldest one, so the CPU only ever waits on a frame that was
+// finished PBO_RING_SIZE - 1 frames ago. finish() drains what is left.
+class FrameCapture {
+	public:
+		FrameCapture(int width, int height, const HeadlessOptions& opts);
+		~FrameCapture();
+		void begin();
+		void end(int frame);
+		void finish();
+		//Only frames that reached disk, failed maps and writes count as failed
+		int framesWritten() { return frames_written; }
+		int framesFailed() { return frames_failed; }
+
+	private:
+		struct PendingFrame {
+			int frame;
+			std::vector<uint8_t> pixels;
+		};
+
+		int width, height;
+		HeadlessOptions opts;
+		unsigned int fbo, color_rbo, depth_rbo;
+		unsigned int pbos[PBO_RING_SIZE];
+		int pbo_frame[PBO_RING_SIZE];
+		int pbo_idx;
+
+		std::thread writer;
+		std::deque<PendingFrame> queue;
+		std::mutex queue_mutex;
+		std::condition_variable queue_cv;
+		bool writer_running;
+		std::atomic<int> frames_written;
+		std::atomic<int> frames_failed;
+
+		void collect(int idx);
+		void writerLoop();
+};
+FrameCapture::FrameCapture(int width_, int height_, const HeadlessOptions& opts_)
+{
+	width = width_;
+	height = height_;
+	opts = opts_;
+	pbo_idx = 0;
+	frames_written = 0;
+	frames_failed = 0;
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glGenRenderbuffers(1, &color_rbo);
+	glBindRenderbuffer(GL_RENDERBUFFER, color_rbo);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_rbo);
+	glGenRenderbuffers(1, &depth_rbo);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth_rbo);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_rbo);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Error::FRAMEBUFFER::Offscreen target incomplete\n");
+	}
+
+	glGenBuffers(PBO_RING_SIZE, pbos);
+	for (int i = 0; i < PBO_RING_SIZE; i++)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width * height * 4, NULL, GL_STREAM_READ);
+		pbo_frame[i] = -1;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	writer_running = true;
+	writer = std::thread(&FrameCapture::writerLoop, this);
+}
+FrameCapture::~FrameCapture()
+{
+	finish();
+	glDeleteBuffers(PBO_RING_SIZE, pbos);
+	glDeleteRenderbuffers(1, &color_rbo);
+	glDeleteRenderbuffers(1, &depth_rbo);
+	glDeleteFramebuffers(1, &fbo);
+}
+void FrameCapture::begin()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, width, height);
+}
+void FrameCapture::end(int frame)
+{
+	//Slot we're about to reuse still holds the oldest frame, hand it off first
+	if (pbo_frame[pbo_idx] >= 0)
+		collect(pbo_idx);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[pbo_idx]);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	pbo_frame[pbo_idx] = frame;
+	pbo_idx = (pbo_idx + 1) % PBO_RING_SIZE;
+}
+void FrameCapture::collect(int idx)
+{
+	PendingFrame pending;
+	pending.frame = pbo_frame[idx];
+	pbo_frame[idx] = -1;
+
+	if (!opts.write_frames)
+		return;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[idx]);
+	const uint8_t* data = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (size_t)width * height * 4, GL_MAP_READ_BIT);
+	if (data == NULL)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		printf("Failed to map frame %d\n", pending.frame);
+		frames_failed++;
+		return;
+	}
+	pending.pixels.assign(data, data + (size_t)width * height * 4);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	std::lock_guard<std::mutex> lock(queue_mutex);
+	queue.push_back(std::move(pending));
+	queue_cv.notify_one();
+}
+void FrameCapture::finish()
+{
+	if (!writer.joinable())
+		return;
+
+	for (int i = 0; i < PBO_RING_SIZE; i++)
+	{
+		int idx = (pbo_idx + i) % PBO_RING_SIZE;
+		if (pbo_frame[idx] >= 0)
+			collect(idx);
+	}
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		writer_running = false;
+	}
+	queue_cv.notify_one();
+	writer.join();
+}
+void FrameCapture::writerLoop()
+{
+	while (1)
+	{
+		PendingFrame pending;
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			queue_cv.wait(lock, [this] { return !writer_running || !queue.empty(); });
+			if (queue.empty())
+				return;
+			pending = std::move(queue.front());
+			queue.pop_front();
+		}
+
+		char filename[512];
+		bool ok;
+		if (opts.raw)
+		{
+			snprintf(filename, sizeof(filename), "%s/frame_%05d_%dx%d.rgba", opts.out_dir.c_str(), pending.frame, width, height);
+			FILE* f = fopen(filename, "wb");
+			if (f == NULL)
+			{
+				printf("Failed to open %s\n", filename);
+				frames_failed++;
+				continue;
+			}
+			ok = fwrite(&pending.pixels[0], 1, pending.pixels.size(), f) == pending.pixels.size();
+			if (fclose(f) != 0)
+				ok = false;
+		}
+		else
+		{
+			snprintf(filename, sizeof(filename), "%s/frame_%05d.png", opts.out_dir.c_str(), pending.frame);
+			ok = PngWriter::write(filename, width, height, &pending.pixels[0]);
+		}
+		if (ok)
+		{
+			frames_written++;
+		}
+		else
+		{
+			printf("Failed to write %s\n", filename);
+			frames_failed++;
+		}
+	}
+}
+
+#endif  //OFFSCREEN_H
@@ -14,9 +14,35 @@
 #include <pov_display/Space_Game.h>
 #include <pov_display/Main.h>
 
+//UDP frame ingest uses POSIX sockets
+#ifndef UDP_INGEST_SUPPORT
+#ifdef _WIN32
+#define UDP_INGEST_SUPPORT false
+#else
+#define UDP_INGEST_SUPPORT true
+#endif
+#endif
+#if UDP_INGEST_SUPPORT
+#include "UdpIngest.h"
+#endif
+
+//Recording playback maps files with mmap
+#ifndef FRAME_RECORDING_SUPPORT
+#ifdef _WIN32
+#define FRAME_RECORDING_SUPPORT false
+#else
+#define FRAME_RECORDING_SUPPORT true
+#endif
+#endif
+#if FRAME_RECORDING_SUPPORT
+#include "FrameRecorder.h"
+#endif
+
 
 #define TICK_DELAY 5
 #define PRINT_DELTA_TIME false
+#define PRINT_SCENE_BUDGET false	//Print scene costs and quality levels
+#define SCENE_BUDGET_REPORT_TICKS 1000
 
 struct ButtonStatus {
 	typedef enum {BTN_NONE, BTN_PRESS, BTN_RELEASE} button_status_t;
@@ -26,6 +52,13 @@ struct ButtonStatus {
 struct ThreadData {
 	bool thread_running;
 	SYSTEMTIME prev_thread_time;
+#if UDP_INGEST_SUPPORT
+	UdpFrameReceiver* udp_receiver;		//NULL = main_exec only
+#endif
+#if FRAME_RECORDING_SUPPORT
+	FramePlayer* player;			//Replays a recording instead of main_exec
+	float playback_speed;
+#endif
 };
 
 void delay_ms(int ms, bool *thread_running, SYSTEMTIME *ts)
@@ -49,6 +82,7 @@ void main_exec(doubleBuffer* frame_buffer);
 
 void processEvents(struct ButtonStatus *button_status)
 {
+	PROFILE_FUNCTION();
 	for (int i = 0; i < NUM_KEYS; i++)
 	{
 		if (button_status->button_events[i] == ButtonStatus::BTN_PRESS)
@@ -77,6 +111,7 @@ void thread_loop(struct ThreadData* thread_data, doubleBuffer* frame_buffer, str
 {
 	while (thread_data->thread_running)
 	{
+		PROFILE_ZONE("tick");
 		SYSTEMTIME ts;
 		GetSystemTime(&ts);
 		if (PRINT_DELTA_TIME)
@@ -89,15 +124,35 @@ void thread_loop(struct ThreadData* thread_data, doubleBuffer* frame_buffer, str
 		processEvents(button_status);
 		frame_buffer->clear();
 
-		main_exec(frame_buffer);//exec function responsible for managing event buffer
+		bool external_frame = false;
+#if UDP_INGEST_SUPPORT
+		//A complete network frame replaces this tick's main_exec output
+		if (thread_data->udp_receiver != NULL)
+			external_frame = thread_data->udp_receiver->takeFrame(frame_buffer);
+#endif
+#if FRAME_RECORDING_SUPPORT
+		if (!external_frame && thread_data->player != NULL)
+			external_frame = thread_data->player->tick(frame_buffer, thread_data->playback_speed);
+#endif
+		if (!external_frame)
+		{
+			PROFILE_ZONE("main_exec");
+			scene_budget.beginTick();
+			main_exec(frame_buffer);//exec function responsible for managing event buffer
+			scene_budget.endTick();
+			if (PRINT_SCENE_BUDGET && scene_budget.getCounters().ticks % SCENE_BUDGET_REPORT_TICKS == 0)
+				scene_budget.print();
+		}
 
 		frame_buffer->update();
+		PROFILE_ZONE("tick delay");
 		delay_ms(TICK_DELAY, &thread_data->thread_running, &ts);
 	}
 }
 
 void thread_main(struct ThreadData *thread_data, doubleBuffer* frame_buffer, struct ButtonStatus* button_status)
 {
+	PROFILE_THREAD("animation");
 	thread_setup(thread_data, frame_buffer, button_status);//Equivalent of arduino setup()
 	thread_loop(thread_data, frame_buffer, button_status);//Equivalent of superLoop()
 }
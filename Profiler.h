@@ -0,0 +1,193 @@
+#ifndef PROFILER_LIB
+#define PROFILER_LIB
+
+//Scoped zone profiler. PROFILE_ZONE("name") times the rest of the enclosing
+//scope, PROFILE_FUNCTION() names the zone after the function and
+//PROFILE_BEGIN(var, "name") / PROFILE_END(var) close a zone early. Each thread
+//writes finished zones into its own ring buffer (single writer, no locks on
+//the hot path), PROFILE_WRITE_TRACE(path) dumps every thread's ring as Chrome
+//trace_event JSON on one shared clock, open it in Perfetto or chrome://tracing.
+//With PROFILER_ENABLED false (and always on the firmware) the macros are empty.
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED false
+#endif
+#define PROFILE_TRACE_FILE "pov_trace.json"     //Written by the viewer on exit
+
+#if PROFILER_ENABLED && defined(CONFIG_POV_SIMULATOR)
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILE_USE_TSC true
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define PROFILE_USE_TSC true
+#else
+#define PROFILE_USE_TSC false
+#endif
+
+#define PROFILE_RING_SIZE (1 << 16)     //Zones kept per thread, oldest are overwritten
+
+struct ProfileZone
+{
+    const char* name;                   //Must be a string literal
+    uint64_t start;
+    uint64_t end;
+};
+
+struct ProfileThread
+{
+    char name[32];
+    uint32_t tid;
+    std::atomic<uint64_t> head;         //Zones ever written, ring index is head % PROFILE_RING_SIZE
+    ProfileZone zones[PROFILE_RING_SIZE];
+};
+
+class Profiler
+{
+public:
+    static uint64_t now();
+    static ProfileThread* thread();
+    static void setThreadName(const char* name);
+    static bool writeTrace(const char* path);
+
+private:
+    static std::mutex registry_mutex;
+    static std::vector<ProfileThread*> threads;
+    static uint64_t base_ticks;
+    static std::chrono::steady_clock::time_point base_time;
+    static thread_local ProfileThread* current;
+};
+
+class ProfileScope
+{
+public:
+    ProfileScope(const char* name) : name(name), start(Profiler::now()) {}
+    ~ProfileScope() { end(); }
+    void end();
+
+private:
+    const char* name;
+    uint64_t start;
+};
+
+std::mutex Profiler::registry_mutex;
+std::vector<ProfileThread*> Profiler::threads;
+uint64_t Profiler::base_ticks = Profiler::now();
+std::chrono::steady_clock::time_point Profiler::base_time = std::chrono::steady_clock::now();
+thread_local ProfileThread* Profiler::current = NULL;
+
+inline uint64_t Profiler::now()
+{
+#if PROFILE_USE_TSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+inline ProfileThread* Profiler::thread()
+{
+    if (current != NULL)
+        return current;
+    //First zone on this thread, rings live until exit so the dump can read them
+    ProfileThread* t = new ProfileThread();
+    t->head.store(0);
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    t->tid = (uint32_t)threads.size() + 1;
+    snprintf(t->name, sizeof(t->name), "thread %u", t->tid);
+    threads.push_back(t);
+    current = t;
+    return t;
+}
+void Profiler::setThreadName(const char* name)
+{
+    ProfileThread* t = thread();
+    strncpy(t->name, name, sizeof(t->name) - 1);
+    t->name[sizeof(t->name) - 1] = '\0';
+}
+
+inline void ProfileScope::end()
+{
+    if (name == NULL)
+        return;
+    ProfileThread* t = Profiler::thread();
+    uint64_t head = t->head.load(std::memory_order_relaxed);
+    ProfileZone& z = t->zones[head % PROFILE_RING_SIZE];
+    z.name = name;
+    z.start = start;
+    z.end = Profiler::now();
+    t->head.store(head + 1, std::memory_order_release);
+    name = NULL;
+}
+
+//Best taken after the threads stopped, a live writer can overwrite the oldest
+//zones while they are being read
+bool Profiler::writeTrace(const char* path)
+{
+    //Ticks -> us, measured over the whole run so the TSC rate is exact enough
+    double us_per_tick = 1.0e-3;
+    uint64_t end_ticks = now();
+    double elapsed_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - base_time).count();
+    if (PROFILE_USE_TSC && end_ticks > base_ticks)
+        us_per_tick = elapsed_us / (double)(end_ticks - base_ticks);
+
+    FILE* f = fopen(path, "w");
+    if (f == NULL)
+    {
+        printf("Error::Profiler::Can't write %s\n", path);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    fprintf(f, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"POV simulator\"}}");
+    size_t total = 0;
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        ProfileThread* t = threads[i];
+        fprintf(f, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s\"}}", t->tid, t->name);
+        uint64_t head = t->head.load(std::memory_order_acquire);
+        uint64_t first = head > PROFILE_RING_SIZE ? head - PROFILE_RING_SIZE : 0;
+        for (uint64_t n = first; n < head; n++)
+        {
+            const ProfileZone& z = t->zones[n % PROFILE_RING_SIZE];
+            double ts = (double)(int64_t)(z.start - base_ticks) * us_per_tick;
+            double dur = (double)(z.end - z.start) * us_per_tick;
+            fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}", z.name, t->tid, ts, dur);
+        }
+        total += head - first;
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    printf("Profiler: %zu zones from %zu threads written to %s\n", total, threads.size(), path);
+    return true;
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) ProfileScope PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__FUNCTION__)
+#define PROFILE_BEGIN(var, name) ProfileScope var(name)
+#define PROFILE_END(var) var.end()
+#define PROFILE_THREAD(name) Profiler::setThreadName(name)
+#define PROFILE_WRITE_TRACE(path) Profiler::writeTrace(path)
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_BEGIN(var, name)
+#define PROFILE_END(var)
+#define PROFILE_THREAD(name)
+#define PROFILE_WRITE_TRACE(path)
+
+#endif
+
+#endif
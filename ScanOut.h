@@ -0,0 +1,243 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <pov_display/FrameBuffer.h>
+
+// Emulates the rotor reading the frame buffer one angular slice at a time.
+// At a given RPM each of the LENGTH slices owns 60 / (RPM * LENGTH) seconds;
+// the emulator wakes at the start of every slot, copies that column out of
+// getReadBuffer() (plus an optional fake LED push cost) and checks it finished
+// before the next slot. Stats show whether the animation thread and the column
+// push fit the firmware budget before anything is flashed.
+
+#define SCANOUT_SPIN_US 1000		//Spin instead of sleeping this close to a slot start
+#define SCANOUT_REPORT_MS 2000		//Print stats this often, 0 = never
+
+struct ScanOutStats {
+	uint64_t revolutions;
+	uint64_t slices;
+	uint64_t deadline_misses;		//Column push finished after the slot ended
+	uint64_t skipped_slices;		//Whole slots lost because we were that late
+	uint64_t torn_revolutions;		//Revolutions built from more than one frame
+	uint64_t torn_slices;			//Frame changed while a single column was being copied
+	uint64_t frames_seen;
+	double jitter_min_us;			//Slot start lateness
+	double jitter_max_us;
+	double jitter_sum_us;
+	double jitter_sq_sum_us;
+	double push_max_us;			//Column copy + emulated push time
+	double push_sum_us;
+
+	void reset();
+	double jitterMean() { return slices ? jitter_sum_us / slices : 0.0; }
+	double jitterStdDev();
+	void print(double slot_us);
+};
+
+class ScanOutEmulator {
+	public:
+		ScanOutEmulator(doubleBuffer* frame_buffer, float rpm, float push_us = 0.0f);
+		~ScanOutEmulator();
+
+		void start();
+		void stop();
+		bool running() { return thread_running; }
+
+		//Thread safe snapshot, reset clears the counters
+		ScanOutStats getStats(bool reset = false);
+		double slotMicros() { return slot_us; }
+		//Last column scanned for each slice, i.e. what the rotor actually showed.
+		//out is RGB888 [LENGTH][WIDTH][HEIGHT][NUM_COLORS]
+		void getScannedFrame(uint8_t* out);
+
+	private:
+		typedef std::chrono::steady_clock clock;
+
+		doubleBuffer* frame_buffer;
+		double slot_us;
+		double push_us;
+		volatile bool thread_running;
+		std::thread th;
+		std::mutex stats_mutex;
+		ScanOutStats stats;
+		uint8_t scanned[LENGTH][WIDTH * HEIGHT * NUM_COLORS];
+
+		void threadLoop();
+		void waitUntil(clock::time_point t);
+		void pushColumn(int slice);
+};
+
+void ScanOutStats::reset()
+{
+	memset(this, 0, sizeof(*this));
+	jitter_min_us = 1e30;
+}
+double ScanOutStats::jitterStdDev()
+{
+	if (slices < 2)
+		return 0.0;
+	double mean = jitterMean();
+	double var = jitter_sq_sum_us / slices - mean * mean;
+	return var > 0.0 ? sqrt(var) : 0.0;
+}
+void ScanOutStats::print(double slot_us)
+{
+	printf("ScanOut: %llu revs, %llu slices (slot %.1f us), %llu misses, %llu skipped, %llu torn revs, %llu torn slices, %llu frames\n",
+		(unsigned long long)revolutions, (unsigned long long)slices, slot_us,
+		(unsigned long long)deadline_misses, (unsigned long long)skipped_slices,
+		(unsigned long long)torn_revolutions, (unsigned long long)torn_slices, (unsigned long long)frames_seen);
+	if (slices)
+	{
+		printf("ScanOut: jitter min/mean/max/sd %.1f/%.1f/%.1f/%.1f us, push mean/max %.2f/%.2f us\n",
+			jitter_min_us, jitterMean(), jitter_max_us, jitterStdDev(), push_sum_us / slices, push_max_us);
+	}
+}
+
+ScanOutEmulator::ScanOutEmulator(doubleBuffer* frame_buffer, float rpm, float push_us)
+{
+	this->frame_buffer = frame_buffer;
+	if (rpm < 1.0f)
+		rpm = 1.0f;
+	slot_us = 60.0e6 / ((double)rpm * LENGTH);
+	this->push_us = push_us;
+	thread_running = false;
+	stats.reset();
+	memset(scanned, 0, sizeof(scanned));
+}
+ScanOutEmulator::~ScanOutEmulator()
+{
+	stop();
+}
+void ScanOutEmulator::start()
+{
+	if (thread_running)
+		return;
+	thread_running = true;
+	th = std::thread(&ScanOutEmulator::threadLoop, this);
+}
+void ScanOutEmulator::stop()
+{
+	thread_running = false;
+	if (th.joinable())
+		th.join();
+}
+ScanOutStats ScanOutEmulator::getStats(bool reset)
+{
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	ScanOutStats copy = stats;
+	if (reset)
+		stats.reset();
+	return copy;
+}
+void ScanOutEmulator::getScannedFrame(uint8_t* out)
+{
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	memcpy(out, scanned, sizeof(scanned));
+}
+void ScanOutEmulator::waitUntil(clock::time_point t)
+{
+	//OS sleep is too coarse for slots of a few hundred us, so only sleep far out
+	clock::time_point spin_from = t - std::chrono::microseconds(SCANOUT_SPIN_US);
+	if (clock::now() < spin_from)
+		std::this_thread::sleep_until(spin_from);
+	while (clock::now() < t)
+		;
+}
+void ScanOutEmulator::pushColumn(int slice)
+{
+	//Same read the ISR does: one column straight out of the current read buffer
+	frameBuffer* rBuf = frame_buffer->getReadBuffer();
+	uint8_t tmp[WIDTH * HEIGHT * NUM_COLORS];
+	uint8_t column[WIDTH * HEIGHT * NUM_COLORS];
+	memcpy(column, rBuf->sliceRGB(slice, tmp), sizeof(column));
+	if (push_us > 0.0)
+	{
+		//Stand-in for clocking the column out to the LED strip
+		clock::time_point done = clock::now() + std::chrono::nanoseconds((int64_t)(push_us * 1000.0));
+		while (clock::now() < done)
+			;
+	}
+	memcpy(scanned[slice], column, sizeof(column));
+}
+void ScanOutEmulator::threadLoop()
+{
+	std::chrono::nanoseconds slot((int64_t)(slot_us * 1000.0));
+	clock::time_point rev_start = clock::now();
+	clock::time_point last_report = rev_start;
+	uint32_t last_seq = frame_buffer->getFrameSequence();
+
+	while (thread_running)
+	{
+		bool rev_torn = false;
+		uint32_t rev_seq = frame_buffer->getFrameSequence();
+		for (int slice = 0; slice < LENGTH && thread_running; slice++)
+		{
+			clock::time_point slot_start = rev_start + slice * slot;
+			clock::time_point slot_end = slot_start + slot;
+			waitUntil(slot_start);
+
+			clock::time_point t0 = clock::now();
+			if (t0 >= slot_end)
+			{
+				//Fell behind by a whole slot, the rotor has already moved on
+				std::lock_guard<std::mutex> lock(stats_mutex);
+				stats.skipped_slices++;
+				continue;
+			}
+			uint32_t seq_before = frame_buffer->getFrameSequence();
+			{
+				std::lock_guard<std::mutex> lock(stats_mutex);
+				pushColumn(slice);
+			}
+			uint32_t seq_after = frame_buffer->getFrameSequence();
+			clock::time_point t1 = clock::now();
+
+			double jitter = std::chrono::duration<double, std::micro>(t0 - slot_start).count();
+			double push = std::chrono::duration<double, std::micro>(t1 - t0).count();
+			std::lock_guard<std::mutex> lock(stats_mutex);
+			stats.slices++;
+			stats.jitter_sum_us += jitter;
+			stats.jitter_sq_sum_us += jitter * jitter;
+			if (jitter < stats.jitter_min_us)
+				stats.jitter_min_us = jitter;
+			if (jitter > stats.jitter_max_us)
+				stats.jitter_max_us = jitter;
+			stats.push_sum_us += push;
+			if (push > stats.push_max_us)
+				stats.push_max_us = push;
+			if (t1 > slot_end)
+				stats.deadline_misses++;
+			if ((seq_before & 1) || seq_before != seq_after)
+				stats.torn_slices++;
+			if (seq_after != rev_seq)
+				rev_torn = true;
+			if (seq_after != last_seq)
+			{
+				stats.frames_seen += (seq_after >> 1) - (last_seq >> 1);
+				last_seq = seq_after;
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(stats_mutex);
+			stats.revolutions++;
+			if (rev_torn)
+				stats.torn_revolutions++;
+		}
+		rev_start += LENGTH * slot;
+
+		clock::time_point now = clock::now();
+		if (SCANOUT_REPORT_MS > 0 && now - last_report >= std::chrono::milliseconds(SCANOUT_REPORT_MS))
+		{
+			ScanOutStats snapshot = getStats(true);
+			snapshot.print(slot_us);
+			last_report = now;
+		}
+	}
+}
@@ -0,0 +1,286 @@
+#ifndef SCENE_BUDGET_LIB
+#define SCENE_BUDGET_LIB
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef CONFIG_POV_SIMULATOR
+#include <stdio.h>
+#include <chrono>
+#endif
+
+//Per scene CPU accounting with automatic quality steps. A scene opens a
+//SCENE_BUDGET(name, levels) at the top of its update/draw, which times the
+//call and tells it which quality level to draw at (levels - 1 = full).
+//thread_loop brackets main_exec with beginTick()/endTick(). Every
+//SCENE_BUDGET_WINDOW ticks the tick cost p95 is checked: close to the budget
+//the most expensive scene steps down a level, with plenty of headroom the
+//cheapest degraded scene steps back up. Scenes without levels are only measured.
+
+#define SCENE_BUDGET_US 5000            //Tick budget, one TICK_DELAY
+#define SCENE_BUDGET_MAX_SCENES 16
+#define SCENE_BUDGET_WINDOW 32          //Ticks per p95 decision, also the hold-off after a step
+#define SCENE_BUDGET_DEGRADE 0.8f       //Step down when p95 is above this fraction of the budget
+#define SCENE_BUDGET_RESTORE 0.5f       //Step up when p95 is below this fraction
+#define SCENE_BUDGET_EWMA 0.1f          //Weight of the newest tick in a scene's cost
+
+struct SceneBudgetEntry
+{
+    const char* name;
+    uint8_t levels;
+    uint8_t quality;
+    bool ran;                           //Ran during the current tick
+    uint32_t tick_us;                   //Accumulated this tick, update + draw
+    float cost_us;                      //EWMA of tick_us over the ticks it ran in
+    uint32_t max_us;
+    uint32_t runs;                      //Ticks it ran in
+    uint32_t last_tick;                 //counters.ticks when it last ran
+    uint32_t degraded_runs;             //... below full quality
+};
+
+struct SceneBudgetCounters
+{
+    uint32_t ticks;
+    uint32_t over_budget_ticks;         //main_exec alone took longer than the budget
+    uint32_t degraded_ticks;            //A scene drew below full quality
+    uint32_t degrade_steps;
+    uint32_t restore_steps;
+    uint32_t last_p95_us;
+};
+
+class SceneBudget
+{
+private:
+    SceneBudgetEntry scenes[SCENE_BUDGET_MAX_SCENES];
+    int num_scenes;
+    uint32_t budget_us;
+    uint32_t tick_start;
+    uint32_t window[SCENE_BUDGET_WINDOW];
+    int window_fill;
+    bool tick_degraded;
+    bool adaptive;
+    SceneBudgetCounters counters;
+
+    uint32_t p95();
+
+public:
+    SceneBudget(uint32_t budget_us = SCENE_BUDGET_US);
+    static uint32_t nowMicros();
+
+    //Called once per scene, the id stays valid for the whole run. Registering
+    //a name again (update and draw of one game) returns the same id
+    int registerScene(const char* name, uint8_t levels);
+    uint8_t quality(int id) { return scenes[id].quality; }
+    void addCost(int id, uint32_t us);
+
+    void beginTick();
+    void endTick();
+
+    //false pins every scene at full quality, e.g. for golden frame runs
+    void setAdaptive(bool on);
+    void setBudget(uint32_t us) { budget_us = us; }
+    uint32_t budget() { return budget_us; }
+    bool degraded();
+    const SceneBudgetCounters& getCounters() { return counters; }
+    int sceneCount() { return num_scenes; }
+    const SceneBudgetEntry& scene(int id) { return scenes[id]; }
+#ifdef CONFIG_POV_SIMULATOR
+    void print();
+#endif
+};
+
+//Times one scene call for as long as it is in scope
+class SceneCost
+{
+private:
+    int id;
+    uint32_t start;
+
+public:
+    SceneCost(int id);
+    ~SceneCost();
+    uint8_t quality();
+};
+
+SceneBudget scene_budget;
+extern SceneBudget scene_budget;
+
+#define SCENE_BUDGET(name, levels) \
+    static const int scene_budget_id = scene_budget.registerScene(name, levels); \
+    SceneCost scene_cost(scene_budget_id)
+
+SceneBudget::SceneBudget(uint32_t budget_us)
+{
+    this->budget_us = budget_us;
+    num_scenes = 0;
+    tick_start = 0;
+    window_fill = 0;
+    tick_degraded = false;
+    adaptive = true;
+    memset(&counters, 0, sizeof(counters));
+}
+uint32_t SceneBudget::nowMicros()
+{
+#ifdef CONFIG_POV_SIMULATOR
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+    return micros();
+#endif
+}
+int SceneBudget::registerScene(const char* name, uint8_t levels)
+{
+    for (int i = 0; i < num_scenes; i++)
+    {
+        if (strcmp(scenes[i].name, name) == 0)
+            return i;
+    }
+    if (num_scenes >= SCENE_BUDGET_MAX_SCENES)
+    {
+#ifdef CONFIG_POV_SIMULATOR
+        printf("Error::SceneBudget::Too many scenes, %s shares the last entry\n", name);
+#endif
+        return SCENE_BUDGET_MAX_SCENES - 1;
+    }
+    SceneBudgetEntry& s = scenes[num_scenes];
+    memset(&s, 0, sizeof(s));
+    s.name = name;
+    s.levels = levels > 0 ? levels : 1;
+    s.quality = s.levels - 1;
+    return num_scenes++;
+}
+void SceneBudget::addCost(int id, uint32_t us)
+{
+    SceneBudgetEntry& s = scenes[id];
+    s.tick_us += us;
+    s.ran = true;
+    if (s.quality + 1 < s.levels)
+        tick_degraded = true;
+}
+void SceneBudget::beginTick()
+{
+    tick_start = nowMicros();
+    tick_degraded = false;
+}
+void SceneBudget::endTick()
+{
+    uint32_t tick_us = nowMicros() - tick_start;
+    counters.ticks++;
+    if (tick_us > budget_us)
+        counters.over_budget_ticks++;
+    if (tick_degraded)
+        counters.degraded_ticks++;
+
+    for (int i = 0; i < num_scenes; i++)
+    {
+        SceneBudgetEntry& s = scenes[i];
+        if (!s.ran)
+            continue;
+        s.cost_us = s.runs == 0 ? s.tick_us : s.cost_us + SCENE_BUDGET_EWMA * (s.tick_us - s.cost_us);
+        if (s.tick_us > s.max_us)
+            s.max_us = s.tick_us;
+        s.runs++;
+        s.last_tick = counters.ticks;
+        if (s.quality + 1 < s.levels)
+            s.degraded_runs++;
+        s.tick_us = 0;
+        s.ran = false;
+    }
+
+    window[window_fill++] = tick_us;
+    if (window_fill < SCENE_BUDGET_WINDOW)
+        return;
+    window_fill = 0;
+    counters.last_p95_us = p95();
+    if (!adaptive)
+        return;
+
+    //Only scenes that ran during the last window are candidates
+    int pick = -1;
+    if (counters.last_p95_us > budget_us * SCENE_BUDGET_DEGRADE)
+    {
+        for (int i = 0; i < num_scenes; i++)
+        {
+            if (scenes[i].quality > 0 && counters.ticks - scenes[i].last_tick < SCENE_BUDGET_WINDOW &&
+                (pick < 0 || scenes[i].cost_us > scenes[pick].cost_us))
+                pick = i;
+        }
+        if (pick >= 0)
+        {
+            scenes[pick].quality--;
+            counters.degrade_steps++;
+        }
+    }
+    else if (counters.last_p95_us < budget_us * SCENE_BUDGET_RESTORE)
+    {
+        for (int i = 0; i < num_scenes; i++)
+        {
+            if (scenes[i].quality + 1 < scenes[i].levels && (pick < 0 || scenes[i].cost_us < scenes[pick].cost_us))
+                pick = i;
+        }
+        if (pick >= 0)
+        {
+            scenes[pick].quality++;
+            counters.restore_steps++;
+        }
+    }
+}
+uint32_t SceneBudget::p95()
+{
+    //Insertion sort, the window is tiny
+    uint32_t sorted[SCENE_BUDGET_WINDOW];
+    for (int i = 0; i < SCENE_BUDGET_WINDOW; i++)
+    {
+        int j = i;
+        for (; j > 0 && sorted[j - 1] > window[i]; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = window[i];
+    }
+    return sorted[(SCENE_BUDGET_WINDOW * 95) / 100];
+}
+void SceneBudget::setAdaptive(bool on)
+{
+    adaptive = on;
+    if (on)
+        return;
+    for (int i = 0; i < num_scenes; i++)
+        scenes[i].quality = scenes[i].levels - 1;
+}
+bool SceneBudget::degraded()
+{
+    for (int i = 0; i < num_scenes; i++)
+    {
+        if (scenes[i].quality + 1 < scenes[i].levels)
+            return true;
+    }
+    return false;
+}
+#ifdef CONFIG_POV_SIMULATOR
+void SceneBudget::print()
+{
+    printf("SceneBudget: %u ticks, p95 %u/%u us, %u over budget, %u degraded, %u steps down, %u up\n",
+        counters.ticks, counters.last_p95_us, budget_us, counters.over_budget_ticks,
+        counters.degraded_ticks, counters.degrade_steps, counters.restore_steps);
+    for (int i = 0; i < num_scenes; i++)
+    {
+        const SceneBudgetEntry& s = scenes[i];
+        printf("SceneBudget:   %-20s quality %d/%d, cost %.1f us (max %u), %u/%u runs degraded\n",
+            s.name, s.quality, s.levels - 1, s.cost_us, s.max_us, s.degraded_runs, s.runs);
+    }
+}
+#endif
+
+SceneCost::SceneCost(int id)
+{
+    this->id = id;
+    start = SceneBudget::nowMicros();
+}
+SceneCost::~SceneCost()
+{
+    scene_budget.addCost(id, SceneBudget::nowMicros() - start);
+}
+uint8_t SceneCost::quality()
+{
+    return scene_budget.quality(id);
+}
+
+#endif
@@ -7,6 +7,7 @@
 //#include "Events.h"
 #include <pov_display/Events.h>
 #include "Shell.h"
+#include "Sprite.h"
 
 class Bullet
 {
@@ -570,7 +571,7 @@ const static uint8_t BANANA_SPRITE[64 * 3] = {
   255,163,0,  255,236,39,  255,236,39,  255,236,39,  255,236,39,  255,163,0, 255,163,0,  0,0,0,
   0,0,0,  255,163,0,  255,163,0,  255,163,0,  255,163,0,  255,163,0,  0,0,0,  0,0,0,
 };
-static const uint8_t blue_potion_arr[3 * 8 * 8] = {
+static constexpr uint8_t blue_potion_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  255,241,232,  255,241,232,  255,241,232,  255,241,232,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  194,195,199,  194,195,199,  0,0,0,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  255,241,232,  255,241,232,  0,0,0,  0,0,0,  0,0,0,
@@ -580,7 +581,7 @@ static const uint8_t blue_potion_arr[3 * 8 * 8] = {
   0,0,0,  194,195,199,  41,173,255,  41,173,255,  41,173,255,  41,173,255,  194,195,199,  0,0,0,
   0,0,0,  0,0,0,  194,195,199,  194,195,199,  194,195,199,  194,195,199,  0,0,0,  0,0,0,
 };
-static const uint8_t green_potion_arr[3 * 8 * 8] = {
+static constexpr uint8_t green_potion_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  255,241,232,  255,241,232,  255,241,232,  255,241,232,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  194,195,199,  194,195,199,  0,0,0,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  255,241,232,  255,241,232,  0,0,0,  0,0,0,  0,0,0,
@@ -590,7 +591,7 @@ static const uint8_t green_potion_arr[3 * 8 * 8] = {
   0,0,0,  194,195,199,  0,228,54,  0,228,54,  0,228,54,  0,228,54,  194,195,199,  0,0,0,
   0,0,0,  0,0,0,  194,195,199,  194,195,199,  194,195,199,  194,195,199,  0,0,0,  0,0,0,
 };
-static const uint8_t orange_potion_arr[3 * 8 * 8] = {
+static constexpr uint8_t orange_potion_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  255,241,232,  255,241,232,  255,241,232,  255,241,232,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  194,195,199,  194,195,199,  0,0,0,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  255,241,232,  255,241,232,  0,0,0,  0,0,0,  0,0,0,
@@ -600,7 +601,7 @@ static const uint8_t orange_potion_arr[3 * 8 * 8] = {
   0,0,0,  194,195,199,  255,163,0,  255,163,0,  255,163,0,  255,163,0,  194,195,199,  0,0,0,
   0,0,0,  0,0,0,  194,195,199,  194,195,199,  194,195,199,  194,195,199,  0,0,0,  0,0,0,
 };
-static const uint8_t red_potion_arr[3 * 8 * 8] = {
+static constexpr uint8_t red_potion_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  255,241,232,  255,241,232,  255,241,232,  255,241,232,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  194,195,199,  194,195,199,  0,0,0,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  255,241,232,  255,241,232,  0,0,0,  0,0,0,  0,0,0,
@@ -610,7 +611,7 @@ static const uint8_t red_potion_arr[3 * 8 * 8] = {
   0,0,0,  194,195,199,  255,0,77,  255,0,77,  255,0,77,  255,0,77,  194,195,199,  0,0,0,
   0,0,0,  0,0,0,  194,195,199,  194,195,199,  194,195,199,  194,195,199,  0,0,0,  0,0,0,
 };
-static const uint8_t blue_gem_arr[3 * 8 * 8] = {
+static constexpr uint8_t blue_gem_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,0,0,  255,241,232,  41,173,255,  0,0,0,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  255,241,232,  255,241,232,  41,173,255,  41,173,255,  0,0,0,  0,0,0,
   0,0,0,  255,241,232,  255,241,232,  255,241,232,  41,173,255,  41,173,255,  41,173,255,  0,0,0,
@@ -620,7 +621,7 @@ static const uint8_t blue_gem_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  41,173,255,  41,173,255,  131,118,156,  131,118,156,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  41,173,255,  131,118,156,  0,0,0,  0,0,0,  0,0,0,
 };
-static const uint8_t green_gem_arr[3 * 8 * 8] = {
+static constexpr uint8_t green_gem_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,0,0,  255,241,232,  0,228,54,  0,0,0,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  255,241,232,  255,241,232,  0,228,54,  0,228,54,  0,0,0,  0,0,0,
   0,0,0,  255,241,232,  255,241,232,  255,241,232,  0,228,54,  0,228,54,  0,228,54,  0,0,0,
@@ -630,7 +631,7 @@ static const uint8_t green_gem_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,228,54,  0,228,54,  0,135,81,  0,135,81,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  0,228,54,  0,135,81,  0,0,0,  0,0,0,  0,0,0,
 };
-static const uint8_t orange_gem_arr[3 * 8 * 8] = {
+static constexpr uint8_t orange_gem_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,0,0,  255,241,232,  255,163,0,  0,0,0,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  255,241,232,  255,241,232,  255,163,0,  255,163,0,  0,0,0,  0,0,0,
   0,0,0,  255,241,232,  255,241,232,  255,241,232,  255,163,0,  255,163,0,  255,163,0,  0,0,0,
@@ -640,7 +641,7 @@ static const uint8_t orange_gem_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  255,163,0,  255,163,0,  209,106,58,  209,106,58,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  255,163,0,  209,106,58,  0,0,0,  0,0,0,  0,0,0,
 };
-static const uint8_t red_gem_arr[3 * 8 * 8] = {
+static constexpr uint8_t red_gem_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,0,0,  255,241,232,  255,0,77,  0,0,0,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  255,241,232,  255,241,232,  255,0,77,  255,0,77,  0,0,0,  0,0,0,
   0,0,0,  255,241,232,  255,241,232,  255,241,232,  255,0,77,  255,0,77,  255,0,77,  0,0,0,
@@ -650,7 +651,7 @@ static const uint8_t red_gem_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  255,0,77,  255,0,77,  126,37,83,  126,37,83,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  255,0,77,  126,37,83,  0,0,0,  0,0,0,  0,0,0,
 };
-static const uint8_t money_bag_arr[3 * 8 * 8] = {
+static constexpr uint8_t money_bag_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  209,106,58,  209,106,58,  209,106,58,  126,37,83,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  255,163,0,  255,163,0,  0,0,0,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  255,163,0,  209,106,58,  209,106,58,  126,37,83,  0,0,0,  0,0,0,
@@ -660,7 +661,7 @@ static const uint8_t money_bag_arr[3 * 8 * 8] = {
   209,106,58,  209,106,58,  209,106,58,  209,106,58,  126,37,83,  126,37,83,  126,37,83,  126,37,83,
   0,0,0,  126,37,83,  126,37,83,  126,37,83,  126,37,83,  126,37,83,  126,37,83,  0,0,0,
 };
-static const uint8_t coin_arr[3 * 8 * 8] = {
+static constexpr uint8_t coin_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  255,236,39,  255,236,39,  255,236,39,  209,106,58,  0,0,0,  0,0,0,
   0,0,0,  255,236,39,  209,106,58,  255,163,0,  255,163,0,  255,236,39,  209,106,58,  0,0,0,
   255,236,39,  209,106,58,  255,163,0,  255,236,39,  209,106,58,  255,163,0,  255,236,39,  209,106,58,
@@ -670,7 +671,7 @@ static const uint8_t coin_arr[3 * 8 * 8] = {
   0,0,0,  255,236,39,  209,106,58,  255,163,0,  255,163,0,  255,236,39,  209,106,58,  0,0,0,
   0,0,0,  0,0,0,  255,236,39,  255,236,39,  255,236,39,  209,106,58,  0,0,0,  0,0,0,
 };
-static const uint8_t cash_arr[3 * 8 * 8] = {
+static constexpr uint8_t cash_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,135,81,  0,135,81,  0,0,0,  0,0,0,  0,0,0,  0,0,0,
   0,0,0,  0,135,81,  0,228,54,  0,228,54,  0,135,81,  0,0,0,  0,0,0,  0,0,0,
   0,135,81,  0,228,54,  0,228,54,  0,135,81,  0,135,81,  0,135,81,  0,0,0,  0,0,0,
@@ -680,7 +681,7 @@ static const uint8_t cash_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,0,0,  0,135,81,  0,228,54,  0,228,54,  0,135,81,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,135,81,  0,135,81,  0,0,0,  0,0,0,
 };
-static const uint8_t gold_arr[3 * 8 * 8] = {
+static constexpr uint8_t gold_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  255,163,0,  209,106,58,  0,0,0,  0,0,0,  0,0,0,
@@ -690,7 +691,7 @@ static const uint8_t gold_arr[3 * 8 * 8] = {
   0,0,0,  209,106,58,  126,37,83,  255,163,0,  209,106,58,  126,37,83,  209,106,58,  0,0,0,
   0,0,0,  255,163,0,  209,106,58,  255,236,39,  255,163,0,  209,106,58,  255,163,0,  0,0,0,
 };
-static const uint8_t egg_arr[3 * 8 * 8] = {
+static constexpr uint8_t egg_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,0,0,  0,0,0,  255,241,232,  255,241,232,  255,241,232,  0,0,0,
   0,0,0,  255,241,232,  255,241,232,  255,241,232,  255,241,232,  255,241,232,  255,241,232,  255,204,170,
   255,241,232,  255,241,232,  255,236,39,  255,236,39,  255,241,232,  255,241,232,  255,241,232,  255,204,170,
@@ -700,7 +701,7 @@ static const uint8_t egg_arr[3 * 8 * 8] = {
   255,241,232,  255,241,232,  255,241,232,  255,241,232,  255,241,232,  255,241,232,  255,204,170,  0,0,0,
   0,0,0,  0,0,0,  255,204,170,  255,204,170,  255,204,170,  255,204,170,  0,0,0,  0,0,0,
 };
-static const uint8_t ice_cream_arr[3 * 8 * 8] = {
+static constexpr uint8_t ice_cream_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  255,241,232,  255,241,232,  255,241,232,  255,204,170,  0,0,0,  0,0,0,
   0,0,0,  255,241,232,  255,241,232,  255,241,232,  255,241,232,  255,241,232,  255,204,170,  0,0,0,
   0,0,0,  255,241,232,  255,241,232,  255,241,232,  255,241,232,  255,241,232,  255,204,170,  0,0,0,
@@ -710,7 +711,7 @@ static const uint8_t ice_cream_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,0,0,  209,106,58,  209,106,58,  0,0,0,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  255,163,0,  209,106,58,  0,0,0,  0,0,0,  0,0,0,
 };
-static const uint8_t cotton_candy_arr[3 * 8 * 8] = {
+static constexpr uint8_t cotton_candy_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  255,119,168,  255,119,168,  255,119,168,  208,90,161,  0,0,0,  0,0,0,
   0,0,0,  255,119,168,  255,119,168,  255,119,168,  255,119,168,  255,119,168,  208,90,161,  0,0,0,
   0,0,0,  255,119,168,  255,119,168,  255,119,168,  255,119,168,  255,119,168,  208,90,161,  0,0,0,
@@ -720,7 +721,7 @@ static const uint8_t cotton_candy_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,0,0,  194,195,199,  194,195,199,  0,0,0,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  0,0,0,  255,241,232,  0,0,0,  0,0,0,  0,0,0,
 };
-static const uint8_t steak_arr[3 * 8 * 8] = {
+static constexpr uint8_t steak_arr[3 * 8 * 8] = {
   0,0,0,  255,241,232,  255,241,232,  255,241,232,  255,241,232,  255,241,232,  0,0,0,  0,0,0,
   255,241,232,  255,119,168,  255,0,77,  255,0,77,  255,0,77,  255,119,168,  255,241,232,  0,0,0,
   255,241,232,  255,0,77,  255,0,77,  255,0,77,  255,0,77,  255,0,77,  255,119,168,  255,204,170,
@@ -730,7 +731,7 @@ static const uint8_t steak_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  255,204,170,  255,119,168,  255,0,77,  255,0,77,  255,119,168,  255,204,170,
   0,0,0,  0,0,0,  0,0,0,  255,204,170,  255,204,170,  255,204,170,  255,204,170,  0,0,0,
 };
-static const uint8_t corn_arr[3 * 8 * 8] = {
+static constexpr uint8_t corn_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  255,236,39,  0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,
   0,0,0,  255,236,39,  255,163,0,  255,236,39,  0,0,0,  0,0,0,  0,0,0,  0,0,0,
   0,0,0,  255,163,0,  255,236,39,  255,163,0,  255,163,0,  0,228,54,  0,228,54,  0,0,0,
@@ -740,7 +741,7 @@ static const uint8_t corn_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,135,81,  0,228,54,  0,135,81,  0,135,81,  0,135,81,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,135,81,  0,135,81,  0,0,0,
 };
-static const uint8_t apple_arr[3 * 8 * 8] = {
+static constexpr uint8_t apple_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,0,0,  209,106,58,  0,228,54,  0,228,54,  0,0,0,  0,0,0,
   0,0,0,  255,0,77,  255,0,77,  209,106,58,  0,228,54,  255,0,77,  162,50,109,  0,0,0,
   255,0,77,  255,241,232,  255,119,168,  162,50,109,  255,0,77,  255,0,77,  255,0,77,  162,50,109,
@@ -750,7 +751,7 @@ static const uint8_t apple_arr[3 * 8 * 8] = {
   0,0,0,  255,0,77,  255,0,77,  162,50,109,  255,0,77,  255,0,77,  162,50,109,  0,0,0,
   0,0,0,  0,0,0,  162,50,109,  162,50,109,  162,50,109,  162,50,109,  0,0,0,  0,0,0,
 };
-static const uint8_t carrot_arr[3 * 8 * 8] = {
+static constexpr uint8_t carrot_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,0,0,  0,228,54,  0,228,54,  0,0,0,  0,228,54,  0,228,54,
   0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,228,54,  0,135,81,  0,228,54,  0,135,81,
   0,0,0,  0,0,0,  0,0,0,  255,163,0,  255,163,0,  209,106,58,  0,135,81,  0,0,0,
@@ -760,7 +761,7 @@ static const uint8_t carrot_arr[3 * 8 * 8] = {
   0,0,0,  255,163,0,  209,106,58,  209,106,58,  0,0,0,  0,0,0,  0,0,0,  0,0,0,
   255,163,0,  209,106,58,  0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,
 };
-static const uint8_t banana_arr[3 * 8 * 8] = {
+static constexpr uint8_t banana_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,0,0,  0,0,0,  209,106,58,  126,37,83,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,  209,106,58,  126,37,83,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,  255,236,39,  255,163,0,  0,0,0,
@@ -770,7 +771,7 @@ static const uint8_t banana_arr[3 * 8 * 8] = {
   255,163,0,  255,236,39,  255,236,39,  255,236,39,  255,236,39,  255,163,0,  255,163,0,  0,0,0,
   0,0,0,  255,163,0,  255,163,0,  255,163,0,  255,163,0,  255,163,0,  0,0,0,  0,0,0,
 };
-static const uint8_t sword_arr[3 * 8 * 8] = {
+static constexpr uint8_t sword_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,  194,195,199,  255,241,232,
   0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,  194,195,199,  255,241,232,  131,118,156,
   0,0,0,  0,0,0,  0,0,0,  0,0,0,  194,195,199,  255,241,232,  131,118,156,  0,0,0,
@@ -780,7 +781,7 @@ static const uint8_t sword_arr[3 * 8 * 8] = {
   171,82,54,  171,82,54,  126,37,83,  255,163,0,  255,163,0,  0,0,0,  0,0,0,  0,0,0,
   126,37,83,  126,37,83,  0,0,0,  0,0,0,  255,163,0,  0,0,0,  0,0,0,  0,0,0,
 };
-static const uint8_t boomerang_arr[3 * 8 * 8] = {
+static constexpr uint8_t boomerang_arr[3 * 8 * 8] = {
   0,0,0,  255,236,39,  171,82,54,  171,82,54,  255,236,39,  171,82,54,  171,82,54,  0,0,0,
   255,236,39,  255,236,39,  255,236,39,  171,82,54,  255,163,0,  171,82,54,  171,82,54,  171,82,54,
   171,82,54,  255,236,39,  255,163,0,  255,163,0,  126,37,83,  126,37,83,  126,37,83,  126,37,83,
@@ -790,7 +791,7 @@ static const uint8_t boomerang_arr[3 * 8 * 8] = {
   171,82,54,  171,82,54,  126,37,83,  0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,
   0,0,0,  171,82,54,  126,37,83,  0,0,0,  0,0,0,  0,0,0,  0,0,0,  0,0,0,
 };
-static const uint8_t bow_arr[3 * 8 * 8] = {
+static constexpr uint8_t bow_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,0,0,  171,82,54,  171,82,54,  171,82,54,  171,82,54,  0,0,0,
   0,0,0,  0,0,0,  171,82,54,  126,37,83,  0,0,0,  194,195,199,  0,0,0,  0,0,0,
   0,0,0,  171,82,54,  126,37,83,  0,0,0,  0,0,0,  255,241,232,  0,0,0,  0,0,0,
@@ -800,7 +801,7 @@ static const uint8_t bow_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  171,82,54,  126,37,83,  0,0,0,  255,241,232,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  171,82,54,  171,82,54,  171,82,54,  171,82,54,  0,0,0,
 };
-static const uint8_t axe_arr[3 * 8 * 8] = {
+static constexpr uint8_t axe_arr[3 * 8 * 8] = {
   255,241,232,  194,195,199,  194,195,199,  0,0,0,  171,82,54,  0,0,0,  0,0,0,  0,0,0,
   255,241,232,  194,195,199,  194,195,199,  194,195,199,  255,163,0,  126,37,83,  0,0,0,  255,241,232,
   255,241,232,  194,195,199,  194,195,199,  194,195,199,  255,163,0,  209,106,58,  194,195,199,  255,241,232,
@@ -810,7 +811,7 @@ static const uint8_t axe_arr[3 * 8 * 8] = {
   0,0,0,  0,0,0,  0,0,0,  0,0,0,  171,82,54,  126,37,83,  0,0,0,  0,0,0,
   0,0,0,  0,0,0,  0,0,0,  0,0,0,  171,82,54,  126,37,83,  0,0,0,  0,0,0,
 };
-static const uint8_t* sprite_buffers[24] = {
+static constexpr const uint8_t* sprite_buffers[24] = {
   blue_potion_arr,
   green_potion_arr,
   orange_potion_arr,
@@ -836,6 +837,11 @@ static const uint8_t* sprite_buffers[24] = {
   bow_arr,
   axe_arr,
 };
+//The same sprites palette indexed, 28-48 bytes each instead of 192. Only
+//these end up in the binary, sprite_buffers is for the compiler
+#define ITEM_SPRITE_COUNT 24
+static_assert(spritePoolMaxColors(sprite_buffers, ITEM_SPRITE_COUNT, 64) <= 16, "Item sprites need at most 16 colors");
+static constexpr IndexedSpritePool<ITEM_SPRITE_COUNT, spritePoolBytes(sprite_buffers, ITEM_SPRITE_COUNT, 64)> ITEM_SPRITES(sprite_buffers, 64);
 static int sprite_buffer_idx = 0;
 struct rgb_pixel {
     uint8_t r;
@@ -847,6 +853,7 @@ struct rgb_pixel {
 class Animation {
 private:
     const uint8_t* sprite_data;
+    SpriteView sprite_view;         //What draw_rgb draws
     uint16_t buffer_size;
     uint8_t data_span;
     bool rgb_data;
@@ -876,6 +883,7 @@ public:
 };
 Animation::Animation(const uint8_t* data, uint16_t size, uint8_t span, bool rgb_data_ = false) {
     sprite_data = data;
+    sprite_view = spriteView(data, 8, 8);
     buffer_size = size;
     data_span = span;
     init = false;
@@ -883,6 +891,7 @@ Animation::Animation(const uint8_t* data, uint16_t size, uint8_t span, bool rgb_
 }
 void Animation::setAnimation(const uint8_t* data, uint16_t size, uint8_t span, bool rgb_data_ = false) {
     sprite_data = data;
+    sprite_view = spriteView(data, 8, 8);
     buffer_size = size;
     data_span = span;
     init = false;
@@ -907,8 +916,13 @@ void Animation::update() {
     if (!init)
         return;
 
-    if (delay_cnt++ % delay_cycles != 0)
+    //Counts down to the next step rather than taking a modulo every call
+    if (delay_cnt > 0)
+    {
+        delay_cnt--;
         return;
+    }
+    delay_cnt = delay_cycles - 1;
 
     uint16_t prev_frame = current_frame;
     //current_frame += span;
@@ -939,20 +953,21 @@ void Animation::draw(doubleBuffer* frame_buffer, int x, uint8_t r, uint8_t g, ui
         return;
     if (sprite_data == NULL)
         return;
-    if (current_frame + 6 > buffer_size)
+    //Frames are 6 column masks, one per layer from the top. Bounds are settled
+    //here once, the loop only stores
+    uint16_t base = current_frame * data_span;
+    if (base >= buffer_size || x < 0 || x >= LENGTH)
         return;
-
-    for (int k = 0; k < 6; k++)
+    int columns = buffer_size - base < 6 ? buffer_size - base : 6;
+    frameBuffer* fb = frame_buffer->getWriteBuffer();
+    fb_pixel_t color = fb->packPixel(r, g, b);
+    for (int k = 0; k < columns; k++)
     {
-        uint16_t current = current_frame * data_span + k;
-        for (int j = 0; j < 8; j++)
+        uint8_t column = sprite_data[base + k];
+        for (int j = 0; column != 0; j++, column >>= 1)
         {
-            if (current >= buffer_size)
-                return;
-            if (sprite_data[current] & (1 << j))
-            {
-                frame_buffer->setColors(x, j, 5 - k, r, g, b);
-            }
+            if (column & 1)
+                fb->setPixelPacked(x, j, 5 - k, color);
         }
     }
 }
@@ -962,25 +977,8 @@ void Animation::draw_rgb(doubleBuffer* frame_buffer, int x) {
     if (sprite_data == NULL)
         return;
 
-    static const int SPRITE_WIDTH = 8;
-    static const int SPRITE_HEIGHT = 8;
-    struct rgb_pixel* sprite_array = (struct rgb_pixel*)sprite_data;
-    /*
-    for (int i=x; i<SPRITE_WIDTH; i++) {
-      for (int j=0; j<SPRITE_HEIGHT; j++) {
-        struct rgb_pixel px = sprite_array[i*SPRITE_WIDTH + j];
-        int j_idx = WIDTH - 1 - j;
-        frame_buffer->setColors(i, j_idx, 0, px.r, px.g, px.b);
-      }
-    }
-    */
-    for (int j = 0; j < SPRITE_HEIGHT; j++) {
-        int j_idx = WIDTH - 1 - j;
-        for (int i = x; i < x + SPRITE_WIDTH; i++) {
-            struct rgb_pixel px = sprite_array[j * SPRITE_HEIGHT + (i - x)];
-            frame_buffer->setColors(i, j_idx, 0, px.r, px.g, px.b);
-        }
-    }
+    //Black is empty in the sprite art, keep what is underneath
+    blitSprite(frame_buffer, sprite_view, x, WIDTH - 1, SPRITE_FACE_RADIAL, 0, SPRITE_KEYED);
 }
 
 class SpaceGame
@@ -994,11 +992,18 @@ private:
     bool pause;
     Animation face_animation;
     Animation banana;
-    Animation sprites;
+    SpriteView item_frames[ITEM_SPRITE_COUNT];
+    SpriteClip item_clip;
+    SpriteClip atlas_clip;
+    SpriteInstances<1> sprites;     //The cycling item sprite
+    int item_sprite;
 
     static constexpr int block_color[3] = { 70, 100, 70 };
     static const uint8_t delay_cnt = 10;
     static const uint8_t MAX_HITS = 5;
+    //No clock in here, so sprite clips advance a nominal DRAW_MS per draw
+    static const uint16_t DRAW_MS = 10;
+    static const uint16_t ITEM_MS = 3500;
 
 public:
     SpaceGame();
@@ -1006,8 +1011,12 @@ public:
     void update();
     void draw(doubleBuffer* frame_buffer);
 };
-SpaceGame::SpaceGame() : face_animation(RAW_SPRITE, 18 * 6, 6), banana(BANANA_SPRITE, 64 * 3, 64 * 3, true), sprites(sprite_buffers[0], 64 * 3, 64 * 3, true)
+SpaceGame::SpaceGame() : face_animation(RAW_SPRITE, 18 * 6, 6), banana(BANANA_SPRITE, 64 * 3, 64 * 3, true), item_sprite(-1)
 {
+    for (int i = 0; i < ITEM_SPRITE_COUNT; i++)
+        item_frames[i] = ITEM_SPRITES.view(i, 8, 8);
+    item_clip = spriteClip(item_frames, ITEM_SPRITE_COUNT, ITEM_MS);
+    atlas_clip = spriteClip(NULL, 0, ITEM_MS);
     reset();
 }
 void SpaceGame::reset()
@@ -1023,10 +1032,13 @@ void SpaceGame::reset()
 
     face_animation.startAnimation(13, 5, 3, 10);
     banana.startAnimation(0, 1, 1);
-    sprites.startAnimation(0, 1, 1);
+    if (item_sprite < 0)
+        item_sprite = sprites.spawn(&item_clip, 65);
 }
 void SpaceGame::update()
 {
+    PROFILE_ZONE("SpaceGame::update");
+    SCENE_BUDGET("SpaceGame", 3);
     if (cnt++ % delay_cnt != 0)
     {
         return;
@@ -1069,16 +1081,30 @@ void SpaceGame::update()
 }
 void SpaceGame::draw(doubleBuffer* frame_buffer)
 {
+    PROFILE_ZONE("SpaceGame::draw");
+    SCENE_BUDGET("SpaceGame", 3);
     static int cnt = 0;
     int idx = (cnt / 100) % NUM_FACES;
     cnt++;
 
-    face_animation.draw(frame_buffer, 10, 255, 128, 0);
-    banana.draw_rgb(frame_buffer, 0);
+    //Decorative sprites go first when over budget: quality 1 drops the
+    //cycling sprite, 0 also the banana and face animation
+    uint8_t quality = scene_cost.quality();
+    if (quality >= 1)
+    {
+        face_animation.draw(frame_buffer, 10, 255, 128, 0);
+        banana.draw_rgb(frame_buffer, 0);
+    }
 
-    sprites.setAnimation(sprite_buffers[(cnt / 350) % 24], 64 * 3, 64 * 3, true);
-    sprites.startAnimation(0, 1, 1);
-    sprites.draw_rgb(frame_buffer, 65);
+    //Frames loaded from an atlas replace the item clip when they show up
+    if (sprite_frames != atlas_clip.frames)
+    {
+        atlas_clip = spriteClip(sprite_frames, (uint8_t)(sprite_frame_count < 255 ? sprite_frame_count : 255), ITEM_MS);
+        sprites.play(item_sprite, sprite_frames != NULL ? &atlas_clip : &item_clip);
+    }
+    sprites.update(DRAW_MS);
+    if (quality >= 2)
+        sprites.draw(frame_buffer, item_sprite);
 
     for (int k = 0; k < 6; k++)
     {
@@ -0,0 +1,440 @@
+#ifndef SPRITE_LIB
+#define SPRITE_LIB
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pov_display/FrameBuffer.h>
+
+//Sprite frames as views into memory someone else owns: the compiled in arrays
+//in Space_Game.h or a mapped sprite atlas (SpriteAtlas.h in the simulator).
+//Pixels are row major with row 0 at the top, the BANANA_SPRITE layout, and
+//black is what the games treat as empty.
+//Indexed formats pack 2 or 4 bit palette indices, first pixel in the low
+//bits, with a palette of up to 4 or 16 RGB888 entries per sprite. Entry 0 is
+//always black. RGBA8888 sprites are blended over what is already drawn.
+enum SPRITE_FORMAT { SPRITE_RGB888, SPRITE_INDEXED2, SPRITE_INDEXED4, SPRITE_RGBA8888 };
+
+struct SpriteView
+{
+    const uint8_t* pixels;
+    const uint8_t* palette; //Indexed formats only
+    uint16_t size;          //Bytes at pixels
+    uint8_t width;
+    uint8_t height;
+    uint8_t format;         //SPRITE_FORMAT
+    uint8_t palette_size;
+};
+
+inline SpriteView spriteView(const uint8_t* rgb, uint8_t width, uint8_t height)
+{
+    SpriteView view;
+    view.pixels = rgb;
+    view.palette = NULL;
+    view.palette_size = 0;
+    view.size = (uint16_t)(width * height * 3);
+    view.width = width;
+    view.height = height;
+    view.format = SPRITE_RGB888;
+    return view;
+}
+
+inline SpriteView spriteViewRGBA(const uint8_t* rgba, uint8_t width, uint8_t height)
+{
+    SpriteView view = spriteView(rgba, width, height);
+    view.size = (uint16_t)(width * height * 4);
+    view.format = SPRITE_RGBA8888;
+    return view;
+}
+
+inline int spriteIndexBits(uint8_t format)
+{
+    return format == SPRITE_INDEXED2 ? 2 : format == SPRITE_INDEXED4 ? 4 : 0;
+}
+
+
+//Compile time packing of RGB888 sprites into one pool of palette indexed
+//ones, 2 bit where a sprite has at most 4 colors and 4 bit up to 16. Used
+//like PROP_FONT: the RGB arrays only exist for the compiler.
+constexpr int spriteColorCount(const uint8_t* rgb, int pixels)
+{
+    int colors = 1;                     //Black, whether it's used or not
+    for (int p = 0; p < pixels; p++)
+    {
+        const uint8_t* px = rgb + p * 3;
+        bool seen = (px[0] | px[1] | px[2]) == 0;
+        for (int q = 0; q < p && !seen; q++)
+            seen = px[0] == rgb[q * 3] && px[1] == rgb[q * 3 + 1] && px[2] == rgb[q * 3 + 2];
+        if (!seen)
+            colors++;
+    }
+    return colors;
+}
+constexpr int spritePackBits(int colors)
+{
+    return colors <= 4 ? 2 : 4;
+}
+constexpr int spritePackedBytes(const uint8_t* rgb, int pixels)
+{
+    return spriteColorCount(rgb, pixels) * 3 + (pixels * spritePackBits(spriteColorCount(rgb, pixels)) + 7) / 8;
+}
+constexpr int spritePoolBytes(const uint8_t* const* sources, int count, int pixels)
+{
+    int total = 0;
+    for (int i = 0; i < count; i++)
+        total += spritePackedBytes(sources[i], pixels);
+    return total;
+}
+constexpr int spritePoolMaxColors(const uint8_t* const* sources, int count, int pixels)
+{
+    int most = 0;
+    for (int i = 0; i < count; i++)
+        most = spriteColorCount(sources[i], pixels) > most ? spriteColorCount(sources[i], pixels) : most;
+    return most;
+}
+
+//Each sprite is its palette followed by its packed indices
+template <int COUNT, int BYTES>
+struct IndexedSpritePool
+{
+    uint8_t data[BYTES];
+    uint16_t offset[COUNT];
+    uint8_t colors[COUNT];
+    uint8_t bits[COUNT];
+
+    constexpr IndexedSpritePool(const uint8_t* const* sources, int pixels) : data(), offset(), colors(), bits()
+    {
+        int next = 0;
+        for (int i = 0; i < COUNT; i++)
+        {
+            const uint8_t* rgb = sources[i];
+            uint8_t* palette = data + next;
+            int n = 1;
+            offset[i] = (uint16_t)next;
+            bits[i] = (uint8_t)spritePackBits(spriteColorCount(rgb, pixels));
+            uint8_t* packed = palette + spriteColorCount(rgb, pixels) * 3;
+            for (int p = 0; p < pixels; p++)
+            {
+                const uint8_t* px = rgb + p * 3;
+                int idx = 0;
+                while (idx < n && !(palette[idx * 3] == px[0] && palette[idx * 3 + 1] == px[1] && palette[idx * 3 + 2] == px[2]))
+                    idx++;
+                if (idx == n)
+                {
+                    palette[n * 3] = px[0];
+                    palette[n * 3 + 1] = px[1];
+                    palette[n * 3 + 2] = px[2];
+                    n++;
+                }
+                int bit = p * bits[i];
+                packed[bit / 8] |= (uint8_t)(idx << (bit % 8));
+            }
+            colors[i] = (uint8_t)n;
+            next += spritePackedBytes(rgb, pixels);
+        }
+    }
+
+    SpriteView view(int i, uint8_t width, uint8_t height) const
+    {
+        SpriteView v;
+        v.palette = data + offset[i];
+        v.palette_size = colors[i];
+        v.pixels = v.palette + colors[i] * 3;
+        v.size = (uint16_t)((width * height * bits[i] + 7) / 8);
+        v.width = width;
+        v.height = height;
+        v.format = bits[i] == 2 ? SPRITE_INDEXED2 : SPRITE_INDEXED4;
+        return v;
+    }
+};
+
+
+//Blitting. A sprite lies on a face of the drum: SPRITE_FACE_RADIAL is the
+//writeString plane (rows along WIDTH, on a HEIGHT layer), SPRITE_FACE_UPRIGHT
+//stands along HEIGHT at one radial row. Clipping is worked out once per blit
+//as a row range and at most two column runs (two when a wrapped sprite crosses
+//slice LENGTH - 1 -> 0). Each source row is then decoded once into storage
+//format pixels and written out along the runs.
+#define SPRITE_MAX_WIDTH 128
+
+enum SPRITE_FACE { SPRITE_FACE_RADIAL, SPRITE_FACE_UPRIGHT };
+enum SPRITE_BLIT_FLAGS
+{
+    SPRITE_FLIP_X = 0x01,
+    SPRITE_FLIP_Y = 0x02,
+    SPRITE_KEYED = 0x04,    //Black (palette entry 0) is transparent, RGBA8888 uses its alpha either way
+    SPRITE_WRAP = 0x08      //Wrap around the drum instead of clipping at 0 and LENGTH
+};
+
+//Row y of the face gets the sprite's top row, the rows below go to y - 1,
+//y - 2... The defaults are how Animation::draw_rgb always drew: top row on the
+//outermost radial row of layer 0, every pixel opaque
+void blitSprite(doubleBuffer* frame_buffer, const SpriteView& view, int x, int y = WIDTH - 1,
+    uint8_t face = SPRITE_FACE_RADIAL, int plane = 0, uint8_t flags = 0)
+{
+    bool radial = face == SPRITE_FACE_RADIAL;
+    int face_rows = radial ? WIDTH : HEIGHT;
+    int planes = radial ? HEIGHT : WIDTH;
+    if (view.pixels == NULL || plane < 0 || plane >= planes || view.width > SPRITE_MAX_WIDTH)
+        return;
+
+    //Sprite rows j in [j0, j1) land inside the face
+    int j0 = y - (face_rows - 1) > 0 ? y - (face_rows - 1) : 0;
+    int j1 = y + 1 < view.height ? y + 1 : view.height;
+    //Column runs: sprite columns [run_i, run_i + run_n) go to slices from run_l
+    int run_i[2], run_n[2], run_l[2];
+    int runs = 0;
+    if (flags & SPRITE_WRAP)
+    {
+        int w = view.width < LENGTH ? view.width : LENGTH;
+        int l0 = ((x % LENGTH) + LENGTH) % LENGTH;
+        int n0 = LENGTH - l0 < w ? LENGTH - l0 : w;
+        run_i[0] = 0, run_n[0] = n0, run_l[0] = l0;
+        runs = 1;
+        if (n0 < w)
+        {
+            run_i[1] = n0, run_n[1] = w - n0, run_l[1] = 0;
+            runs = 2;
+        }
+    }
+    else
+    {
+        int i0 = x < 0 ? -x : 0;
+        int i1 = LENGTH - x < view.width ? LENGTH - x : view.width;
+        if (i0 < i1)
+        {
+            run_i[0] = i0, run_n[0] = i1 - i0, run_l[0] = x + i0;
+            runs = 1;
+        }
+    }
+    if (runs == 0 || j0 >= j1)
+        return;
+
+    frameBuffer* fb = frame_buffer->getWriteBuffer();
+    int bits = spriteIndexBits(view.format);
+    fb_pixel_t lut[16];
+    if (bits > 0)
+    {
+        int entries = 1 << bits;
+        int colors = view.palette_size < entries ? view.palette_size : entries;
+        lut[0] = fb->packPixel(0, 0, 0);
+        for (int i = 1; i < entries; i++)
+            lut[i] = i < colors ? fb->packPixel(view.palette[i * 3], view.palette[i * 3 + 1], view.palette[i * 3 + 2]) : lut[0];
+    }
+
+    fb_pixel_t row[SPRITE_MAX_WIDTH];
+    uint8_t alpha[SPRITE_MAX_WIDTH];        //0 skip, 255 store, else blend
+    bool keyed = (flags & SPRITE_KEYED) != 0;
+    for (int j = j0; j < j1; j++)
+    {
+        int src_j = (flags & SPRITE_FLIP_Y) ? view.height - 1 - j : j;
+        int r = y - j;
+
+        //Decode the source row in source order
+        if (bits > 0)
+        {
+            uint32_t mask = (1u << bits) - 1;
+            int bit = src_j * view.width * bits;
+            const uint8_t* src = view.pixels + (bit >> 3);
+            uint32_t acc = *src++ >> (bit & 7);
+            int left = 8 - (bit & 7);
+            for (int i = 0; i < view.width; i++)
+            {
+                if (left == 0)
+                {
+                    acc = *src++;
+                    left = 8;
+                }
+                uint32_t idx = acc & mask;
+                row[i] = lut[idx];
+                alpha[i] = (keyed && idx == 0) ? 0 : 255;
+                acc >>= bits;
+                left -= bits;
+            }
+        }
+        else
+        {
+            int stride = view.format == SPRITE_RGBA8888 ? 4 : 3;
+            const uint8_t* px = view.pixels + src_j * view.width * stride;
+            for (int i = 0; i < view.width; i++, px += stride)
+            {
+                alpha[i] = stride == 4 ? px[3] : ((keyed && (px[0] | px[1] | px[2]) == 0) ? 0 : 255);
+                if (alpha[i] == 255)
+                    row[i] = fb->packPixel(px[0], px[1], px[2]);
+            }
+        }
+
+        for (int run = 0; run < runs; run++)
+        {
+            for (int k = 0; k < run_n[run]; k++)
+            {
+                int i = run_i[run] + k;
+                int src_i = (flags & SPRITE_FLIP_X) ? view.width - 1 - i : i;
+                int l = run_l[run] + k;
+                int w = radial ? r : plane;
+                int h = radial ? plane : r;
+                if (alpha[src_i] == 255)
+                {
+                    fb->setPixelPacked(l, w, h, row[src_i]);
+                }
+                else if (alpha[src_i] != 0)
+                {
+                    //Only RGBA8888 gets here
+                    const uint8_t* px = view.pixels + (src_j * view.width + src_i) * 4;
+                    uint8_t dst[NUM_COLORS];
+                    fb->getPixel(l, w, h, &dst[RED], &dst[GREEN], &dst[BLUE]);
+                    int a = px[3];
+                    fb->setPixelPacked(l, w, h, fb->packPixel(
+                        (uint8_t)((px[0] * a + dst[RED] * (255 - a) + 127) / 255),
+                        (uint8_t)((px[1] * a + dst[GREEN] * (255 - a) + 127) / 255),
+                        (uint8_t)((px[2] * a + dst[BLUE] * (255 - a) + 127) / 255)));
+                }
+            }
+        }
+    }
+}
+
+//Clips and instances. A SpriteClip is a read only run of frames with their
+//durations and is shared by every instance that plays it. The per instance
+//state (clip, frame, time into it, position) lives in parallel arrays so
+//updating a few hundred sprites is one pass over small fields, and switching
+//clips is a pointer store.
+enum SPRITE_LOOP { SPRITE_LOOP_FOREVER, SPRITE_LOOP_ONCE, SPRITE_LOOP_PINGPONG };
+
+struct SpriteClip
+{
+    const SpriteView* frames;
+    const uint16_t* durations;  //ms per frame, NULL for frame_ms each
+    uint16_t frame_ms;
+    uint8_t frame_count;
+    uint8_t loop;               //SPRITE_LOOP
+
+    uint16_t duration(int frame) const
+    {
+        uint16_t d = durations != NULL ? durations[frame] : frame_ms;
+        return d > 0 ? d : 1;
+    }
+};
+
+inline SpriteClip spriteClip(const SpriteView* frames, uint8_t frame_count, uint16_t frame_ms,
+    uint8_t loop = SPRITE_LOOP_FOREVER, const uint16_t* durations = NULL)
+{
+    SpriteClip clip;
+    clip.frames = frames;
+    clip.durations = durations;
+    clip.frame_ms = frame_ms > 0 ? frame_ms : 1;
+    clip.frame_count = frame_count;
+    clip.loop = loop;
+    return clip;
+}
+
+template <int CAPACITY>
+class SpriteInstances
+{
+private:
+    const SpriteClip* clip[CAPACITY];
+    uint16_t elapsed[CAPACITY];     //ms into the current frame
+    uint8_t frame[CAPACITY];
+    int8_t step[CAPACITY];          //+1/-1 while playing (pingpong runs backwards), 0 when stopped
+    int16_t pos_x[CAPACITY];
+    int8_t pos_y[CAPACITY];
+    uint8_t plane[CAPACITY];
+    uint8_t face[CAPACITY];
+    uint8_t flags[CAPACITY];
+    int count;
+
+public:
+    SpriteInstances() : count(0) {}
+
+    //Returns the instance id, -1 when full
+    int spawn(const SpriteClip* clip_, int x, int y = WIDTH - 1, uint8_t face_ = SPRITE_FACE_RADIAL,
+        int plane_ = 0, uint8_t flags_ = SPRITE_KEYED)
+    {
+        if (count >= CAPACITY)
+            return -1;
+        int id = count++;
+        play(id, clip_);
+        move(id, x, y);
+        plane[id] = (uint8_t)plane_;
+        face[id] = face_;
+        flags[id] = flags_;
+        return id;
+    }
+    void clear() { count = 0; }
+    int size() const { return count; }
+
+    //Restarts id on clip_ from its first frame
+    void play(int id, const SpriteClip* clip_)
+    {
+        clip[id] = clip_;
+        frame[id] = 0;
+        elapsed[id] = 0;
+        step[id] = (clip_ != NULL && clip_->frame_count > 0) ? 1 : 0;
+    }
+    void move(int id, int x, int y)
+    {
+        pos_x[id] = (int16_t)x;
+        pos_y[id] = (int8_t)y;
+    }
+    void setFlags(int id, uint8_t flags_) { flags[id] = flags_; }
+    bool playing(int id) const { return step[id] != 0; }
+    int currentFrame(int id) const { return frame[id]; }
+
+    //Advances every instance by dt_ms. Long steps run through as many frames
+    //as they cover, so the result doesn't depend on how time was sliced
+    void update(uint16_t dt_ms)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            if (step[i] == 0)
+                continue;
+            const SpriteClip* c = clip[i];
+            uint32_t t = elapsed[i] + (uint32_t)dt_ms;
+            int f = frame[i];
+            int s = step[i];
+            uint16_t d = c->duration(f);
+            while (t >= d && s != 0)
+            {
+                t -= d;
+                f += s;
+                if (f < 0 || f >= c->frame_count)
+                {
+                    if (c->loop == SPRITE_LOOP_FOREVER)
+                        f = 0;
+                    else if (c->loop == SPRITE_LOOP_PINGPONG && c->frame_count > 1)
+                        s = -s, f += 2 * s;
+                    else
+                        f -= s, s = 0, t = 0;
+                }
+                d = c->duration(f);
+            }
+            elapsed[i] = (uint16_t)t;
+            frame[i] = (uint8_t)f;
+            step[i] = (int8_t)s;
+        }
+    }
+
+    void draw(doubleBuffer* frame_buffer, int id) const
+    {
+        if (clip[id] == NULL || clip[id]->frame_count == 0)
+            return;
+        blitSprite(frame_buffer, clip[id]->frames[frame[id]], pos_x[id], pos_y[id], face[id], plane[id], flags[id]);
+    }
+    void draw(doubleBuffer* frame_buffer) const
+    {
+        for (int i = 0; i < count; i++)
+            draw(frame_buffer, i);
+    }
+};
+
+//Frames that replace the compiled in item sprites, e.g. from a loaded atlas.
+//NULL means the built in ITEM_SPRITES are used
+static const SpriteView* sprite_frames = NULL;
+static int sprite_frame_count = 0;
+
+inline void setSpriteFrames(const SpriteView* frames, int count)
+{
+    sprite_frames = count > 0 ? frames : NULL;
+    sprite_frame_count = count > 0 ? count : 0;
+}
+
+#endif
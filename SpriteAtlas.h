@@ -0,0 +1,458 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+//main.cpp includes it with STB_IMAGE_IMPLEMENTATION, the implementation part
+//has no include guard of its own
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image.h"
+#endif
+#include "FrameCodec.h"
+#include <pov_display/Sprite.h>
+
+// Sprite atlas files, so new art is a data change instead of a rebuild. The
+// simulator maps the file at startup and hands out SpriteView frames: raw RGB
+// frames point straight into the mapping, RLE or palette indexed frames are
+// expanded once into one buffer on open. Atlases are built from PNG sprite
+// sheets with --sprite-atlas out.povs cell_w cell_h sheet.png [sheet.png...],
+// cut into cell_w x cell_h frames left to right, top to bottom. Transparent
+// pixels become black, which the games already treat as empty; cells with
+// partly transparent pixels keep their alpha as RGBA8888 frames.
+//
+// File layout (little endian):
+//   AtlasFileHeader
+//   frame table: AtlasFrameEntry per frame
+//   palette:     palette_count RGB888 entries
+//   pixel data:  frames back to back, entry offsets are relative to data_offset
+
+#define ATLAS_MAGIC 0x53564F50          //"POVS"
+#define ATLAS_VERSION 1
+#define ATLAS_NAME_LENGTH 16
+#define ATLAS_MAX_PALETTE 256
+
+enum ATLAS_PIXELS { ATLAS_PIXELS_RGB888 = 0, ATLAS_PIXELS_INDEXED8 = 1, ATLAS_PIXELS_RGBA8888 = 2 };
+enum ATLAS_ENCODING { ATLAS_RAW = 0, ATLAS_RLE = 1 };   //RLE is rleEncode from FrameCodec.h
+
+struct AtlasFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t frame_count;
+	uint32_t palette_count;
+	uint32_t frame_table_offset;
+	uint32_t palette_offset;
+	uint32_t data_offset;
+	uint32_t data_size;
+};
+struct AtlasFrameEntry {
+	char name[ATLAS_NAME_LENGTH];           //NUL terminated, "<sheet>_<cell>"
+	uint8_t width;
+	uint8_t height;
+	uint8_t pixels;                         //ATLAS_PIXELS
+	uint8_t encoding;                       //ATLAS_ENCODING
+	uint32_t offset;
+	uint32_t size;                          //Stored bytes
+};
+
+class SpriteAtlas {
+	public:
+		SpriteAtlas();
+		~SpriteAtlas() { close(); }
+
+		bool open(const char* path);
+		void close();
+
+		int frameCount() { return (int)views.size(); }
+		const SpriteView* frames() { return views.empty() ? NULL : &views[0]; }
+		const SpriteView& frame(int i) { return views[i]; }
+		int find(const char* name);     //Frame index, -1 if missing
+
+	private:
+		uint8_t* base;
+		size_t size;
+		const AtlasFrameEntry* entries;
+		std::vector<SpriteView> views;
+		std::vector<uint8_t> decoded;   //Expanded RLE and indexed frames
+
+		bool expand(const AtlasFrameEntry& e, const uint8_t* palette, uint32_t palette_count, uint8_t* out);
+		static bool zeroCopy(const AtlasFrameEntry& e) { return e.encoding == ATLAS_RAW && e.pixels != ATLAS_PIXELS_INDEXED8; }
+		static int viewBytes(const AtlasFrameEntry& e) { return e.width * e.height * (e.pixels == ATLAS_PIXELS_RGBA8888 ? 4 : 3); }
+};
+
+SpriteAtlas::SpriteAtlas()
+{
+	base = NULL;
+	size = 0;
+	entries = NULL;
+}
+bool SpriteAtlas::open(const char* path)
+{
+	close();
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		printf("Error::ATLAS::Can't open %s\n", path);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		printf("Error::ATLAS::Can't stat %s\n", path);
+		::close(fd);
+		return false;
+	}
+	size = st.st_size;
+	if (size < sizeof(AtlasFileHeader))
+	{
+		printf("Error::ATLAS::%s is too small\n", path);
+		::close(fd);
+		return false;
+	}
+	void* mem = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mem == MAP_FAILED)
+	{
+		printf("Error::ATLAS::mmap failed\n");
+		return false;
+	}
+	base = (uint8_t*)mem;
+
+	AtlasFileHeader header;
+	memcpy(&header, base, sizeof(header));
+	if (header.magic != ATLAS_MAGIC || header.version != ATLAS_VERSION ||
+		(uint64_t)header.frame_table_offset + (uint64_t)header.frame_count * sizeof(AtlasFrameEntry) > size ||
+		(uint64_t)header.palette_offset + (uint64_t)header.palette_count * 3 > size ||
+		(uint64_t)header.data_offset + header.data_size > size || header.palette_count > ATLAS_MAX_PALETTE)
+	{
+		printf("Error::ATLAS::%s isn't a sprite atlas\n", path);
+		close();
+		return false;
+	}
+	entries = (const AtlasFrameEntry*)(base + header.frame_table_offset);
+	const uint8_t* palette = base + header.palette_offset;
+	const uint8_t* data = base + header.data_offset;
+
+	//Size the expansion buffer first, views point into it
+	size_t expanded = 0;
+	for (uint32_t i = 0; i < header.frame_count; i++)
+	{
+		const AtlasFrameEntry& e = entries[i];
+		if ((uint64_t)e.offset + e.size > header.data_size || e.width == 0 || e.height == 0 || viewBytes(e) > 0xFFFF ||
+			e.pixels > ATLAS_PIXELS_RGBA8888 || e.encoding > ATLAS_RLE)
+		{
+			printf("Error::ATLAS::Frame %u of %s is corrupt\n", i, path);
+			close();
+			return false;
+		}
+		if (!zeroCopy(e))
+			expanded += viewBytes(e);
+	}
+	decoded.assign(expanded, 0);
+
+	size_t next = 0;
+	views.resize(header.frame_count);
+	for (uint32_t i = 0; i < header.frame_count; i++)
+	{
+		const AtlasFrameEntry& e = entries[i];
+		const uint8_t* pixels = data + e.offset;
+		if (!zeroCopy(e))
+		{
+			if (!expand(e, palette, header.palette_count, &decoded[next]))
+			{
+				printf("Error::ATLAS::Frame %u (%.*s) of %s is corrupt\n", i, ATLAS_NAME_LENGTH, e.name, path);
+				close();
+				return false;
+			}
+			pixels = &decoded[next];
+			next += viewBytes(e);
+		}
+		else if (e.size != (uint32_t)viewBytes(e))
+		{
+			printf("Error::ATLAS::Frame %u (%.*s) of %s has the wrong size\n", i, ATLAS_NAME_LENGTH, e.name, path);
+			close();
+			return false;
+		}
+		if (e.pixels == ATLAS_PIXELS_RGBA8888)
+			views[i] = spriteViewRGBA(pixels, e.width, e.height);
+		else
+			views[i] = spriteView(pixels, e.width, e.height);
+	}
+	printf("Atlas: %s, %u frames, %zu bytes mapped, %zu expanded\n", path, header.frame_count, size, expanded);
+	return true;
+}
+void SpriteAtlas::close()
+{
+	if (base != NULL)
+		munmap(base, size);
+	base = NULL;
+	entries = NULL;
+	views.clear();
+	decoded.clear();
+}
+bool SpriteAtlas::expand(const AtlasFrameEntry& e, const uint8_t* palette, uint32_t palette_count, uint8_t* out)
+{
+	const uint8_t* data = base + ((const AtlasFileHeader*)base)->data_offset + e.offset;
+	int count = e.width * e.height;
+	size_t raw_size = e.pixels == ATLAS_PIXELS_INDEXED8 ? count : viewBytes(e);
+
+	//RGB(A) RLE decodes in place, indices go through a temporary
+	std::vector<uint8_t> tmp;
+	const uint8_t* raw = data;
+	if (e.encoding == ATLAS_RLE)
+	{
+		uint8_t* dst = out;
+		if (e.pixels == ATLAS_PIXELS_INDEXED8)
+		{
+			tmp.resize(raw_size);
+			dst = &tmp[0];
+		}
+		if (!rleDecode(data, e.size, dst, raw_size))
+			return false;
+		raw = dst;
+	}
+	else if (e.encoding != ATLAS_RAW || e.size != raw_size)
+	{
+		return false;
+	}
+	if (e.pixels != ATLAS_PIXELS_INDEXED8)
+	{
+		if (raw != out)
+			memcpy(out, raw, raw_size);
+		return true;
+	}
+	for (int p = 0; p < count; p++)
+	{
+		if (raw[p] >= palette_count)
+			return false;
+		memcpy(out + p * 3, palette + raw[p] * 3, 3);
+	}
+	return true;
+}
+int SpriteAtlas::find(const char* name)
+{
+	for (size_t i = 0; i < views.size(); i++)
+	{
+		if (strncmp(entries[i].name, name, ATLAS_NAME_LENGTH) == 0)
+			return (int)i;
+	}
+	return -1;
+}
+
+
+//Converter. Frames use 8 bit indices into one shared palette while the
+//frames have at most ATLAS_MAX_PALETTE colors, RGB888 after that or RGBA8888
+//with partial alpha, and are RLE coded whenever that comes out smaller.
+//Frames are collected in memory and written out at the end
+class AtlasBuilder {
+	public:
+		//rgba is width x height RGBA, alpha < 128 counts as transparent. All
+		//black frames are dropped when skip_empty is set, false if dropped
+		bool addFrame(const char* name, const uint8_t* rgba, int width, int height, bool skip_empty);
+		bool write(const char* out_path);
+		int frameCount() { return (int)entries.size(); }
+		bool hasFrame(const char* name);
+
+	private:
+		std::vector<AtlasFrameEntry> entries;
+		std::vector<uint8_t> palette;
+		std::unordered_map<uint32_t, int> palette_index;
+		std::vector<uint8_t> data;
+		std::vector<uint8_t> rgb;
+		std::vector<uint8_t> indices;
+		std::vector<uint8_t> rle;
+};
+
+bool AtlasBuilder::addFrame(const char* name, const uint8_t* rgba, int width, int height, bool skip_empty)
+{
+	int pixels = width * height;
+	rgb.resize(pixels * 3);
+	indices.resize(pixels);
+	rle.resize(pixels * 4 + pixels * 4 / 128 + 16);
+
+	bool empty = true;
+	bool blended = false;
+	for (int p = 0; p < pixels; p++)
+	{
+		const uint8_t* px = rgba + p * 4;
+		uint8_t* out = &rgb[p * 3];
+		bool visible = px[3] >= 128;
+		out[0] = visible ? px[0] : 0;
+		out[1] = visible ? px[1] : 0;
+		out[2] = visible ? px[2] : 0;
+		if (px[3] > 0 && px[3] < 255)
+			blended = true;
+		if ((out[0] | out[1] | out[2]) || (px[3] > 0 && (px[0] | px[1] | px[2])))
+			empty = false;
+	}
+	if (empty && skip_empty)
+		return false;
+
+	bool indexed = !blended;
+	size_t palette_start = palette.size() / 3;
+	for (int p = 0; p < pixels && indexed; p++)
+	{
+		const uint8_t* out = &rgb[p * 3];
+		uint32_t key = (out[0] << 16) | (out[1] << 8) | out[2];
+		std::unordered_map<uint32_t, int>::iterator it = palette_index.find(key);
+		if (it == palette_index.end() && palette.size() / 3 < ATLAS_MAX_PALETTE)
+		{
+			it = palette_index.insert(std::make_pair(key, (int)(palette.size() / 3))).first;
+			palette.insert(palette.end(), out, out + 3);
+		}
+		if (it == palette_index.end())
+			indexed = false;
+		else
+			indices[p] = (uint8_t)it->second;
+	}
+	if (!indexed)
+	{
+		//Stored as RGB888 after all, give back the entries this frame took
+		for (size_t i = palette_start; i < palette.size() / 3; i++)
+			palette_index.erase((palette[i * 3] << 16) | (palette[i * 3 + 1] << 8) | palette[i * 3 + 2]);
+		palette.resize(palette_start * 3);
+	}
+
+	AtlasFrameEntry e;
+	memset(&e, 0, sizeof(e));
+	snprintf(e.name, ATLAS_NAME_LENGTH, "%s", name);
+	e.width = (uint8_t)width;
+	e.height = (uint8_t)height;
+	e.pixels = blended ? ATLAS_PIXELS_RGBA8888 : indexed ? ATLAS_PIXELS_INDEXED8 : ATLAS_PIXELS_RGB888;
+	const uint8_t* raw = blended ? rgba : indexed ? &indices[0] : &rgb[0];
+	size_t raw_size = blended ? pixels * 4 : indexed ? pixels : pixels * 3;
+	size_t rle_size = rleEncode(raw, raw_size, &rle[0]);
+	e.encoding = rle_size < raw_size ? ATLAS_RLE : ATLAS_RAW;
+	if (e.encoding == ATLAS_RLE)
+		raw = &rle[0];
+	e.offset = (uint32_t)data.size();
+	e.size = (uint32_t)(e.encoding == ATLAS_RLE ? rle_size : raw_size);
+	data.insert(data.end(), raw, raw + e.size);
+	entries.push_back(e);
+	return true;
+}
+bool AtlasBuilder::hasFrame(const char* name)
+{
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		if (strncmp(entries[i].name, name, ATLAS_NAME_LENGTH) == 0)
+			return true;
+	}
+	return false;
+}
+bool AtlasBuilder::write(const char* out_path)
+{
+	AtlasFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = ATLAS_MAGIC;
+	header.version = ATLAS_VERSION;
+	header.frame_count = (uint32_t)entries.size();
+	header.palette_count = (uint32_t)(palette.size() / 3);
+	header.frame_table_offset = sizeof(AtlasFileHeader);
+	header.palette_offset = header.frame_table_offset + header.frame_count * sizeof(AtlasFrameEntry);
+	header.data_offset = header.palette_offset + (uint32_t)palette.size();
+	header.data_size = (uint32_t)data.size();
+
+	FILE* f = fopen(out_path, "wb");
+	if (f == NULL)
+	{
+		printf("Error::ATLAS::Can't write %s\n", out_path);
+		return false;
+	}
+	fwrite(&header, sizeof(header), 1, f);
+	if (!entries.empty())
+		fwrite(&entries[0], sizeof(AtlasFrameEntry), entries.size(), f);
+	if (!palette.empty())
+		fwrite(&palette[0], 1, palette.size(), f);
+	if (!data.empty())
+		fwrite(&data[0], 1, data.size(), f);
+	fclose(f);
+	printf("Atlas: wrote %s, %u frames, %u colors, %u bytes of pixels\n", out_path,
+		header.frame_count, header.palette_count, header.data_size);
+	return true;
+}
+
+//Cuts sheets into cells, empty (all black) cells are skipped
+bool buildSpriteAtlas(const char* out_path, int cell_w, int cell_h, const char* const* sheets, int num_sheets)
+{
+	if (cell_w <= 0 || cell_h <= 0 || cell_w > 255 || cell_h > 255 || cell_w * cell_h * 4 > 0xFFFF)
+	{
+		printf("Error::ATLAS::Bad cell size %dx%d\n", cell_w, cell_h);
+		return false;
+	}
+	AtlasBuilder builder;
+	std::vector<uint8_t> rgba(cell_w * cell_h * 4);
+
+	stbi_set_flip_vertically_on_load(false);
+	for (int s = 0; s < num_sheets; s++)
+	{
+		int w, h, n;
+		uint8_t* img = stbi_load(sheets[s], &w, &h, &n, 4);
+		if (img == NULL)
+		{
+			printf("Error::ATLAS::Can't load %s: %s\n", sheets[s], stbi_failure_reason());
+			return false;
+		}
+		//Frame names start with the file name without directory and extension
+		std::string stem = sheets[s];
+		size_t slash = stem.find_last_of("/\\");
+		if (slash != std::string::npos)
+			stem = stem.substr(slash + 1);
+		size_t dot = stem.find_last_of('.');
+		if (dot != std::string::npos)
+			stem = stem.substr(0, dot);
+
+		int cols = w / cell_w, rows = h / cell_h;
+		for (int cell = 0; cell < cols * rows; cell++)
+		{
+			int x0 = (cell % cols) * cell_w, y0 = (cell / cols) * cell_h;
+			for (int y = 0; y < cell_h; y++)
+				memcpy(&rgba[y * cell_w * 4], img + ((y0 + y) * w + x0) * 4, cell_w * 4);
+			//find() goes by name, so a cut off or repeated one would alias another frame
+			char name[ATLAS_NAME_LENGTH];
+			if (snprintf(name, sizeof(name), "%s_%d", stem.c_str(), cell) >= (int)sizeof(name))
+			{
+				printf("Error::ATLAS::Frame name %s_%d is longer than %d characters, shorten %s\n",
+					stem.c_str(), cell, ATLAS_NAME_LENGTH - 1, sheets[s]);
+				stbi_image_free(img);
+				return false;
+			}
+			if (builder.hasFrame(name))
+			{
+				printf("Error::ATLAS::Frame name %s is used twice, sheets need distinct file names\n", name);
+				stbi_image_free(img);
+				return false;
+			}
+			builder.addFrame(name, &rgba[0], cell_w, cell_h, true);
+		}
+		stbi_image_free(img);
+	}
+	return builder.write(out_path);
+}
+
+//Parses --sprite-atlas out.povs cell_w cell_h sheet.png [sheet.png...], false if it isn't argv[1].
+//out_path is NULL after a usage error
+bool parseSpriteAtlasArgs(int argc, char** argv, const char*& out_path, int& cell_w, int& cell_h, const char* const*& sheets, int& num_sheets)
+{
+	if (argc < 2 || strcmp(argv[1], "--sprite-atlas") != 0)
+		return false;
+	if (argc < 6)
+	{
+		printf("Usage: --sprite-atlas out.povs cell_w cell_h sheet.png [sheet.png...]\n");
+		out_path = NULL;
+		return true;
+	}
+	out_path = argv[2];
+	cell_w = atoi(argv[3]);
+	cell_h = atoi(argv[4]);
+	sheets = argv + 5;
+	num_sheets = argc - 5;
+	return true;
+}
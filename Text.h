@@ -4,9 +4,11 @@
 //#include "FrameBuffer.h"
 #include <pov_display/FrameBuffer.h>
 #include <string.h>
+#include "Font.h"
 #define CHAR_WIDTH 8
 
 enum CHAR_TYPE { LETTER, NUMBER };
+enum FONT_ID { FONT_FIXED, FONT_PROPORTIONAL };    //CHAR_BUF/NUM_BUF, Font.h
 
 //TODO: CHAR_WIDTH doesn't need to be so big, biggest right now is 5
 const static uint8_t NUM_BUF[10][CHAR_WIDTH] = {
@@ -120,4 +122,356 @@ void writeString(const char* str, int offset, int layer, uint8_t r, uint8_t g, u
     }
 }
 
+//writeString with the proportional font, returns the columns the string covers
+int writePropString(const char* str, int offset, int layer, uint8_t r, uint8_t g, uint8_t b, doubleBuffer* frame_buffer)
+{
+    if (layer < 0 || layer >= HEIGHT)
+        return 0;
+
+    int pos = offset;
+    for (const char* p = str; *p; p++)
+    {
+        int w = fontWidth(*p);
+        if (pos >= LENGTH)
+            break;
+        if (pos + w > 0)
+        {
+            const uint8_t* cols = fontColumns(*p);
+            for (int i = (pos < 0 ? -pos : 0); i < w && pos + i < LENGTH; i++)
+            {
+                uint8_t column = cols[i];
+                for (int j = 0; column != 0; j++, column >>= 1)
+                {
+                    if (column & 1)
+                        frame_buffer->setColors(pos + i, j, layer, r, g, b);
+                }
+            }
+        }
+        pos += p[1] ? fontAdvance(p[0], p[1]) : w;
+    }
+    return measureString(str);
+}
+
+//Offset that centers str on the front of the drum
+inline int centerString(const char* str, int center = LENGTH / 2)
+{
+    return center - measureString(str) / 2;
+}
+
+
+//Text layout across the whole volume. Radial text is the writeString layout
+//(glyph rows along WIDTH, on a HEIGHT layer), upright text stands along HEIGHT
+//with the 6 row font at one radial row. Either can be extruded through depth
+//layers perpendicular to the glyph, up through HEIGHT for radial text and
+//outward through WIDTH for upright text, and moved per glyph by an effect.
+//Every column is shifted and clipped once as a bit mask, then written
+//straight to the write buffer for all its layers.
+enum TEXT_ORIENT { TEXT_RADIAL, TEXT_UPRIGHT };
+enum TEXT_EFFECT
+{
+    TEXT_FX_NONE,
+    TEXT_FX_WAVE,           //Glyphs ride a sine along the string, period in columns
+    TEXT_FX_BOUNCE,         //Glyphs hop in turn, period in phase steps per hop
+    TEXT_FX_DEPTH_WAVE      //Extrusion depth follows a triangle wave along the drum, period in columns
+};
+
+struct TextLayout
+{
+    uint8_t orient;         //TEXT_ORIENT
+    uint8_t r, g, b;
+    int8_t base;            //Radial: HEIGHT layer, upright: radial row of the front face
+    int8_t depth;           //Layers the glyphs are extruded through, at least 1
+    int8_t lift;            //Shift along the glyph's vertical, rows for radial, layers for upright
+    uint8_t effect;         //TEXT_EFFECT
+    uint8_t amplitude;      //Effect size in rows/layers
+    uint8_t period;
+    int phase;              //Effect step, usually the scene's tick counter
+    bool wrap;              //Wrap around the drum instead of clipping at 0 and LENGTH
+};
+
+//sin over one cycle in 16 steps, scaled to +-64
+const static int8_t TEXT_WAVE[16] = { 0, 24, 45, 59, 64, 59, 45, 24, 0, -24, -45, -59, -64, -59, -45, -24 };
+
+inline TextLayout textLayout(uint8_t orient, uint8_t r, uint8_t g, uint8_t b)
+{
+    TextLayout layout;
+    memset(&layout, 0, sizeof(layout));
+    layout.orient = orient;
+    layout.r = r;
+    layout.g = g;
+    layout.b = b;
+    layout.depth = 1;
+    layout.period = 16;
+    return layout;
+}
+
+inline int textWave(int step, int amplitude)
+{
+    int v = amplitude * TEXT_WAVE[step & 15];
+    return (v + (v >= 0 ? 32 : -32)) / 64;
+}
+
+//Vertical offset the effect gives glyph number idx starting at column pos
+inline int textGlyphLift(const TextLayout& layout, int idx, int pos, int width)
+{
+    int period = layout.period > 0 ? layout.period : 1;
+    switch (layout.effect)
+    {
+    case TEXT_FX_WAVE:
+        return textWave(((pos + width / 2 + layout.phase) * 16) / period, layout.amplitude);
+    case TEXT_FX_BOUNCE:
+        //Positive half of the sine only, neighbours a quarter hop apart
+        return textWave(((layout.phase * 8) / period + idx * 2) & 7, layout.amplitude);
+    default:
+        return 0;
+    }
+}
+
+//Depth of column l, wobbly_words' triangle for TEXT_FX_DEPTH_WAVE
+inline int textColumnDepth(const TextLayout& layout, int l)
+{
+    if (layout.effect != TEXT_FX_DEPTH_WAVE)
+        return layout.depth;
+    int period = layout.period > 0 ? layout.period : 1;
+    int t = (((l + layout.phase) % period + period) % period) * 2 * layout.amplitude / period;
+    int d = t <= layout.amplitude ? t : 2 * layout.amplitude - t;
+    return d > layout.depth ? d : layout.depth;
+}
+
+//Bulk path: one glyph column, already shifted and clipped to the glyph axis,
+//in a color the caller packed once with fb->packPixel
+inline void blitTextColumn(frameBuffer* fb, int l, uint32_t mask, uint8_t orient, int base, int depth, fb_pixel_t v)
+{
+    int layers = orient == TEXT_RADIAL ? HEIGHT : WIDTH;
+    int first = base < 0 ? 0 : base;
+    int last = base + depth < layers ? base + depth : layers;
+    for (int row = 0; mask != 0; row++, mask >>= 1)
+    {
+        if (!(mask & 1))
+            continue;
+        for (int k = first; k < last; k++)
+        {
+            if (orient == TEXT_RADIAL)
+                fb->setPixelPacked(l, row, k, v);
+            else
+                fb->setPixelPacked(l, k, row, v);
+        }
+    }
+}
+
+//Draws str from column offset, returns the columns it covers
+int layoutText(const char* str, int offset, const TextLayout& layout, doubleBuffer* frame_buffer)
+{
+    const FontRef& font = layout.orient == TEXT_RADIAL ? RADIAL_FONT_REF : UPRIGHT_FONT_REF;
+    int rows = layout.orient == TEXT_RADIAL ? WIDTH : HEIGHT;
+    uint32_t row_mask = (1u << rows) - 1;
+    frameBuffer* fb = frame_buffer->getWriteBuffer();
+    //Packed on the first lit column, so FB_PALETTE8 only gains an entry for
+    //text that actually draws
+    fb_pixel_t v = 0;
+    bool packed = false;
+
+    int pos = offset;
+    int idx = 0;
+    for (const char* p = str; *p; p++, idx++)
+    {
+        int w = fontWidth(*p, font);
+        int advance = p[1] ? fontAdvance(p[0], p[1], font) : w;
+        if (!layout.wrap && pos >= LENGTH)
+            break;
+        if (!layout.wrap && pos + w <= 0)
+        {
+            pos += advance;
+            continue;
+        }
+        int lift = layout.lift + textGlyphLift(layout, idx, pos, w);
+        if (lift >= rows || lift <= -8)
+        {
+            pos += advance;
+            continue;
+        }
+        const uint8_t* cols = fontColumns(*p, font);
+        for (int i = 0; i < w; i++)
+        {
+            int l = pos + i;
+            if (layout.wrap)
+                l = ((l % LENGTH) + LENGTH) % LENGTH;
+            else if (l < 0 || l >= LENGTH)
+                continue;
+            uint32_t mask = cols[i];
+            mask = (lift >= 0 ? mask << lift : mask >> -lift) & row_mask;
+            if (mask == 0)
+                continue;
+            if (!packed)
+            {
+                v = fb->packPixel(layout.r, layout.g, layout.b);
+                packed = true;
+            }
+            blitTextColumn(fb, l, mask, layout.orient, layout.base, textColumnDepth(layout, l), v);
+        }
+        pos += advance;
+    }
+    return measureString(str, font);
+}
+
+
+//Text strip cache. A string is rasterized once into one WIDTH bit mask per
+//column (same layout writeString draws), scrolling is then a clipped or
+//wrapped blit of the masks instead of re-resolving every glyph each tick.
+//Strips are keyed by string, font and color and replaced least recently used.
+#define TEXT_STRIP_MAX_COLS 256     //32 fixed width characters, longer strings fall back to writeString
+#define TEXT_STRIP_MAX_CHARS 64
+#define TEXT_STRIP_CACHE_SIZE 4
+
+struct TextStrip
+{
+    uint32_t key;
+    uint8_t font;
+    uint8_t r, g, b;
+    uint16_t columns;
+    uint32_t last_used;
+    char text[TEXT_STRIP_MAX_CHARS + 1];
+    uint8_t mask[TEXT_STRIP_MAX_COLS];  //bit j = radial row j
+};
+
+static TextStrip text_strips[TEXT_STRIP_CACHE_SIZE];
+static uint32_t text_strip_clock = 0;
+
+inline uint32_t textStripKey(const char* str, uint8_t font, uint8_t r, uint8_t g, uint8_t b)
+{
+    //FNV-1a over the string then the style
+    uint32_t h = 2166136261u;
+    for (const char* p = str; *p; p++)
+        h = (h ^ (uint8_t)*p) * 16777619u;
+    h = (h ^ font) * 16777619u;
+    h = (h ^ r) * 16777619u;
+    h = (h ^ g) * 16777619u;
+    h = (h ^ b) * 16777619u;
+    return h | 1;                   //0 marks an empty entry
+}
+
+//Fills mask with the glyph columns of str, returns the column count or -1 if it doesn't fit
+int rasterizeString(const char* str, uint8_t* mask, int max_columns)
+{
+    int len = strlen(str);
+    if (len * CHAR_WIDTH > max_columns || len > TEXT_STRIP_MAX_CHARS)
+        return -1;
+    for (int c = 0; c < len; c++)
+    {
+        char c_ = str[c];
+        int type = resolveChar(c_);
+        const uint8_t* glyph = NULL;
+        if (type == LETTER)
+            glyph = CHAR_BUF[c_ - 65];
+        else if (type == NUMBER)
+            glyph = NUM_BUF[c_ - 48];
+
+        if (glyph != NULL)
+            memcpy(mask + c * CHAR_WIDTH, glyph, CHAR_WIDTH);
+        else
+            memset(mask + c * CHAR_WIDTH, 0, CHAR_WIDTH);
+    }
+    return len * CHAR_WIDTH;
+}
+int rasterizePropString(const char* str, uint8_t* mask, int max_columns)
+{
+    int width = measureString(str);
+    if (width > max_columns || (int)strlen(str) > TEXT_STRIP_MAX_CHARS)
+        return -1;
+    memset(mask, 0, width);
+    int pos = 0;
+    for (const char* p = str; *p; p++)
+    {
+        memcpy(mask + pos, fontColumns(*p), fontWidth(*p));
+        if (p[1])
+            pos += fontAdvance(p[0], p[1]);
+    }
+    return width;
+}
+
+//Cached strip for str, rasterized on a miss. NULL if str is too long to cache
+const TextStrip* getTextStrip(const char* str, uint8_t r, uint8_t g, uint8_t b, uint8_t font = 0)
+{
+    uint32_t key = textStripKey(str, font, r, g, b);
+    text_strip_clock++;
+    TextStrip* victim = &text_strips[0];
+    for (int i = 0; i < TEXT_STRIP_CACHE_SIZE; i++)
+    {
+        TextStrip* s = &text_strips[i];
+        if (s->key == key && s->font == font && s->r == r && s->g == g && s->b == b && strcmp(s->text, str) == 0)
+        {
+            s->last_used = text_strip_clock;
+            return s;
+        }
+        if (s->last_used < victim->last_used)
+            victim = s;
+    }
+
+    int columns = font == FONT_PROPORTIONAL ? rasterizePropString(str, victim->mask, TEXT_STRIP_MAX_COLS)
+                                            : rasterizeString(str, victim->mask, TEXT_STRIP_MAX_COLS);
+    if (columns < 0)
+        return NULL;
+    victim->key = key;
+    strcpy(victim->text, str);
+    victim->font = font;
+    victim->r = r;
+    victim->g = g;
+    victim->b = b;
+    victim->columns = columns;
+    victim->last_used = text_strip_clock;
+    return victim;
+}
+
+//Draws the strip with its first column at offset. With wrap the strip repeats
+//every columns + gap slices around the drum, otherwise it is clipped to 0..LENGTH-1
+void blitTextStrip(const TextStrip* strip, int offset, int layer, doubleBuffer* frame_buffer, bool wrap = false, int gap = 0)
+{
+    if (strip == NULL || layer < 0 || layer >= HEIGHT || strip->columns == 0)
+        return;
+
+    int period = strip->columns + (gap > 0 ? gap : 0);
+    int first = 0, last = LENGTH;
+    if (!wrap)
+    {
+        //Only the visible window of the strip is touched
+        first = offset > 0 ? offset : 0;
+        last = offset + strip->columns < LENGTH ? offset + strip->columns : LENGTH;
+    }
+    int src = (first - offset) % period;
+    if (src < 0)
+        src += period;
+    //pos stays in 0..LENGTH-1 and masks are clipped to WIDTH rows once here,
+    //so the columns go straight into the write buffer without per voxel checks
+    uint32_t row_mask = (1u << WIDTH) - 1;
+    frameBuffer* fb = frame_buffer->getWriteBuffer();
+    fb_pixel_t v = 0;
+    bool packed = false;
+    for (int pos = first; pos < last; pos++)
+    {
+        uint32_t column = src < strip->columns ? strip->mask[src] & row_mask : 0;
+        if (++src == period)
+            src = 0;
+        if (column == 0)
+            continue;
+        if (!packed)
+        {
+            v = fb->packPixel(strip->r, strip->g, strip->b);
+            packed = true;
+        }
+        blitTextColumn(fb, pos, column, TEXT_RADIAL, layer, 1, v);
+    }
+}
+
+//writeString/writePropString through the strip cache, same output
+void writeStringCached(const char* str, int offset, int layer, uint8_t r, uint8_t g, uint8_t b, doubleBuffer* frame_buffer, uint8_t font = FONT_FIXED)
+{
+    const TextStrip* strip = getTextStrip(str, r, g, b, font);
+    if (strip != NULL)
+        blitTextStrip(strip, offset, layer, frame_buffer);
+    else if (font == FONT_PROPORTIONAL)
+        writePropString(str, offset, layer, r, g, b, frame_buffer);
+    else
+        writeString(str, offset, layer, r, g, b, frame_buffer);
+}
+
 #endif
@@ -0,0 +1,283 @@
+#ifndef TIMELINE_LIB
+#define TIMELINE_LIB
+
+#include <stdint.h>
+#include <stddef.h>
+
+//Keyframed timelines for scripted shows. A show is data: tracks of keyframes
+//on a channel (position, color, brightness, phase, buffer mode...), grouped
+//into sequences and parallel groups that may repeat. Nothing is stepped:
+//timelineEvaluate() works out every channel for one point in time, so a
+//scene can be ticked, seeked or scrubbed to any time at the same cost.
+//Values are integers so stepped shows (a level every 35 ms, a phase every
+//10 ticks) come out exact.
+#define TIMELINE_TICK_MS 5              //Time per tick-style scene call, one TICK_DELAY
+#define TIMELINE_FOREVER 0xFFFF         //repeat count of a node that loops
+#define TIMELINE_ENDLESS 0xFFFFFFFFu    //Duration of anything that loops
+
+//Curve from a keyframe to the next one
+enum TIMELINE_EASE
+{
+    EASE_STEP,          //Hold the value until the next key
+    EASE_LINEAR,
+    EASE_IN_QUAD,
+    EASE_OUT_QUAD,
+    EASE_IN_OUT_QUAD,
+    EASE_SMOOTH         //Smoothstep
+};
+
+enum TIMELINE_CHANNEL
+{
+    TL_X, TL_Y, TL_Z,
+    TL_RED, TL_GREEN, TL_BLUE,
+    TL_BRIGHTNESS,
+    TL_PHASE,
+    TL_LEVEL,
+    TL_MODE,            //Scene defined switches, e.g. single/double buffering
+    TL_CHANNELS
+};
+
+struct Keyframe
+{
+    uint32_t t_ms;
+    int32_t value;
+    uint8_t ease;       //TIMELINE_EASE towards the next key
+};
+
+struct TimelineTrack
+{
+    uint8_t channel;    //TIMELINE_CHANNEL
+    const Keyframe* keys;
+    uint8_t key_count;
+};
+
+enum TIMELINE_NODE { TIMELINE_TRACK, TIMELINE_SEQUENCE, TIMELINE_PARALLEL };
+
+//A track, or children played one after another (sequence) or all at once
+//(parallel). A sequence holds each finished child at its end values
+struct TimelineNode
+{
+    uint8_t kind;       //TIMELINE_NODE
+    uint16_t repeat;    //Extra plays after the first, TIMELINE_FOREVER to loop
+    const TimelineTrack* track;
+    const TimelineNode* children;
+    uint8_t child_count;
+};
+
+constexpr TimelineNode timelineTrack(const TimelineTrack* track, uint16_t repeat = 0)
+{
+    return TimelineNode{ TIMELINE_TRACK, repeat, track, NULL, 0 };
+}
+constexpr TimelineNode timelineSequence(const TimelineNode* children, uint8_t count, uint16_t repeat = 0)
+{
+    return TimelineNode{ TIMELINE_SEQUENCE, repeat, NULL, children, count };
+}
+constexpr TimelineNode timelineParallel(const TimelineNode* children, uint8_t count, uint16_t repeat = 0)
+{
+    return TimelineNode{ TIMELINE_PARALLEL, repeat, NULL, children, count };
+}
+
+struct TimelineValues
+{
+    int32_t value[TL_CHANNELS];
+    uint16_t set;       //Bit per channel some track wrote
+
+    bool has(int channel) const { return (set >> channel) & 1; }
+    int32_t get(int channel, int32_t fallback = 0) const { return has(channel) ? value[channel] : fallback; }
+};
+
+//16.16 position u in [0, 1] through a curve
+inline uint32_t timelineEase(uint8_t ease, uint32_t u)
+{
+    const uint64_t ONE = 1 << 16;
+    switch (ease)
+    {
+    case EASE_STEP:
+        return 0;
+    case EASE_IN_QUAD:
+        return (uint32_t)(((uint64_t)u * u) >> 16);
+    case EASE_OUT_QUAD:
+        return (uint32_t)(ONE - (((ONE - u) * (ONE - u)) >> 16));
+    case EASE_IN_OUT_QUAD:
+        if (u < ONE / 2)
+            return (uint32_t)(((uint64_t)u * u) >> 15);
+        return (uint32_t)(ONE - (((ONE - u) * (ONE - u)) >> 15));
+    case EASE_SMOOTH:
+    {
+        uint64_t u2 = ((uint64_t)u * u) >> 16;
+        return (uint32_t)((u2 * (3 * ONE - 2 * u)) >> 16);
+    }
+    default:
+        return u;
+    }
+}
+
+inline int32_t timelineSample(const TimelineTrack& track, uint32_t t)
+{
+    const Keyframe* keys = track.keys;
+    int n = track.key_count;
+    if (n == 0)
+        return 0;
+    if (t <= keys[0].t_ms)
+        return keys[0].value;
+    if (t >= keys[n - 1].t_ms)
+        return keys[n - 1].value;
+
+    //Last key at or before t
+    int lo = 0, hi = n - 1;
+    while (hi - lo > 1)
+    {
+        int mid = (lo + hi) / 2;
+        if (keys[mid].t_ms <= t)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    const Keyframe& a = keys[lo];
+    const Keyframe& b = keys[lo + 1];
+    int64_t span = (int64_t)b.value - a.value;
+    uint32_t dt = t - a.t_ms;
+    uint32_t len = b.t_ms - a.t_ms;
+    if (a.ease == EASE_STEP)
+        return a.value;
+    if (a.ease == EASE_LINEAR)
+        return (int32_t)(a.value + span * dt / len);
+    uint32_t u = (uint32_t)(((uint64_t)dt << 16) / len);
+    return (int32_t)(a.value + ((span * timelineEase(a.ease, u)) >> 16));
+}
+
+//One play of a node, ignoring its repeat
+inline uint32_t timelinePlayDuration(const TimelineNode& node);
+
+inline uint32_t timelineDuration(const TimelineNode& node)
+{
+    uint32_t one = timelinePlayDuration(node);
+    if (one == TIMELINE_ENDLESS || (node.repeat == TIMELINE_FOREVER && one > 0))
+        return TIMELINE_ENDLESS;
+    uint64_t total = (uint64_t)one * (node.repeat + 1);
+    return total >= TIMELINE_ENDLESS ? TIMELINE_ENDLESS : (uint32_t)total;
+}
+
+inline uint32_t timelinePlayDuration(const TimelineNode& node)
+{
+    if (node.kind == TIMELINE_TRACK)
+        return (node.track != NULL && node.track->key_count > 0) ? node.track->keys[node.track->key_count - 1].t_ms : 0;
+
+    uint64_t total = 0;
+    for (int i = 0; i < node.child_count; i++)
+    {
+        uint32_t d = timelineDuration(node.children[i]);
+        if (d == TIMELINE_ENDLESS)
+            return TIMELINE_ENDLESS;
+        if (node.kind == TIMELINE_SEQUENCE)
+            total += d;
+        else if (d > total)
+            total = d;
+    }
+    return total >= TIMELINE_ENDLESS ? TIMELINE_ENDLESS : (uint32_t)total;
+}
+
+//Writes every channel node drives at time t into out. Past its end a node
+//holds its final values
+inline void timelineEvaluate(const TimelineNode& node, uint32_t t, TimelineValues* out)
+{
+    uint32_t one = timelinePlayDuration(node);
+    uint32_t total = timelineDuration(node);
+    if (one != TIMELINE_ENDLESS && one > 0)
+        t = t >= total ? one : t % one;
+
+    if (node.kind == TIMELINE_TRACK)
+    {
+        if (node.track == NULL || node.track->channel >= TL_CHANNELS)
+            return;
+        out->value[node.track->channel] = timelineSample(*node.track, t);
+        out->set |= 1 << node.track->channel;
+        return;
+    }
+    for (int i = 0; i < node.child_count; i++)
+    {
+        const TimelineNode& child = node.children[i];
+        if (node.kind == TIMELINE_PARALLEL)
+        {
+            timelineEvaluate(child, t, out);
+            continue;
+        }
+        uint32_t d = timelineDuration(child);
+        if (t < d || i == node.child_count - 1)
+        {
+            timelineEvaluate(child, t, out);
+            return;
+        }
+        timelineEvaluate(child, d, out);
+        t -= d;
+    }
+}
+
+//Playback position in a timeline. A root that loops forever keeps its time
+//within one play and counts the plays instead, so scenes can re-roll their
+//random choices at the start of each one
+class TimelinePlayer
+{
+private:
+    const TimelineNode* root;
+    uint32_t time_ms;
+    uint32_t play;
+    uint32_t play_ms;       //One play of root
+    bool looping;
+
+public:
+    TimelinePlayer(const TimelineNode* root_ = NULL) { start(root_); }
+
+    void start(const TimelineNode* root_)
+    {
+        root = root_;
+        play_ms = root != NULL ? timelinePlayDuration(*root) : 0;
+        looping = root != NULL && root->repeat == TIMELINE_FOREVER && play_ms > 0 && play_ms != TIMELINE_ENDLESS;
+        seek(0);
+    }
+    void seek(uint32_t t_ms)
+    {
+        if (looping)
+        {
+            play = t_ms / play_ms;
+            time_ms = t_ms % play_ms;
+            return;
+        }
+        play = 0;
+        time_ms = t_ms;
+        uint32_t total = root != NULL ? timelineDuration(*root) : 0;
+        if (time_ms > total)
+            time_ms = total;
+    }
+    void advance(uint32_t dt_ms)
+    {
+        if (looping)
+        {
+            time_ms += dt_ms;
+            while (time_ms >= play_ms)
+            {
+                time_ms -= play_ms;
+                play++;
+            }
+            return;
+        }
+        seek(time_ms + dt_ms < time_ms ? TIMELINE_ENDLESS : time_ms + dt_ms);
+    }
+
+    uint32_t time() const { return time_ms; }
+    uint32_t plays() const { return play; }
+    bool done() const { return root == NULL || (!looping && time_ms >= timelineDuration(*root)); }
+
+    TimelineValues evaluate() const
+    {
+        TimelineValues values;
+        values.set = 0;
+        for (int i = 0; i < TL_CHANNELS; i++)
+            values.value[i] = 0;
+        if (root != NULL)
+            timelineEvaluate(*root, time_ms, &values);
+        return values;
+    }
+};
+
+#endif
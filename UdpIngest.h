@@ -0,0 +1,522 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <pov_display/FrameBuffer.h>
+
+// Receives voxel frames over UDP, in a DDP-like packet format, and hands
+// complete frames to the animation thread.
+//
+// Every packet carries a 24 byte header (network byte order) followed by
+// RGB888 bytes for [offset, offset + length) of the [LENGTH][WIDTH][HEIGHT][3]
+// frame. A frame is split into `count` packets numbered by `index`. Partial
+// frames are allowed: bytes no packet covers keep the last complete frame's
+// values, so a sender can update only a few slices.
+//
+// Frame sync policy: one frame is assembled at a time. Packets for an older
+// frame_seq are dropped as late, packets whose count disagrees with the frame
+// being assembled as bad; the first packet of a newer frame abandons an
+// incomplete one. A restarted sender counts from 1 again, so the sequence
+// is dropped and followed afresh after a backward jump of more than
+// UDP_INGEST_RESTART_GAP, or once the old one hasn't completed a frame for
+// UDP_INGEST_TIMEOUT_MS. A completed frame replaces any that the animation thread
+// hasn't taken yet, so the display always shows the newest full frame and
+// never a mix of two.
+
+#define UDP_FRAME_MAGIC 0x5056          //"PV"
+#define UDP_FRAME_VERSION 1
+#define UDP_FRAME_HEADER_SIZE 24
+#define UDP_FRAME_MAX_PAYLOAD 1440      //Keeps packets under a 1500 byte MTU
+#define UDP_FRAME_MAX_PACKETS 64
+#define UDP_FRAME_BYTES (LENGTH * WIDTH * HEIGHT * NUM_COLORS)
+#define UDP_INGEST_TIMEOUT_MS 500       //Hand the display back to main_exec after this long without frames
+#define UDP_INGEST_RESTART_GAP 256      //Frames behind that can't be reordering, the sender restarted
+
+struct UdpFrameHeader {
+	uint16_t magic;
+	uint8_t version;
+	uint8_t flags;
+	uint32_t frame_seq;
+	uint32_t offset;            //Byte offset into the frame
+	uint16_t length;            //Payload bytes
+	uint8_t index;              //Packet number within the frame
+	uint8_t count;              //Packets in this frame
+	uint64_t send_ns;           //Sender CLOCK_MONOTONIC, only meaningful on the same host
+};
+
+struct UdpIngestStats {
+	uint64_t packets;
+	uint64_t bad_packets;       //Wrong magic/size, out of range or count mismatch
+	uint64_t late_packets;      //Belonged to a frame we already finished or gave up on
+	uint64_t duplicate_packets;
+	uint64_t frames_completed;
+	uint64_t frames_abandoned;  //A newer frame started before this one completed
+	uint64_t frames_overwritten;//Completed but replaced before the display took it
+	uint64_t frames_taken;
+	uint64_t sender_restarts;   //Sequence dropped for a restarted sender
+};
+
+inline uint64_t udpMonotonicNanos()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+inline void packUdpHeader(const UdpFrameHeader& h, uint8_t* out)
+{
+	uint16_t magic = htons(h.magic);
+	uint32_t seq = htonl(h.frame_seq);
+	uint32_t offset = htonl(h.offset);
+	uint16_t length = htons(h.length);
+	uint32_t t_hi = htonl((uint32_t)(h.send_ns >> 32));
+	uint32_t t_lo = htonl((uint32_t)h.send_ns);
+	memcpy(out, &magic, 2);
+	out[2] = h.version;
+	out[3] = h.flags;
+	memcpy(out + 4, &seq, 4);
+	memcpy(out + 8, &offset, 4);
+	memcpy(out + 12, &length, 2);
+	out[14] = h.index;
+	out[15] = h.count;
+	memcpy(out + 16, &t_hi, 4);
+	memcpy(out + 20, &t_lo, 4);
+}
+inline void unpackUdpHeader(const uint8_t* in, UdpFrameHeader& h)
+{
+	uint16_t magic, length;
+	uint32_t seq, offset, t_hi, t_lo;
+	memcpy(&magic, in, 2);
+	memcpy(&seq, in + 4, 4);
+	memcpy(&offset, in + 8, 4);
+	memcpy(&length, in + 12, 2);
+	memcpy(&t_hi, in + 16, 4);
+	memcpy(&t_lo, in + 20, 4);
+	h.magic = ntohs(magic);
+	h.version = in[2];
+	h.flags = in[3];
+	h.frame_seq = ntohl(seq);
+	h.offset = ntohl(offset);
+	h.length = ntohs(length);
+	h.index = in[14];
+	h.count = in[15];
+	h.send_ns = ((uint64_t)ntohl(t_hi) << 32) | ntohl(t_lo);
+}
+
+
+class UdpFrameReceiver {
+	public:
+		UdpFrameReceiver();
+		~UdpFrameReceiver() { stop(); }
+
+		//Binds to 127.0.0.1 unless any_interface is set
+		bool start(uint16_t port, bool any_interface = false);
+		void stop();
+		bool running() { return thread_running; }
+
+		//Animation thread side: copies the newest complete frame into the write
+		//buffer, repeating it until a newer one completes. Returns false once no
+		//frame has completed for UDP_INGEST_TIMEOUT_MS
+		bool takeFrame(doubleBuffer* frame_buffer, uint64_t* send_ns = NULL);
+
+		UdpIngestStats getStats();
+		//Sender timestamp -> takeFrame() latencies in us since the last call
+		std::vector<double> takeLatencies();
+
+	private:
+		int sock;
+		std::thread th;
+		std::atomic<bool> thread_running;
+
+		//Receiver thread only
+		uint8_t assembling[UDP_FRAME_BYTES];
+		uint8_t last_complete[UDP_FRAME_BYTES];
+		uint32_t assembling_seq;
+		uint64_t assembling_send_ns;
+		uint64_t received_mask;
+		int received_count;
+		int expected_count;
+		bool assembling_active;
+		bool have_seq;
+		uint64_t seq_progress_ns;   //Last frame completed (or first begun) on this sequence
+
+		//Shared with the animation thread
+		std::mutex ready_mutex;
+		uint8_t ready[UDP_FRAME_BYTES];
+		bool ready_fresh;
+		uint64_t ready_send_ns;
+		uint64_t ready_time_ns;
+		UdpIngestStats stats;
+		std::vector<double> latencies;
+
+		void threadLoop();
+		void handlePacket(const uint8_t* buf, int len);
+		void beginFrame(uint32_t seq, int count, uint64_t send_ns);
+		void completeFrame();
+};
+
+UdpFrameReceiver::UdpFrameReceiver()
+{
+	sock = -1;
+	thread_running = false;
+	assembling_active = false;
+	assembling_seq = 0;
+	assembling_send_ns = 0;
+	received_mask = 0;
+	received_count = 0;
+	expected_count = 0;
+	have_seq = false;
+	seq_progress_ns = 0;
+	ready_fresh = false;
+	ready_time_ns = 0;
+	memset(last_complete, 0, sizeof(last_complete));
+	memset(&stats, 0, sizeof(stats));
+}
+bool UdpFrameReceiver::start(uint16_t port, bool any_interface)
+{
+	stop();
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0)
+	{
+		printf("Error::UDP_INGEST::socket failed\n");
+		return false;
+	}
+	//Room for a few frames in flight while the receiver thread is descheduled
+	int rcvbuf = 4 * 1024 * 1024;
+	setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(any_interface ? INADDR_ANY : INADDR_LOOPBACK);
+	if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		printf("Error::UDP_INGEST::bind to port %d failed\n", port);
+		close(sock);
+		sock = -1;
+		return false;
+	}
+	printf("UDP ingest: listening on %s:%d\n", any_interface ? "0.0.0.0" : "127.0.0.1", port);
+	thread_running = true;
+	th = std::thread(&UdpFrameReceiver::threadLoop, this);
+	return true;
+}
+void UdpFrameReceiver::stop()
+{
+	thread_running = false;
+	if (th.joinable())
+		th.join();
+	if (sock >= 0)
+	{
+		close(sock);
+		sock = -1;
+	}
+}
+void UdpFrameReceiver::threadLoop()
+{
+	uint8_t buf[UDP_FRAME_HEADER_SIZE + UDP_FRAME_MAX_PAYLOAD];
+	struct pollfd pfd;
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+	while (thread_running)
+	{
+		//Short timeout so stop() doesn't hang on a quiet socket
+		if (poll(&pfd, 1, 50) <= 0)
+			continue;
+		int len = (int)recv(sock, buf, sizeof(buf), 0);
+		if (len > 0)
+			handlePacket(buf, len);
+	}
+}
+void UdpFrameReceiver::beginFrame(uint32_t seq, int count, uint64_t send_ns)
+{
+	//Uncovered bytes keep the last complete frame
+	memcpy(assembling, last_complete, sizeof(assembling));
+	assembling_seq = seq;
+	assembling_send_ns = send_ns;
+	received_mask = 0;
+	received_count = 0;
+	expected_count = count;
+	assembling_active = true;
+	if (!have_seq)
+		seq_progress_ns = udpMonotonicNanos();
+	have_seq = true;
+}
+void UdpFrameReceiver::completeFrame()
+{
+	memcpy(last_complete, assembling, sizeof(last_complete));
+	assembling_active = false;
+	seq_progress_ns = udpMonotonicNanos();
+
+	std::lock_guard<std::mutex> lock(ready_mutex);
+	if (ready_fresh)
+		stats.frames_overwritten++;
+	memcpy(ready, assembling, sizeof(ready));
+	ready_fresh = true;
+	ready_send_ns = assembling_send_ns;
+	ready_time_ns = udpMonotonicNanos();
+	stats.frames_completed++;
+}
+void UdpFrameReceiver::handlePacket(const uint8_t* buf, int len)
+{
+	UdpFrameHeader h;
+	bool bad = len < UDP_FRAME_HEADER_SIZE;
+	if (!bad)
+	{
+		unpackUdpHeader(buf, h);
+		bad = h.magic != UDP_FRAME_MAGIC || h.version != UDP_FRAME_VERSION ||
+			h.count == 0 || h.count > UDP_FRAME_MAX_PACKETS || h.index >= h.count ||
+			h.length != len - UDP_FRAME_HEADER_SIZE ||
+			h.offset > UDP_FRAME_BYTES || h.length > UDP_FRAME_BYTES - h.offset;
+		//Every packet of a frame has to agree on how many there are, or the
+		//frame could complete early or never
+		if (assembling_active && h.frame_seq == assembling_seq && h.count != expected_count)
+			bad = true;
+	}
+	if (bad)
+	{
+		std::lock_guard<std::mutex> lock(ready_mutex);
+		stats.packets++;
+		stats.bad_packets++;
+		return;
+	}
+
+	//Serial number arithmetic so the sequence can wrap
+	int32_t diff = (int32_t)(h.frame_seq - assembling_seq);
+	bool restarted = have_seq && diff < 0 && (diff < -UDP_INGEST_RESTART_GAP ||
+		udpMonotonicNanos() - seq_progress_ns > UDP_INGEST_TIMEOUT_MS * 1000000ull);
+	if (restarted)
+		have_seq = false;
+	bool late = have_seq && (diff < 0 || (diff == 0 && !assembling_active));
+	bool abandoned = false;
+	bool duplicate = false;
+	if (!late)
+	{
+		if (!have_seq || diff > 0)
+		{
+			abandoned = assembling_active;
+			beginFrame(h.frame_seq, h.count, h.send_ns);
+		}
+		uint64_t bit = 1ull << h.index;
+		duplicate = (received_mask & bit) != 0;
+		if (!duplicate)
+		{
+			memcpy(assembling + h.offset, buf + UDP_FRAME_HEADER_SIZE, h.length);
+			received_mask |= bit;
+			received_count++;
+			if (h.send_ns < assembling_send_ns)
+				assembling_send_ns = h.send_ns;
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(ready_mutex);
+		stats.packets++;
+		if (late)
+			stats.late_packets++;
+		if (restarted)
+			stats.sender_restarts++;
+		if (abandoned)
+			stats.frames_abandoned++;
+		if (duplicate)
+			stats.duplicate_packets++;
+	}
+	if (!late && !duplicate && received_count == expected_count)
+		completeFrame();
+}
+bool UdpFrameReceiver::takeFrame(doubleBuffer* frame_buffer, uint64_t* send_ns)
+{
+	std::lock_guard<std::mutex> lock(ready_mutex);
+	if (ready_time_ns == 0 || udpMonotonicNanos() - ready_time_ns > UDP_INGEST_TIMEOUT_MS * 1000000ull)
+		return false;
+	const uint8_t* px = ready;
+	for (int i = 0; i < LENGTH; i++)
+	{
+		for (int j = 0; j < WIDTH; j++)
+		{
+			for (int k = 0; k < HEIGHT; k++, px += NUM_COLORS)
+			{
+				frame_buffer->setColors(i, j, k, px[RED], px[GREEN], px[BLUE]);
+			}
+		}
+	}
+	if (send_ns)
+		*send_ns = ready_send_ns;
+	if (ready_fresh)
+	{
+		ready_fresh = false;
+		stats.frames_taken++;
+		if (latencies.size() < 100000)
+			latencies.push_back((udpMonotonicNanos() - ready_send_ns) / 1000.0);
+	}
+	return true;
+}
+UdpIngestStats UdpFrameReceiver::getStats()
+{
+	std::lock_guard<std::mutex> lock(ready_mutex);
+	return stats;
+}
+std::vector<double> UdpFrameReceiver::takeLatencies()
+{
+	std::lock_guard<std::mutex> lock(ready_mutex);
+	std::vector<double> out;
+	out.swap(latencies);
+	return out;
+}
+
+
+// Load generator / reference sender. Splits an RGB888 frame into packets
+class UdpFrameSender {
+	public:
+		UdpFrameSender() : sock(-1), seq(0) {}
+		~UdpFrameSender() { if (sock >= 0) close(sock); }
+
+		bool open(const char* host, uint16_t port);
+		//Sends bytes [offset, offset + length) of frame as one frame_seq
+		int sendFrame(const uint8_t* frame, uint32_t offset = 0, uint32_t length = UDP_FRAME_BYTES);
+
+	private:
+		int sock;
+		uint32_t seq;
+		struct sockaddr_in dest;
+};
+
+bool UdpFrameSender::open(const char* host, uint16_t port)
+{
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0)
+		return false;
+	memset(&dest, 0, sizeof(dest));
+	dest.sin_family = AF_INET;
+	dest.sin_port = htons(port);
+	if (inet_pton(AF_INET, host, &dest.sin_addr) != 1)
+	{
+		printf("Error::UDP_SENDER::Bad address %s\n", host);
+		close(sock);
+		sock = -1;
+		return false;
+	}
+	return true;
+}
+int UdpFrameSender::sendFrame(const uint8_t* frame, uint32_t offset, uint32_t length)
+{
+	if (sock < 0 || offset + length > UDP_FRAME_BYTES)
+		return -1;
+	int count = (length + UDP_FRAME_MAX_PAYLOAD - 1) / UDP_FRAME_MAX_PAYLOAD;
+	if (count == 0 || count > UDP_FRAME_MAX_PACKETS)
+		return -1;
+
+	uint8_t buf[UDP_FRAME_HEADER_SIZE + UDP_FRAME_MAX_PAYLOAD];
+	UdpFrameHeader h;
+	h.magic = UDP_FRAME_MAGIC;
+	h.version = UDP_FRAME_VERSION;
+	h.flags = 0;
+	h.frame_seq = ++seq;
+	h.count = count;
+	h.send_ns = udpMonotonicNanos();
+	for (int i = 0; i < count; i++)
+	{
+		uint32_t chunk = std::min((uint32_t)UDP_FRAME_MAX_PAYLOAD, length - i * UDP_FRAME_MAX_PAYLOAD);
+		h.index = i;
+		h.offset = offset + i * UDP_FRAME_MAX_PAYLOAD;
+		h.length = chunk;
+		packUdpHeader(h, buf);
+		memcpy(buf + UDP_FRAME_HEADER_SIZE, frame + h.offset, chunk);
+		sendto(sock, buf, UDP_FRAME_HEADER_SIZE + chunk, 0, (struct sockaddr*)&dest, sizeof(dest));
+	}
+	return count;
+}
+
+// Streams frames at fps (0 = as fast as possible) for a number of seconds
+void udpLoadGenerator(const char* host, uint16_t port, float fps, float seconds)
+{
+	UdpFrameSender sender;
+	if (!sender.open(host, port))
+		return;
+	static uint8_t frame[UDP_FRAME_BYTES];
+	uint64_t start = udpMonotonicNanos();
+	uint64_t end = start + (uint64_t)(seconds * 1e9);
+	uint64_t interval = fps > 0.0f ? (uint64_t)(1e9 / fps) : 0;
+	uint64_t next = start;
+	int frames = 0;
+	while (udpMonotonicNanos() < end)
+	{
+		//Moving band so frames differ and tearing would be visible
+		for (int i = 0; i < LENGTH; i++)
+		{
+			uint8_t v = ((i + frames) % LENGTH) < 8 ? 255 : 0;
+			memset(frame + i * WIDTH * HEIGHT * NUM_COLORS, v, WIDTH * HEIGHT * NUM_COLORS);
+		}
+		sender.sendFrame(frame);
+		frames++;
+		if (interval)
+		{
+			next += interval;
+			while (udpMonotonicNanos() < next)
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}
+	printf("UDP load: sent %d frames in %.1f s\n", frames, (udpMonotonicNanos() - start) / 1e9);
+}
+
+// Receiver + load generator on localhost. A consumer thread stands in for
+// the animation thread, taking frames every tick_ms
+void benchUdpIngest(uint16_t port, float fps, float seconds, int tick_ms = 5)
+{
+	UdpFrameReceiver receiver;
+	if (!receiver.start(port))
+		return;
+	static doubleBuffer frame_buffer;
+	std::atomic<bool> done(false);
+	std::thread consumer([&]() {
+		while (!done.load())
+		{
+			if (receiver.takeFrame(&frame_buffer))
+				frame_buffer.update();
+			std::this_thread::sleep_for(std::chrono::milliseconds(tick_ms));
+		}
+	});
+	uint64_t t0 = udpMonotonicNanos();
+	udpLoadGenerator("127.0.0.1", port, fps, seconds);
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	double secs = (udpMonotonicNanos() - t0) / 1e9;
+	UdpIngestStats s = receiver.getStats();
+	std::vector<double> lat = receiver.takeLatencies();
+
+	//Restart: a fresh sender counts from 1 again and has to be picked up,
+	//either right away (big backward jump) or after UDP_INGEST_TIMEOUT_MS
+	uint64_t t1 = udpMonotonicNanos();
+	udpLoadGenerator("127.0.0.1", port, fps, 1.0f);
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	double restart_secs = (udpMonotonicNanos() - t1) / 1e9;
+	UdpIngestStats r = receiver.getStats();
+	done = true;
+	consumer.join();
+	receiver.stop();
+
+	std::sort(lat.begin(), lat.end());
+	printf("UDP ingest: %llu packets (%llu bad, %llu late, %llu dup), %llu frames complete (%.0f/s), %llu abandoned, %llu overwritten, %llu displayed\n",
+		(unsigned long long)s.packets, (unsigned long long)s.bad_packets, (unsigned long long)s.late_packets,
+		(unsigned long long)s.duplicate_packets, (unsigned long long)s.frames_completed, s.frames_completed / secs,
+		(unsigned long long)s.frames_abandoned, (unsigned long long)s.frames_overwritten, (unsigned long long)s.frames_taken);
+	if (!lat.empty())
+	{
+		printf("UDP ingest: send -> display latency p50 %.0f us, p99 %.0f us, max %.0f us\n",
+			lat[lat.size() / 2], lat[lat.size() * 99 / 100], lat.back());
+	}
+	printf("UDP ingest: restarted sender, %llu restart(s) seen, %llu frames complete in %.1f s, %llu late\n",
+		(unsigned long long)(r.sender_restarts - s.sender_restarts), (unsigned long long)(r.frames_completed - s.frames_completed),
+		restart_secs, (unsigned long long)(r.late_packets - s.late_packets));
+}
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include "AssetLoader.h"
+#include "FrameRecorder.h"
+
+// Mesh voxelizer. Loads anything Assimp can read and turns it into voxel
+// frames for the drum, one per step of a full turn, baked into a recording
+// (.povr) that PLAYBACK_FILE or FramePlayer spins with no triangle work at
+// display time. Rotations are voxelized in parallel; the recording's XOR
+// delta + RLE keeps the cached turn small.
+//
+// Voxels use the geometry of the LED pass in main.cpp: slice l at 3.75 * l
+// degrees from +x towards +z, radial row w centred at VOXEL_RADIUS_0 + w *
+// VOXEL_RADIAL_PITCH, layers VOXEL_LAYER_PITCH apart. The volume is far
+// wider than it is tall, so the turned mesh is stretched to fill it, across
+// and up separately. Whatever falls into the hole in the middle has no LEDs
+// to land on. A voxel is lit where the surface passes
+// through it, with the average surface color, and optionally inside closed
+// meshes too (found by ray parity along each column).
+//
+// --voxelize mesh out.povr rotations turns_per_second [tilt_deg]
+
+#define VOXEL_RADIUS_0 35.0f
+#define VOXEL_RADIAL_PITCH 5.0f
+#define VOXEL_LAYER_PITCH 7.6f
+#define VOXEL_SAMPLE_STEP 1.0f          //Surface sample spacing, well below a voxel
+#define VOXEL_SOLID_FILL true           //Light the inside of closed meshes
+#define VOXEL_MAX_THREADS 16
+#define VOXEL_MAX_ROTATIONS 3600        //0.1 degree steps, ~50 MB of frames before encoding
+
+//Triangle soup with a color per vertex
+struct VoxelMesh {
+	std::vector<float> positions;           //xyz
+	std::vector<uint8_t> colors;            //rgb
+	std::vector<uint32_t> indices;          //3 per triangle
+};
+
+struct VoxelizeOptions {
+	int rotations;                          //Frames per turn
+	float tilt_deg;                         //Mesh tilted about z before it spins
+	bool solid;
+};
+
+bool loadVoxelMesh(const char* path, VoxelMesh& out)
+{
+	Assimp::Importer import;
+	const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_PreTransformVertices | aiProcess_JoinIdenticalVertices);
+	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE)
+	{
+		printf("Error::ASSIMP::%s\n", import.GetErrorString());
+		return false;
+	}
+	out.positions.clear();
+	out.colors.clear();
+	out.indices.clear();
+	for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+	{
+		const aiMesh* mesh = scene->mMeshes[m];
+		uint32_t base = (uint32_t)(out.positions.size() / 3);
+
+		//Vertex colors if there are any, else the material's diffuse color
+		aiColor4D diffuse(1.0f, 1.0f, 1.0f, 1.0f);
+		if (scene->mMaterials != NULL && mesh->mMaterialIndex < scene->mNumMaterials)
+			aiGetMaterialColor(scene->mMaterials[mesh->mMaterialIndex], AI_MATKEY_COLOR_DIFFUSE, &diffuse);
+		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+		{
+			out.positions.push_back(mesh->mVertices[i].x);
+			out.positions.push_back(mesh->mVertices[i].y);
+			out.positions.push_back(mesh->mVertices[i].z);
+			aiColor4D c = mesh->mColors[0] != NULL ? mesh->mColors[0][i] : diffuse;
+			out.colors.push_back((uint8_t)(std::min(std::max(c.r, 0.0f), 1.0f) * 255.0f + 0.5f));
+			out.colors.push_back((uint8_t)(std::min(std::max(c.g, 0.0f), 1.0f) * 255.0f + 0.5f));
+			out.colors.push_back((uint8_t)(std::min(std::max(c.b, 0.0f), 1.0f) * 255.0f + 0.5f));
+		}
+		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+		{
+			const aiFace& face = mesh->mFaces[i];
+			if (face.mNumIndices != 3)
+				continue;               //Points and lines
+			for (int j = 0; j < 3; j++)
+				out.indices.push_back(base + face.mIndices[j]);
+		}
+	}
+	if (out.indices.empty())
+	{
+		printf("Error::VOXELIZER::%s has no triangles\n", path);
+		return false;
+	}
+	return true;
+}
+
+//Centres the mesh on the origin and scales it to a unit radius about the
+//vertical axis and a unit half height. Tilted meshes sweep a sphere as they
+//turn, so they are scaled by that uniformly
+void fitVoxelMesh(VoxelMesh& mesh, bool tilted)
+{
+	size_t n = mesh.positions.size() / 3;
+	if (n == 0)
+		return;
+	float lo[3] = { 1e30f, 1e30f, 1e30f }, hi[3] = { -1e30f, -1e30f, -1e30f };
+	for (size_t i = 0; i < n; i++)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			lo[a] = std::min(lo[a], mesh.positions[i * 3 + a]);
+			hi[a] = std::max(hi[a], mesh.positions[i * 3 + a]);
+		}
+	}
+	float c[3] = { (lo[0] + hi[0]) * 0.5f, (lo[1] + hi[1]) * 0.5f, (lo[2] + hi[2]) * 0.5f };
+	float r_xz = 0, r_3d = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		float dx = mesh.positions[i * 3] - c[0], dy = mesh.positions[i * 3 + 1] - c[1], dz = mesh.positions[i * 3 + 2] - c[2];
+		r_xz = std::max(r_xz, sqrtf(dx * dx + dz * dz));
+		r_3d = std::max(r_3d, sqrtf(dx * dx + dy * dy + dz * dz));
+	}
+	float across = 1.0f / std::max(tilted ? r_3d : r_xz, 1e-6f);
+	float up = tilted ? across : 1.0f / std::max((hi[1] - lo[1]) * 0.5f, 1e-6f);
+	for (size_t i = 0; i < n; i++)
+	{
+		mesh.positions[i * 3] = (mesh.positions[i * 3] - c[0]) * across;
+		mesh.positions[i * 3 + 1] = (mesh.positions[i * 3 + 1] - c[1]) * up;
+		mesh.positions[i * 3 + 2] = (mesh.positions[i * 3 + 2] - c[2]) * across;
+	}
+}
+
+//Voxel holding point (x, y, z) relative to the middle of the volume, false
+//outside it
+inline bool voxelOf(float x, float y, float z, int& l, int& w, int& k)
+{
+	const float outer = VOXEL_RADIUS_0 + (WIDTH - 0.5f) * VOXEL_RADIAL_PITCH;
+	const float top = HEIGHT * VOXEL_LAYER_PITCH * 0.5f;
+	float r = sqrtf(x * x + z * z);
+	w = (int)floorf((r - VOXEL_RADIUS_0) / VOXEL_RADIAL_PITCH + 0.5f);
+	k = (int)floorf((y + top) / VOXEL_LAYER_PITCH);
+	//A fitted mesh reaches exactly the outer wall and the top, which belong
+	//to the last ring and layer rather than to the next one out
+	if (w == WIDTH && r <= outer * 1.0001f)
+		w = WIDTH - 1;
+	if (k == HEIGHT && y <= top * 1.0001f)
+		k = HEIGHT - 1;
+	if (w < 0 || w >= WIDTH || k < 0 || k >= HEIGHT)
+		return false;
+	float turn = atan2f(z, x) / (2.0f * (float)M_PI);
+	l = ((int)floorf(turn * LENGTH + 0.5f) % LENGTH + LENGTH) % LENGTH;
+	return true;
+}
+
+//One frame, RGB888 in frameToRGB layout, of mesh (already fitted) turned by
+//spin radians about the tilted axis
+void voxelizeFrame(const VoxelMesh& mesh, float spin, float tilt, bool solid, uint8_t* frame)
+{
+	//Rotate into place: tilt about z, spin about the vertical, then stretch
+	//the unit volume over the voxels
+	const float across = VOXEL_RADIUS_0 + (WIDTH - 0.5f) * VOXEL_RADIAL_PITCH;
+	const float up = HEIGHT * VOXEL_LAYER_PITCH * 0.5f;
+	size_t n = mesh.positions.size() / 3;
+	std::vector<float> p(n * 3);
+	float ct = cosf(tilt), st = sinf(tilt), cs = cosf(spin), ss = sinf(spin);
+	for (size_t i = 0; i < n; i++)
+	{
+		const float* v = &mesh.positions[i * 3];
+		float x = v[0] * ct - v[1] * st, y = v[0] * st + v[1] * ct, z = v[2];
+		p[i * 3] = (x * cs - z * ss) * across;
+		p[i * 3 + 1] = y * up;
+		p[i * 3 + 2] = (x * ss + z * cs) * across;
+	}
+
+	const int voxels = LENGTH * WIDTH * HEIGHT;
+	std::vector<uint32_t> sum(voxels * 3, 0);
+	std::vector<uint32_t> count(voxels, 0);
+	size_t tris = mesh.indices.size() / 3;
+
+	//Surface: sample every triangle on a grid finer than a voxel
+	for (size_t t = 0; t < tris; t++)
+	{
+		const uint32_t* idx = &mesh.indices[t * 3];
+		const float* a = &p[idx[0] * 3];
+		const float* b = &p[idx[1] * 3];
+		const float* c = &p[idx[2] * 3];
+		float edge = 0;
+		for (int e = 0; e < 3; e++)
+		{
+			const float* u = &p[idx[e] * 3];
+			const float* v = &p[idx[(e + 1) % 3] * 3];
+			edge = std::max(edge, sqrtf((u[0] - v[0]) * (u[0] - v[0]) + (u[1] - v[1]) * (u[1] - v[1]) + (u[2] - v[2]) * (u[2] - v[2])));
+		}
+		int steps = (int)ceilf(edge / VOXEL_SAMPLE_STEP);
+		steps = steps < 1 ? 1 : steps;
+		for (int i = 0; i <= steps; i++)
+		{
+			for (int j = 0; i + j <= steps; j++)
+			{
+				float wb = (float)i / steps, wc = (float)j / steps, wa = 1.0f - wb - wc;
+				int l, w, k;
+				if (!voxelOf(wa * a[0] + wb * b[0] + wc * c[0], wa * a[1] + wb * b[1] + wc * c[1], wa * a[2] + wb * b[2] + wc * c[2], l, w, k))
+					continue;
+				int v = (l * WIDTH + w) * HEIGHT + k;
+				for (int ch = 0; ch < 3; ch++)
+					sum[v * 3 + ch] += (uint32_t)(wa * mesh.colors[idx[0] * 3 + ch] + wb * mesh.colors[idx[1] * 3 + ch] + wc * mesh.colors[idx[2] * 3 + ch] + 0.5f);
+				count[v]++;
+			}
+		}
+	}
+
+	memset(frame, 0, REC_FRAME_BYTES);
+	for (int v = 0; v < voxels; v++)
+	{
+		if (count[v] == 0)
+			continue;
+		for (int ch = 0; ch < 3; ch++)
+			frame[v * 3 + ch] = (uint8_t)(sum[v * 3 + ch] / count[v]);
+	}
+	if (!solid)
+		return;
+
+	//Inside: a vertical ray through each column crosses the surface an even
+	//number of times, layers between an entry and an exit are inside. A ray
+	//through an edge or vertex shared by several triangles must hit exactly
+	//one of them or the parity flips, so the (x, z) coverage test uses exactly
+	//antisymmetric edge functions and a top-left rule for points on an edge
+	auto edgeFn = [](const float* u, const float* v, float x, float z) {
+		bool swap = u[0] > v[0] || (u[0] == v[0] && u[2] > v[2]);
+		const float* s = swap ? v : u;
+		const float* t = swap ? u : v;
+		double e = ((double)t[0] - s[0]) * ((double)z - s[2]) - ((double)t[2] - s[2]) * ((double)x - s[0]);
+		return swap ? -e : e;
+	};
+	//Directed edge of a counterclockwise triangle, exactly one direction owns it
+	auto ownsEdge = [](const float* u, const float* v) {
+		return v[2] > u[2] || (v[2] == u[2] && v[0] < u[0]);
+	};
+	struct Hit { float y; uint8_t rgb[3]; };
+	std::vector<Hit> hits;
+	for (int l = 0; l < LENGTH; l++)
+	{
+		float theta = 2.0f * (float)M_PI * l / LENGTH;
+		for (int w = 0; w < WIDTH; w++)
+		{
+			float r = VOXEL_RADIUS_0 + w * VOXEL_RADIAL_PITCH;
+			float x = r * cosf(theta), z = r * sinf(theta);
+			hits.clear();
+			for (size_t t = 0; t < tris; t++)
+			{
+				const uint32_t* idx = &mesh.indices[t * 3];
+				const float* a = &p[idx[0] * 3];
+				const float* b = &p[idx[1] * 3];
+				const float* c = &p[idx[2] * 3];
+				double ea = edgeFn(b, c, x, z), eb = edgeFn(c, a, x, z), ec = edgeFn(a, b, x, z);
+				double det = ea + eb + ec;
+				if (fabs(det) < 1e-12)
+					continue;           //Edge on to the ray
+				bool ccw = det > 0;
+				if (!ccw)
+				{
+					ea = -ea;
+					eb = -eb;
+					ec = -ec;
+					det = -det;
+				}
+				if (ea < 0 || (ea == 0 && !(ccw ? ownsEdge(b, c) : ownsEdge(c, b))) ||
+					eb < 0 || (eb == 0 && !(ccw ? ownsEdge(c, a) : ownsEdge(a, c))) ||
+					ec < 0 || (ec == 0 && !(ccw ? ownsEdge(a, b) : ownsEdge(b, a))))
+					continue;
+				float wa = (float)(ea / det), wb = (float)(eb / det), wc = (float)(ec / det);
+				Hit h;
+				h.y = wa * a[1] + wb * b[1] + wc * c[1];
+				for (int ch = 0; ch < 3; ch++)
+					h.rgb[ch] = (uint8_t)(wa * mesh.colors[idx[0] * 3 + ch] + wb * mesh.colors[idx[1] * 3 + ch] + wc * mesh.colors[idx[2] * 3 + ch] + 0.5f);
+				hits.push_back(h);
+			}
+			std::sort(hits.begin(), hits.end(), [](const Hit& u, const Hit& v) { return u.y < v.y; });
+			for (size_t i = 0; i + 1 < hits.size(); i += 2)
+			{
+				for (int k = 0; k < HEIGHT; k++)
+				{
+					float y = (k + 0.5f) * VOXEL_LAYER_PITCH - HEIGHT * VOXEL_LAYER_PITCH * 0.5f;
+					int v = (l * WIDTH + w) * HEIGHT + k;
+					if (y < hits[i].y || y > hits[i + 1].y || count[v] != 0)
+						continue;
+					for (int ch = 0; ch < 3; ch++)
+						frame[v * 3 + ch] = (uint8_t)((hits[i].rgb[ch] + hits[i + 1].rgb[ch] + 1) / 2);
+				}
+			}
+		}
+	}
+}
+
+//Frame f of the turn is the mesh spun by f / rotations of a turn
+void voxelizeRotations(const VoxelMesh& source, const VoxelizeOptions& options, std::vector<std::vector<uint8_t> >& frames)
+{
+	VoxelMesh mesh = source;
+	fitVoxelMesh(mesh, options.tilt_deg != 0);
+	float tilt = options.tilt_deg * (float)M_PI / 180.0f;
+	int count = options.rotations > 0 ? options.rotations : 1;
+	frames.assign(count, std::vector<uint8_t>(REC_FRAME_BYTES));
+	parallelFor(count, VOXEL_MAX_THREADS, [&](int f) {
+		voxelizeFrame(mesh, 2.0f * (float)M_PI * f / count, tilt, options.solid, &frames[f][0]);
+	});
+}
+
+bool bakeVoxelizedMesh(const char* mesh_path, const char* out_path, const VoxelizeOptions& options, float turns_per_second)
+{
+	VoxelMesh mesh;
+	if (!loadVoxelMesh(mesh_path, mesh))
+		return false;
+	std::vector<std::vector<uint8_t> > frames;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	voxelizeRotations(mesh, options, frames);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("Voxelizer: %zu triangles, %zu rotations in %.1f ms\n", mesh.indices.size() / 3, frames.size(), ms);
+
+	FrameRecorder recorder;
+	if (!recorder.create(out_path))
+		return false;
+	float tps = turns_per_second > 0 ? turns_per_second : 1.0f;
+	bool ok = true;
+	for (size_t f = 0; f < frames.size() && ok; f++)
+		ok = recorder.append(&frames[f][0], (uint64_t)(f * 1000000.0 / (tps * frames.size())));
+	return recorder.stop() && ok;
+}
+
+//Parses --voxelize mesh out.povr rotations turns_per_second [tilt_deg], false if it isn't argv[1].
+//out_path is NULL after a usage error
+bool parseVoxelizeArgs(int argc, char** argv, const char*& mesh_path, const char*& out_path, VoxelizeOptions& options, float& turns_per_second)
+{
+	if (argc < 2 || strcmp(argv[1], "--voxelize") != 0)
+		return false;
+	out_path = NULL;
+	if (argc < 6 || atoi(argv[4]) < 1 || atoi(argv[4]) > VOXEL_MAX_ROTATIONS)
+	{
+		printf("Usage: --voxelize mesh out.povr rotations(1-%d) turns_per_second [tilt_deg]\n", VOXEL_MAX_ROTATIONS);
+		return true;
+	}
+	mesh_path = argv[2];
+	out_path = argv[3];
+	options.rotations = atoi(argv[4]);
+	turns_per_second = (float)atof(argv[5]);
+	options.tilt_deg = argc > 6 ? (float)atof(argv[6]) : 0.0f;
+	options.solid = VOXEL_SOLID_FILL;
+	return true;
+}
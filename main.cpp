@@ -13,12 +13,82 @@
 #include <vector>
 #include <string>
 #include <thread>
+#include <memory>
+#include <future>
+#include <mutex>
+#include <unordered_map>
 #include <stdint.h>
+#include <chrono>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include "filesystem.h"
+#include "MeshOptimizer.h"
+#include "AssetLoader.h"
+
+//Zone profiler, dumps a Chrome trace to PROFILE_TRACE_FILE on exit. Has to be
+//set before FrameBuffer.h is included, see Profiler.h
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED false
+#endif
+//Offscreen capture needs EGL and the frame server POSIX shared memory,
+//neither is in the Windows build
+#ifndef HEADLESS_SUPPORT
+#ifdef _WIN32
+#define HEADLESS_SUPPORT false
+#else
+#define HEADLESS_SUPPORT true
+#endif
+#endif
+#ifndef FRAME_SERVER_SUPPORT
+#ifdef _WIN32
+#define FRAME_SERVER_SUPPORT false
+#else
+#define FRAME_SERVER_SUPPORT true
+#endif
+#endif
+#if HEADLESS_SUPPORT
+#include "Offscreen.h"
+#endif
 #include "POV_Thread.h"
+//Golden frame regression runs, plain file IO so every build has them
+#ifndef GOLDEN_FRAMES_SUPPORT
+#define GOLDEN_FRAMES_SUPPORT true
+#endif
+#if GOLDEN_FRAMES_SUPPORT
+#include "GoldenFrames.h"
+#endif
+//Sprite atlases are mapped with mmap
+#ifndef SPRITE_ATLAS_SUPPORT
+#ifdef _WIN32
+#define SPRITE_ATLAS_SUPPORT false
+#else
+#define SPRITE_ATLAS_SUPPORT true
+#endif
+#endif
+#if SPRITE_ATLAS_SUPPORT
+#include "SpriteAtlas.h"
+#endif
+//Image import bakes into recordings and sprite atlases
+#ifndef IMAGE_IMPORT_SUPPORT
+#define IMAGE_IMPORT_SUPPORT (SPRITE_ATLAS_SUPPORT && FRAME_RECORDING_SUPPORT)
+#endif
+#if IMAGE_IMPORT_SUPPORT
+#include "ImageImport.h"
+#endif
+//Voxelized meshes are baked into recordings
+#ifndef VOXELIZER_SUPPORT
+#define VOXELIZER_SUPPORT FRAME_RECORDING_SUPPORT
+#endif
+#if VOXELIZER_SUPPORT
+#include "Voxelizer.h"
+#endif
+#include "ScanOut.h"
+#include "MicroBench.h"
+#include <pov_display/LedPacking.h>
+#if FRAME_SERVER_SUPPORT
+#include "FrameServer.h"
+#endif
 #include <pov_display/FrameBuffer.h>
 
 
@@ -32,8 +102,32 @@
 using namespace std;
 
 #define USE_WIREFRAME false
-
+#define OPTIMIZE_MESHES true		//Weld duplicate STL vertices and reorder for the vertex cache
+#define QUANTIZE_MESHES true		//Pack untextured meshes to 16-bit positions/normals
+#define WELD_ANGLE_DEG 30.0f		//Max normal deviation for two vertices to be welded
+#define PRINT_MODEL_DRAW_TIME false	//Print GPU time of the enclosure pass
+#define ASYNC_MODEL_LOADING true	//Import models on worker threads while the viewer renders
+#define UPLOADS_PER_FRAME 1		//Max finished assets handed to GL per frame
+#define SKIP_IDLE_FRAMES true		//Only redraw when the LEDs, camera or assets changed
+#define IDLE_WAIT_TIMEOUT 0.005		//Seconds to block for input while idle, about one TICK_DELAY
+#define SCANOUT_EMULATOR false		//Emulate rotor slice timing and report deadline stats
+#define SCANOUT_RPM 1200.0f		//Rotor speed for the emulator
+#define SCANOUT_PUSH_US 0.0f		//Fake per-column LED push time added to each slice
+#define BENCH_LED_PACKING false		//Check and time the strip output packers at startup
+#define FRAME_SERVER true		//Let other processes draw through shared memory
+#define BENCH_FRAME_SERVER false	//Time shared memory frame handoff at startup
+#define UDP_INGEST true			//Accept frames over UDP on localhost
+#define UDP_INGEST_PORT 4048
+#define BENCH_UDP_INGEST false		//Stream frames to ourselves over UDP at startup
+#define RECORD_FILE ""			//Record every displayed frame to this file
+#define PLAYBACK_FILE ""		//Loop this recording instead of running main_exec
+#define PLAYBACK_SPEED 1.0f
+#define SPRITE_ATLAS_FILE ""		//Item sprites for the games, the compiled in ones when empty
+
+struct TextureData;
 unsigned int TextureFromFile(const char* path, const string& directory);
+bool DecodeTexture(const string& filename, TextureData& out);
+unsigned int UploadTexture(TextureData& tex);
 struct Vertex {
 	glm::vec3 Position;
 	glm::vec3 Normal;
@@ -43,9 +137,112 @@ struct Vertex {
 struct Texture {
 	unsigned int id;
 	string type;
-	string path;
+	string path;	//Resolved file path, doubles as the TextureCache key
+};
+
+//Decoded image waiting for its GL upload
+struct TextureData {
+	unsigned char* pixels;
+	int width, height, nrComponents;
 };
 
+//CPU side of a mesh, everything Mesh needs except the GL objects
+struct MeshData {
+	vector<Vertex> vertices;
+	vector<unsigned int> indices;
+	vector<Texture> textures;	//ids are filled in from the TextureCache on upload
+};
+
+//Process-wide texture cache keyed by resolved path. The first mesh that
+//references an image decodes it, later references (from any model or loader
+//thread) wait for that decode and share the same GL texture. Entries are
+//reference counted by the meshes using them.
+class TextureCache {
+	public:
+		//Loader side: takes a reference and returns once the image is decoded
+		bool acquire(const string& key);
+		//GL thread: creates the GL texture on first use, returns the shared id
+		unsigned int getTexture(const string& key);
+		//GL thread: drops a reference, the texture is deleted with the last one
+		void release(const string& key);
+		size_t size();
+
+	private:
+		struct Entry {
+			unsigned int id;
+			int refs;
+			TextureData data;
+			std::shared_future<bool> decoded;
+		};
+		std::unordered_map<string, std::unique_ptr<Entry>> entries;
+		std::mutex cache_mutex;
+};
+TextureCache textureCache;
+
+bool TextureCache::acquire(const string& key)
+{
+	std::promise<bool> decode_promise;
+	std::shared_future<bool> decoded;
+	Entry* entry;
+	bool owner = false;
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		std::unique_ptr<Entry>& slot = entries[key];
+		if (!slot)
+		{
+			slot.reset(new Entry());
+			slot->id = 0;
+			slot->refs = 0;
+			slot->data.pixels = NULL;
+			slot->decoded = decode_promise.get_future().share();
+			owner = true;
+		}
+		slot->refs++;
+		entry = slot.get();
+		decoded = slot->decoded;
+	}
+
+	if (owner)
+	{
+		//Decode outside the lock so different images still load in parallel
+		decode_promise.set_value(DecodeTexture(key, entry->data));
+	}
+	return decoded.get();
+}
+unsigned int TextureCache::getTexture(const string& key)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	auto it = entries.find(key);
+	if (it == entries.end())
+		return 0;
+
+	Entry* entry = it->second.get();
+	if (entry->id == 0)
+		entry->id = UploadTexture(entry->data);
+	return entry->id;
+}
+void TextureCache::release(const string& key)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	auto it = entries.find(key);
+	if (it == entries.end())
+		return;
+
+	Entry* entry = it->second.get();
+	if (--entry->refs > 0)
+		return;
+	if (entry->id != 0)
+		glDeleteTextures(1, &entry->id);
+	if (entry->data.pixels != NULL)
+		stbi_image_free(entry->data.pixels);
+	entries.erase(it);
+}
+size_t TextureCache::size()
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	return entries.size();
+}
+
 class Mesh {
 	public:
 		// Mesh Data
@@ -53,23 +250,57 @@ class Mesh {
 		vector<unsigned int> indices;
 		vector<Texture> textures;
 
-		Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures);
+		Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures);
+		Mesh(Mesh&& other);
+		Mesh(const Mesh&) = delete;
+		Mesh& operator=(const Mesh&) = delete;
+		~Mesh();
 		void Draw(Shader &shader);
+		size_t gpuBytes() { return vertex_bytes + index_bytes; }
 	
 	private:
 		//Render data
 		unsigned int VAO, VBO, EBO;
+		GLenum index_type;
+		size_t vertex_bytes, index_bytes;
+		bool quantized;
+		glm::vec3 pos_offset, pos_scale;
 		void setupMesh();
 };
 
-Mesh::Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+Mesh::Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures)
 {
-	this->vertices = vertices;
-	this->indices = indices;
-	this->textures = textures;
+	this->vertices = std::move(vertices);
+	this->indices = std::move(indices);
+	this->textures = std::move(textures);
 
 	setupMesh();
 }
+Mesh::Mesh(Mesh&& other)
+	: vertices(std::move(other.vertices)), indices(std::move(other.indices)), textures(std::move(other.textures)),
+	VAO(other.VAO), VBO(other.VBO), EBO(other.EBO), index_type(other.index_type),
+	vertex_bytes(other.vertex_bytes), index_bytes(other.index_bytes), quantized(other.quantized),
+	pos_offset(other.pos_offset), pos_scale(other.pos_scale)
+{
+	//Moved-from mesh no longer owns any GL objects or texture references
+	other.VAO = 0;
+	other.VBO = 0;
+	other.EBO = 0;
+	other.textures.clear();
+}
+Mesh::~Mesh()
+{
+	if (VAO != 0)
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+	}
+	for (unsigned int i = 0; i < textures.size(); i++)
+	{
+		textureCache.release(textures[i].path);
+	}
+}
 void Mesh::setupMesh()
 {
 	glGenVertexArrays(1, &VAO);
@@ -79,20 +310,62 @@ void Mesh::setupMesh()
 	glBindVertexArray(VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+	//Texcoords can't survive the 16-bit packing, only quantize untextured meshes (STLs)
+	quantized = QUANTIZE_MESHES && textures.empty();
+	pos_offset = glm::vec3(0.0f);
+	pos_scale = glm::vec3(1.0f);
+	if (quantized)
+	{
+		vector<QuantizedVertex> packed;
+		MeshOptimizer::quantizeVertices(vertices, packed, pos_offset, pos_scale);
+		vertex_bytes = packed.size() * sizeof(QuantizedVertex);
+		glBufferData(GL_ARRAY_BUFFER, vertex_bytes, &packed[0], GL_STATIC_DRAW);
+	}
+	else
+	{
+		vertex_bytes = vertices.size() * sizeof(Vertex);
+		glBufferData(GL_ARRAY_BUFFER, vertex_bytes, &vertices[0], GL_STATIC_DRAW);
+	}
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+	if (QUANTIZE_MESHES && vertices.size() <= 0xFFFF)
+	{
+		vector<uint16_t> short_indices(indices.begin(), indices.end());
+		index_type = GL_UNSIGNED_SHORT;
+		index_bytes = short_indices.size() * sizeof(uint16_t);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_bytes, &short_indices[0], GL_STATIC_DRAW);
+	}
+	else
+	{
+		index_type = GL_UNSIGNED_INT;
+		index_bytes = indices.size() * sizeof(unsigned int);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_bytes, &indices[0], GL_STATIC_DRAW);
+	}
 
-	//Vertex positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+	if (quantized)
+	{
+		//Normalized shorts, posOffset/posScale undo the bounds mapping in the shader
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, Position));
+
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_SHORT, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, Normal));
+
+		//No texcoord stream, attribute 2 reads the constant (0, 0)
+		glDisableVertexAttribArray(2);
+	}
+	else
+	{
+		//Vertex positions
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
 
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
 
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+	}
 
 	glBindVertexArray(0);
 }
@@ -117,9 +390,12 @@ void Mesh::Draw(Shader& shader)
 	}
 	glActiveTexture(GL_TEXTURE0);
 
+	shader.setVec3("posOffset", pos_offset);
+	shader.setVec3("posScale", pos_scale);
+
 	//Draw mesh
 	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, indices.size(), index_type, 0);
 	glBindVertexArray(0);
 }
 
@@ -133,17 +409,25 @@ class Model
 			loadModel(path);
 		}
 		void loadModel(string path);
+		void loadModelAsync(string path, AssetLoader& loader);
+		bool isLoaded() { return loaded; }
+		void unload();
 		void Draw(Shader& shader);
+		size_t gpuBytes();
 	private:
 		//Model data
 		vector<Mesh> meshes;
 		string directory;
-		vector<Texture> textures_loaded;
+		bool loaded = false;
 
-		
-		void processNode(aiNode *node, const aiScene *scene);
-		Mesh processMesh(aiMesh* mesh, const aiScene* scene);
+		//CPU stage, safe to run on any thread
+		bool importModel(string path, vector<MeshData>& mesh_data);
+		void processNode(aiNode *node, const aiScene *scene, vector<MeshData>& mesh_data);
+		MeshData processMesh(aiMesh* mesh, const aiScene* scene);
 		vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName);
+
+		//GL stage, GL thread only
+		void uploadMeshes(vector<MeshData>& mesh_data);
 };
 void Model::Draw(Shader& shader)
 {
@@ -152,7 +436,34 @@ void Model::Draw(Shader& shader)
 		meshes[i].Draw(shader);
 	}
 }
+size_t Model::gpuBytes()
+{
+	size_t bytes = 0;
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		bytes += meshes[i].gpuBytes();
+	}
+	return bytes;
+}
 void Model::loadModel(string path)
+{
+	vector<MeshData> mesh_data;
+	if (importModel(path, mesh_data))
+		uploadMeshes(mesh_data);
+}
+void Model::loadModelAsync(string path, AssetLoader& loader)
+{
+	loader.submit([this, path, &loader]() {
+		//Shared so the upload closure stays copyable for std::function
+		std::shared_ptr<vector<MeshData>> mesh_data = std::make_shared<vector<MeshData>>();
+		if (!importModel(path, *mesh_data))
+			return;
+		loader.queueUpload([this, mesh_data]() {
+			uploadMeshes(*mesh_data);
+		});
+	});
+}
+bool Model::importModel(string path, vector<MeshData>& mesh_data)
 {
 	Assimp::Importer import;
 	const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
@@ -160,31 +471,53 @@ void Model::loadModel(string path)
 	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 	{
 		cout << "Error::ASSIMP::" << import.GetErrorString() << endl;
-		return;
+		return false;
 	}
 	directory = path.substr(0, path.find_last_of('/'));
-	processNode(scene->mRootNode, scene);
+	processNode(scene->mRootNode, scene, mesh_data);
+	return true;
 }
-void Model::processNode(aiNode* node, const aiScene* scene)
+void Model::uploadMeshes(vector<MeshData>& mesh_data)
+{
+	meshes.reserve(meshes.size() + mesh_data.size());
+	for (unsigned int i = 0; i < mesh_data.size(); i++)
+	{
+		MeshData& data = mesh_data[i];
+		for (unsigned int j = 0; j < data.textures.size(); j++)
+		{
+			data.textures[j].id = textureCache.getTexture(data.textures[j].path);
+		}
+		meshes.emplace_back(std::move(data.vertices), std::move(data.indices), std::move(data.textures));
+	}
+	loaded = true;
+}
+void Model::unload()
+{
+	//Must run while the GL context is still alive
+	meshes.clear();
+	loaded = false;
+}
+void Model::processNode(aiNode* node, const aiScene* scene, vector<MeshData>& mesh_data)
 {
 	//Process all the node's meshes (if any)
 	for (unsigned int i = 0; i < node->mNumMeshes; i++)
 	{
 		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		meshes.push_back(processMesh(mesh, scene));
+		mesh_data.push_back(processMesh(mesh, scene));
 	}
 
 	//Process child nodes
 	for (unsigned int i = 0; i < node->mNumChildren; i++)
 	{
-		processNode(node->mChildren[i], scene);
+		processNode(node->mChildren[i], scene, mesh_data);
 	}
 }
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
+MeshData Model::processMesh(aiMesh* mesh, const aiScene* scene)
 {
-	vector<Vertex> vertices;
-	vector<unsigned int> indices;
-	vector<Texture> textures;
+	MeshData data;
+	vector<Vertex>& vertices = data.vertices;
+	vector<unsigned int>& indices = data.indices;
+	vector<Texture>& textures = data.textures;
 
 	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 	{
@@ -226,6 +559,16 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
 		}
 	}
 
+	if (OPTIMIZE_MESHES)
+	{
+		MeshStats before = MeshOptimizer::getStats(vertices, indices);
+		MeshOptimizer::optimizeMesh(vertices, indices, WELD_ANGLE_DEG);
+		MeshStats after = MeshOptimizer::getStats(vertices, indices);
+		printf("Mesh optimized: %zu -> %zu verts, %zu -> %zu tris, ACMR %.3f -> %.3f, %zu KB unoptimized\n",
+			before.num_vertices, after.num_vertices, before.num_indices / 3, after.num_indices / 3, before.acmr, after.acmr,
+			(before.vertex_bytes + before.index_bytes) / 1024);
+	}
+
 	//Process materai
 	if (mesh->mMaterialIndex >= 0)
 	{
@@ -235,7 +578,7 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
 		vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
 		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
 	}
-	return Mesh(vertices, indices, textures);
+	return data;
 }
 vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
 {
@@ -244,39 +587,43 @@ vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type,
 	{
 		aiString str;
 		mat->GetTexture(type, i, &str);
-		bool skip = false;
-		for (unsigned int j = 0; j < textures_loaded.size(); j++)
-		{
-			if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-			{
-				textures.push_back(textures_loaded[j]);
-				skip = true;
-				break;
-			}
-		}
-		if (!skip)
-		{
-			//Textures need to be loaded
-			Texture texture;
-			texture.id = TextureFromFile(str.C_Str(), directory);
-			texture.type = typeName;
-			texture.path = str.C_Str();
-			textures.push_back(texture);
-		}
+
+		//Hash lookup in the shared cache, only the first reference decodes the file
+		Texture texture;
+		texture.id = 0;
+		texture.type = typeName;
+		texture.path = directory + '/' + string(str.C_Str());
+		textureCache.acquire(texture.path);
+		textures.push_back(texture);
 	}
 
 	return textures;
 }
 unsigned int TextureFromFile(const char* path, const string& directory)
 {
-	string filename = string(path);
-	filename = directory + '/' + filename;
-
+	TextureData tex;
+	DecodeTexture(directory + '/' + string(path), tex);
+	return UploadTexture(tex);
+}
+bool DecodeTexture(const string& filename, TextureData& out)
+{
+	out.pixels = stbi_load(filename.c_str(), &out.width, &out.height, &out.nrComponents, 0);
+	if (!out.pixels)
+	{
+		std::cout << "Texture failed to load at path: " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
+unsigned int UploadTexture(TextureData& tex)
+{
 	unsigned int textureID;
 	glGenTextures(1, &textureID);
 
-	int width, height, nrComponents;
-	unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+	int width = tex.width;
+	int height = tex.height;
+	int nrComponents = tex.nrComponents;
+	unsigned char* data = tex.pixels;
 	if (data)
 	{
 		GLenum format;
@@ -297,11 +644,7 @@ unsigned int TextureFromFile(const char* path, const string& directory)
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
 		stbi_image_free(data);
-	}
-	else
-	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
+		tex.pixels = NULL;
 	}
 
 	return textureID;
@@ -328,12 +671,34 @@ float yaw = -90.0f;
 float fov = 45.0f;
 bool firstMouse = true;
 
+bool view_dirty = true;
 void framebuffser_size_callback(GLFWwindow* window, int width, int height)
 {
 	glViewport(0, 0, width, height);
+	view_dirty = true;
+}
+
+//Window was exposed or damaged, idle frames can't just keep the old image
+void window_refresh_callback(GLFWwindow* window)
+{
+	view_dirty = true;
 }
 
 bool enclosure_top_visible = true;
+
+//FNV-1a over everything renderScene() reads besides the LED buffer
+uint32_t viewStateHash()
+{
+	float state[7] = { yaw_alt, pitch_alt, fov, cam_radius, lightPos.x, lightPos.y, lightPos.z };
+	uint32_t hash = 2166136261u;
+	const uint8_t* bytes = (const uint8_t*)state;
+	for (unsigned int i = 0; i < sizeof(state); i++)
+	{
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	hash = (hash ^ (uint8_t)enclosure_top_visible) * 16777619u;
+	return hash;
+}
 struct ButtonStatus button_status;
 void processInput(GLFWwindow* window)
 {
@@ -582,52 +947,352 @@ float vertices[] = {
 };
 
 
-int main()
+#if FRAME_SERVER_SUPPORT
+FrameServer frame_server;
+#endif
+
+//Frames from a frame server client take over from main_exec while one is publishing
+const frameBuffer* selectLedFrame(doubleBuffer& arduino_buffer, uint32_t* seq)
+{
+	PROFILE_FUNCTION();
+#if FRAME_SERVER_SUPPORT
+	uint32_t client_seq;
+	const frameBuffer* fb = frame_server.acquire(&client_seq);
+	if (fb != NULL)
+	{
+		//Top bit keeps it apart from the doubleBuffer sequence
+		*seq = client_seq | 0x80000000u;
+		return fb;
+	}
+#endif
+	*seq = arduino_buffer.getFrameSequence();
+	return arduino_buffer.getReadBuffer();
+}
+
+//GL objects shared by the window and headless render paths
+struct ViewerScene {
+	Shader* modelShader;
+	Shader* lightCubeShader;
+	Shader* ledShader;
+	Model* enclosure_models;
+	unsigned int lightCubeVAO;
+	unsigned int modelTimeQuery;
+	GLuint64 model_time_ns;
+	int model_time_frames;
+};
+
+//Draws enclosure, light cube and LED pass into the currently bound framebuffer
+void renderScene(ViewerScene& scene, const frameBuffer* rBuf, float aspect)
+{
+	PROFILE_FUNCTION();
+	//Rendering commands here
+	glClearColor(0.15f, 0.15f, 0.15f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+
+	glm::vec3 box_pos = glm::vec3(1.0f, 0.0f, 0.0);
+	glm::vec4 box_vec = glm::vec4(box_pos, 1.0f);
+	glm::mat4 box_transform = glm::mat4(1.0f);
+	box_transform = glm::rotate(box_transform, glm::radians(yaw_alt), glm::vec3(0.0f, 1.0f, 0.0f));
+	box_vec = box_transform * box_vec;
+	box_pos = glm::vec3(box_vec.x, box_vec.y, box_vec.z);
+	glm::vec3 axis = glm::cross(box_pos, glm::vec3(0.0f, 1.0f, 0.0f));
+
+	box_transform = glm::mat4(1.0f);
+	box_transform = glm::rotate(box_transform, glm::radians(pitch_alt), axis);
+	box_vec = box_transform * box_vec;
+	box_pos = cam_radius * glm::vec3(box_vec.x, box_vec.y, box_vec.z);
+	static bool first = true;
+	if (first) {
+		printf("box_pos = (%f, %f, %f)\n", box_pos.x, box_pos.y, box_pos.z);
+		first = false;
+	}
+	
+
+	//Draw Models
+	PROFILE_BEGIN(model_zone, "model pass");
+	scene.modelShader->use();
+
+	scene.modelShader->setVec3("light.position", lightPos);
+	//scene.modelShader->setVec3("viewPos", cameraPos);
+	scene.modelShader->setVec3("viewPos", box_pos);
+
+	// light properties
+	scene.modelShader->setVec3("light.ambient", 1.0f, 1.0f, 1.0f); // note that all light colors are set at full intensity
+	scene.modelShader->setVec3("light.diffuse", 1.0f, 1.0f, 1.0f);
+	scene.modelShader->setVec3("light.specular", 1.0f, 1.0f, 1.0f);
+
+	// material properties
+	scene.modelShader->setVec3("material.ambient", 0.0f, 0.1f, 0.06f);
+	scene.modelShader->setVec3("material.diffuse", 0.0f, 0.50980392f, 0.50980392f);
+	scene.modelShader->setVec3("material.specular", 0.50196078f, 0.50196078f, 0.50196078f);
+	scene.modelShader->setFloat("material.shininess", 32.0f);
+
+	glm::mat4 projection = glm::perspective(glm::radians(fov), aspect, 0.1f, 300.0f);
+	//glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+	glm::mat4 view = glm::lookAt(box_pos, glm::vec3(0.0f, 20.0f, 0.0f), cameraUp);
+
+
+	scene.modelShader->setMat4("projection", projection);
+	scene.modelShader->setMat4("view", view);
+
+	glm::mat4 model = glm::mat4(1.0f);
+	//model = glm::rotate(model, glm::radians(5.0f * glfwGetTime()), glm::vec3(0.0f, 1.0f, 0.0f));
+	//model = glm::rotate(model, (float)(0.5f * time), glm::vec3(0.0f, 1.0f, 0.0f));
+	//model = glm::translate(model, glm::vec3(0.0f, 4.0f, 0.0f));
+	//model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
+	scene.modelShader->setMat4("model", model);
+	if (PRINT_MODEL_DRAW_TIME)
+		glBeginQuery(GL_TIME_ELAPSED, scene.modelTimeQuery);
+	for (int i = 0; i < 3; i++)
+	{
+		if (i != 2) {
+			scene.enclosure_models[i].Draw(*scene.modelShader);
+		}
+		else if (enclosure_top_visible) {
+			/*
+			glm::mat4 model = glm::mat4(1.0f);
+			model = glm::translate(model, glm::vec3(0.0f, 7.45f, 0.0f));
+			model = glm::rotate(model, (float)(0.5f * time) + glm::radians(22.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+			model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+
+
+			//model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
+			scene.modelShader->setMat4("model", model);
+			scene.enclosure_models[i].Draw(*scene.modelShader);
+			*/
+			glm::mat4 model = glm::mat4(1.0f);
+			model = glm::translate(model, glm::vec3(0.0f, 74.2f, 0.0f));
+			//model = glm::rotate(model, (float)(0.5f * time) + glm::radians(22.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+			model = glm::rotate(model, glm::radians(22.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+			model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+
+
+			//model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
+			scene.modelShader->setMat4("model", model);
+			scene.enclosure_models[i].Draw(*scene.modelShader);
+		}
+	}
+	if (PRINT_MODEL_DRAW_TIME)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		GLuint64 elapsed_ns;
+		glGetQueryObjectui64v(scene.modelTimeQuery, GL_QUERY_RESULT, &elapsed_ns);
+		scene.model_time_ns += elapsed_ns;
+		if (++scene.model_time_frames == 100)
+		{
+			printf("Enclosure draw: %.3f ms/frame\n", scene.model_time_ns / (scene.model_time_frames * 1.0e6));
+			scene.model_time_ns = 0;
+			scene.model_time_frames = 0;
+		}
+	}
+	PROFILE_END(model_zone);
+
+	//Draw Light cube
+	scene.lightCubeShader->use();
+	scene.lightCubeShader->setMat4("projection", projection);
+	scene.lightCubeShader->setMat4("view", view);
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, lightPos);
+	//model = glm::scale(model, glm::vec3(0.2f)); // a smaller cube
+	scene.lightCubeShader->setMat4("model", model);
+
+	glBindVertexArray(scene.lightCubeVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 36);
+
+
+	PROFILE_ZONE("LED pass");
+	scene.ledShader->use();
+	scene.ledShader->setMat4("projection", projection);
+	scene.ledShader->setMat4("view", view);
+	for (int k = 0; k < HEIGHT; k++) {
+		for (int i = 0; i < LENGTH; i++) {
+			for (int j = 0; j < WIDTH; j++) {
+				uint8_t r, g, b;
+				rBuf->getPixel(i, j, k, &r, &g, &b);
+				if ((r | g | b) == 0)
+					continue;
+				glm::vec3 ledColor = glm::vec3(r / 255.0f, g / 255.0f, b / 255.0f);
+				
+				scene.ledShader->setVec3("ledColor", ledColor);
+				model = glm::mat4(1.0f);
+				model = glm::rotate(model, glm::radians(3.75f * -i), glm::vec3(0.0f, 1.0f, 0.0f));
+				model = glm::translate(model, glm::vec3(35.0f + j * 5.0f, 20.1f + 7.6*k, 0.0f));
+				model = glm::scale(model, glm::vec3(2.0f, 1.0f, 2.0f));
+				scene.ledShader->setMat4("model", model);
+				glDrawArrays(GL_TRIANGLES, 0, 36);
+			}
+		}
+	}
+}
+
+
+int main(int argc, char** argv)
 {
 	printf("Hello World\n");
+#if GOLDEN_FRAMES_SUPPORT
+	//Regression run, nothing else may draw first since scenes keep static state
+	GOLDEN_MODE golden_mode;
+	const char* golden_dir;
+	const char* golden_scene;
+	if (parseGoldenArgs(argc, argv, golden_mode, golden_dir, golden_scene))
+		return golden_dir != NULL ? runGoldenFrames(golden_mode, golden_dir, golden_scene) : 1;
+#endif
+	const char* microbench_json;
+	const char* microbench_filter;
+	if (parseMicroBenchArgs(argc, argv, microbench_json, microbench_filter))
+		return runMicroBenchmarks(microbench_json, microbench_filter);
+#if SPRITE_ATLAS_SUPPORT
+	const char* atlas_path;
+	int atlas_cell_w, atlas_cell_h;
+	const char* const* atlas_sheets;
+	int atlas_num_sheets;
+	if (parseSpriteAtlasArgs(argc, argv, atlas_path, atlas_cell_w, atlas_cell_h, atlas_sheets, atlas_num_sheets))
+		return atlas_path != NULL && buildSpriteAtlas(atlas_path, atlas_cell_w, atlas_cell_h, atlas_sheets, atlas_num_sheets) ? 0 : 1;
+#endif
+#if IMAGE_IMPORT_SUPPORT
+	int import_surface;
+	const char* import_path;
+	float import_fps;
+	const char* const* import_images;
+	int import_count;
+	if (parseImportArgs(argc, argv, import_surface, import_path, import_fps, import_images, import_count))
+		return import_path != NULL && bakeImport(import_surface, import_path, import_fps, import_images, import_count) ? 0 : 1;
+#endif
+#if VOXELIZER_SUPPORT
+	const char* voxel_mesh;
+	const char* voxel_path;
+	VoxelizeOptions voxel_options;
+	float voxel_tps;
+	if (parseVoxelizeArgs(argc, argv, voxel_mesh, voxel_path, voxel_options, voxel_tps))
+		return voxel_path != NULL && bakeVoxelizedMesh(voxel_mesh, voxel_path, voxel_options, voxel_tps) ? 0 : 1;
+#endif
+#if SPRITE_ATLAS_SUPPORT
+	//Mapped for the whole run, the games draw straight from it
+	SpriteAtlas sprite_atlas;
+	if (strlen(SPRITE_ATLAS_FILE) > 0 && sprite_atlas.open(SPRITE_ATLAS_FILE))
+		setSpriteFrames(sprite_atlas.frames(), sprite_atlas.frameCount());
+#endif
+#if HEADLESS_SUPPORT
+	//Before anything starts, a typo shouldn't silently open a window instead
+	HeadlessOptions headless_opts;
+	bool headless;
+	if (!parseHeadlessArgs(argc, argv, headless_opts, headless))
+		return 1;
+#endif
+	PROFILE_THREAD("render");
+	if (BENCH_LED_PACKING)
+		benchLedPacking(SCANOUT_RPM);
+#if FRAME_SERVER_SUPPORT
+	if (BENCH_FRAME_SERVER)
+		benchFrameServer();
+#endif
 
 	//Start thread
 	doubleBuffer arduino_buffer;
 	struct ThreadData thread_data;
 	thread_data.thread_running = true;
+#if UDP_INGEST_SUPPORT
+	UdpFrameReceiver udp_receiver;
+	thread_data.udp_receiver = NULL;
+	if (BENCH_UDP_INGEST)
+	{
+		benchUdpIngest(UDP_INGEST_PORT, 0.0f, 2.0f);
+		benchUdpIngest(UDP_INGEST_PORT, 200.0f, 2.0f);
+	}
+	if (UDP_INGEST && udp_receiver.start(UDP_INGEST_PORT))
+		thread_data.udp_receiver = &udp_receiver;
+#endif
+#if FRAME_RECORDING_SUPPORT
+	FrameRecorder recorder;
+	FramePlayer player;
+	thread_data.player = NULL;
+	thread_data.playback_speed = PLAYBACK_SPEED;
+	if (strlen(PLAYBACK_FILE) > 0 && player.open(PLAYBACK_FILE))
+		thread_data.player = &player;
+	if (strlen(RECORD_FILE) > 0)
+		recorder.start(RECORD_FILE, &arduino_buffer);
+#endif
 	thread th1(thread_main, &thread_data, &arduino_buffer, &button_status);
-
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-	GLFWwindow* window = glfwCreateWindow(800, 600, "LearnOpenGL", NULL, NULL);
-	if (window == NULL)
+	ScanOutEmulator scan_out(&arduino_buffer, SCANOUT_RPM, SCANOUT_PUSH_US);
+	if (SCANOUT_EMULATOR)
+		scan_out.start();
+#if FRAME_SERVER_SUPPORT
+	if (FRAME_SERVER)
+		frame_server.create();
+#endif
+	//Every exit from here on goes through this, a still joinable th1 would terminate()
+	auto stopThreads = [&]() {
+		scan_out.stop();
+		thread_data.thread_running = false;
+		th1.join();
+		PROFILE_WRITE_TRACE(PROFILE_TRACE_FILE);
+	};
+
+#if HEADLESS_SUPPORT
+	HeadlessContext headless_context;
+	GLFWwindow* window = NULL;
+	if (headless)
 	{
-		cout << "Failed to create GLFW window" << endl;
-		glfwTerminate();
-		return -1;
+		//No window, render into an FBO on an EGL context instead
+		if (!headless_context.create())
+		{
+			stopThreads();
+			return -1;
+		}
+		if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+		{
+			cout << "Failed to initialize GLAD" << endl;
+			headless_context.destroy();
+			stopThreads();
+			return -1;
+		}
 	}
-	glfwMakeContextCurrent(window);
-
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	else
+#else
+	GLFWwindow* window = NULL;
+#endif
 	{
-		cout << "Failed to initialize GLAD" << endl;
-		return -1;
+		glfwInit();
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+		window = glfwCreateWindow(800, 600, "LearnOpenGL", NULL, NULL);
+		if (window == NULL)
+		{
+			cout << "Failed to create GLFW window" << endl;
+			glfwTerminate();
+			stopThreads();
+			return -1;
+		}
+		glfwMakeContextCurrent(window);
+
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+		{
+			cout << "Failed to initialize GLAD" << endl;
+			glfwTerminate();
+			stopThreads();
+			return -1;
+		}
+
+		//Set callback functions
+		//glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+		glfwSetCursorPosCallback(window, mouse_callback);
+		glfwSetScrollCallback(window, scroll_callback);
+		glfwSetMouseButtonCallback(window, mouse_button_callback);
+		glViewport(0, 0, 800, 600);
+		glfwSetFramebufferSizeCallback(window, framebuffser_size_callback);
+		glfwSetWindowRefreshCallback(window, window_refresh_callback);
 	}
 
 	if (USE_WIREFRAME)
 		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-
-	//Set callback functions
-	//glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-	glfwSetCursorPosCallback(window, mouse_callback);
-	glfwSetScrollCallback(window, scroll_callback);
-	glfwSetMouseButtonCallback(window, mouse_button_callback);
 	glEnable(GL_DEPTH_TEST);
 
 	// tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
 	stbi_set_flip_vertically_on_load(true);
 
-	glViewport(0, 0, 800, 600);
-	glfwSetFramebufferSizeCallback(window, framebuffser_size_callback);
-
 	Shader ourShader("model_loading.vs", "model_loading.fs");
 	//string path_str = FileSystem::getPath("resources\\backpack\\backpack.obj"); 
 	string path_str0 = FileSystem::getPath("enclosure_body.stl");
@@ -638,11 +1303,23 @@ int main()
 
 
 	Model enclosure_models[3];
-	enclosure_models[0].loadModel((char*)path_str0.c_str());
-	enclosure_models[1].loadModel((char*)path_str1.c_str());
-	enclosure_models[2].loadModel((char*)path_str2.c_str());
+	AssetLoader asset_loader;
+	auto load_start = std::chrono::steady_clock::now();
+	bool models_reported = false;
+	if (ASYNC_MODEL_LOADING)
+	{
+		//Enclosure streams in while the LEDs are already being drawn
+		enclosure_models[0].loadModelAsync(path_str0, asset_loader);
+		enclosure_models[1].loadModelAsync(path_str1, asset_loader);
+		enclosure_models[2].loadModelAsync(path_str2, asset_loader);
+	}
+	else
+	{
+		enclosure_models[0].loadModel((char*)path_str0.c_str());
+		enclosure_models[1].loadModel((char*)path_str1.c_str());
+		enclosure_models[2].loadModel((char*)path_str2.c_str());
+	}
 	//Model ourModel((char*)path_str0.c_str());
-	cout << "Models loaded" << endl;
 	
 	//Light cube
 	//glm::vec3 lightPos(20.0f, 15.0f, 2.0f);
@@ -662,156 +1339,111 @@ int main()
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(0);
 
+	ViewerScene scene;
+	scene.modelShader = &ourShader;
+	scene.lightCubeShader = &lightCubeShader;
+	scene.ledShader = &ledShader;
+	scene.enclosure_models = enclosure_models;
+	scene.lightCubeVAO = lightCubeVAO;
+	glGenQueries(1, &scene.modelTimeQuery);
+	scene.model_time_ns = 0;
+	scene.model_time_frames = 0;
+
+
+#if HEADLESS_SUPPORT
+	if (headless)
+	{
+		//Every captured frame should contain the full enclosure
+		while (!asset_loader.idle())
+		{
+			if (asset_loader.processUploads() == 0)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		printf("Model load time: %.1f ms\n",
+			std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count());
+
+		FrameCapture capture(headless_opts.width, headless_opts.height, headless_opts);
+		float aspect = (float)headless_opts.width / (float)headless_opts.height;
+		auto render_start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < headless_opts.frames; frame++)
+		{
+			//The display thread ticks on its own clock. Unpaced, each capture
+			//shows whatever frame is current when it renders, so scene time
+			//between captures depends on render speed; --fps fixes it
+			if (headless_opts.fps > 0.0f)
+				std::this_thread::sleep_until(render_start + std::chrono::microseconds((int64_t)(frame * 1000000.0 / headless_opts.fps)));
+			headlessCameraPath(headless_opts, frame, &yaw_alt, &pitch_alt);
+			capture.begin();
+			uint32_t frame_seq;
+			renderScene(scene, selectLedFrame(arduino_buffer, &frame_seq), aspect);
+			capture.end(frame);
+		}
+		capture.finish();
+		double render_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - render_start).count();
+		printf("Headless: %d frames (%dx%d) in %.1f ms, %.1f frames/s, %d written, %d failed\n",
+			headless_opts.frames, headless_opts.width, headless_opts.height, render_ms,
+			headless_opts.frames * 1000.0 / render_ms, capture.framesWritten(), capture.framesFailed());
+		int capture_failed = capture.framesFailed();
+
+		for (int i = 0; i < 3; i++)
+		{
+			enclosure_models[i].unload();
+		}
+		headless_context.destroy();
+		stopThreads();
+		return capture_failed == 0 ? 0 : 1;
+	}
+#endif
 
+	uint32_t last_frame_seq = 0;
+	uint32_t last_view_hash = 0;
 	while (!glfwWindowShouldClose(window))
 	{
 		float currentFrame = glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
 		processInput(window);
-		
-		//Rendering commands here
-		glClearColor(0.15f, 0.15f, 0.15f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-
-		glm::vec3 box_pos = glm::vec3(1.0f, 0.0f, 0.0);
-		glm::vec4 box_vec = glm::vec4(box_pos, 1.0f);
-		glm::mat4 box_transform = glm::mat4(1.0f);
-		box_transform = glm::rotate(box_transform, glm::radians(yaw_alt), glm::vec3(0.0f, 1.0f, 0.0f));
-		box_vec = box_transform * box_vec;
-		box_pos = glm::vec3(box_vec.x, box_vec.y, box_vec.z);
-		glm::vec3 axis = glm::cross(box_pos, glm::vec3(0.0f, 1.0f, 0.0f));
-
-		box_transform = glm::mat4(1.0f);
-		box_transform = glm::rotate(box_transform, glm::radians(pitch_alt), axis);
-		box_vec = box_transform * box_vec;
-		box_pos = cam_radius * glm::vec3(box_vec.x, box_vec.y, box_vec.z);
-		static bool first = true;
-		if (first) {
-			printf("box_pos = (%f, %f, %f)\n", box_pos.x, box_pos.y, box_pos.z);
-			first = false;
-		}
-		
-
-		//Draw Models
-		ourShader.use();
-
-		ourShader.setVec3("light.position", lightPos);
-		//ourShader.setVec3("viewPos", cameraPos);
-		ourShader.setVec3("viewPos", box_pos);
-
-		// light properties
-		ourShader.setVec3("light.ambient", 1.0f, 1.0f, 1.0f); // note that all light colors are set at full intensity
-		ourShader.setVec3("light.diffuse", 1.0f, 1.0f, 1.0f);
-		ourShader.setVec3("light.specular", 1.0f, 1.0f, 1.0f);
-
-		// material properties
-		ourShader.setVec3("material.ambient", 0.0f, 0.1f, 0.06f);
-		ourShader.setVec3("material.diffuse", 0.0f, 0.50980392f, 0.50980392f);
-		ourShader.setVec3("material.specular", 0.50196078f, 0.50196078f, 0.50196078f);
-		ourShader.setFloat("material.shininess", 32.0f);
 
-		glm::mat4 projection = glm::perspective(glm::radians(fov), 800.0f / 600.0f, 0.1f, 300.0f);
-		//glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-		glm::mat4 view = glm::lookAt(box_pos, glm::vec3(0.0f, 20.0f, 0.0f), cameraUp);
-
-
-		ourShader.setMat4("projection", projection);
-		ourShader.setMat4("view", view);
-
-		glm::mat4 model = glm::mat4(1.0f);
-		float time = glfwGetTime();
-		//model = glm::rotate(model, glm::radians(5.0f * glfwGetTime()), glm::vec3(0.0f, 1.0f, 0.0f));
-		//model = glm::rotate(model, (float)(0.5f * time), glm::vec3(0.0f, 1.0f, 0.0f));
-		//model = glm::translate(model, glm::vec3(0.0f, 4.0f, 0.0f));
-		//model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
-		ourShader.setMat4("model", model);
-		for (int i = 0; i < 3; i++)
+		int uploaded = asset_loader.processUploads(UPLOADS_PER_FRAME);
+		if (!models_reported && asset_loader.idle())
 		{
-			if (i != 2) {
-				enclosure_models[i].Draw(ourShader);
-			}
-			else if (enclosure_top_visible) {
-				/*
-				glm::mat4 model = glm::mat4(1.0f);
-				model = glm::translate(model, glm::vec3(0.0f, 7.45f, 0.0f));
-				model = glm::rotate(model, (float)(0.5f * time) + glm::radians(22.5f), glm::vec3(0.0f, 1.0f, 0.0f));
-				model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-
-
-				//model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
-				ourShader.setMat4("model", model);
-				enclosure_models[i].Draw(ourShader);
-				*/
-				glm::mat4 model = glm::mat4(1.0f);
-				model = glm::translate(model, glm::vec3(0.0f, 74.2f, 0.0f));
-				//model = glm::rotate(model, (float)(0.5f * time) + glm::radians(22.5f), glm::vec3(0.0f, 1.0f, 0.0f));
-				model = glm::rotate(model, glm::radians(22.5f), glm::vec3(0.0f, 1.0f, 0.0f));
-				model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-
-
-				//model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
-				ourShader.setMat4("model", model);
-				enclosure_models[i].Draw(ourShader);
+			size_t model_bytes = 0;
+			for (int i = 0; i < 3; i++)
+			{
+				model_bytes += enclosure_models[i].gpuBytes();
 			}
+			cout << "Models loaded" << endl;
+			printf("Model load time: %.1f ms, enclosure GPU buffers: %zu KB, %zu unique textures\n",
+				std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count(),
+				model_bytes / 1024, textureCache.size());
+			models_reported = true;
 		}
 
-		//Draw Light cube
-		lightCubeShader.use();
-		lightCubeShader.setMat4("projection", projection);
-		lightCubeShader.setMat4("view", view);
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, lightPos);
-		//model = glm::scale(model, glm::vec3(0.2f)); // a smaller cube
-		lightCubeShader.setMat4("model", model);
-
-		glBindVertexArray(lightCubeVAO);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-
-
-		ledShader.use();
-		ledShader.setMat4("projection", projection);
-		ledShader.setMat4("view", view);
-		for (int k = 0; k < HEIGHT; k++) {
-			for (int i = 0; i < LENGTH; i++) {
-				for (int j = 0; j < WIDTH; j++) {
-					frameBuffer* rBuf = arduino_buffer.getReadBuffer();
-					int sum = 0;
-					glm::vec3 ledColor;
-					for (int idx = 0; idx < 3; idx++) {
-						sum += rBuf->fbuf_[i][j][k][idx];
-						switch (idx) {
-							case 0:
-								ledColor.x = rBuf->fbuf_[i][j][k][idx] / 255.0f;
-								break;
-							case 1:
-								ledColor.y = rBuf->fbuf_[i][j][k][idx] / 255.0f;
-								break;
-							case 2:
-								ledColor.z = rBuf->fbuf_[i][j][k][idx] / 255.0f;
-								break;
-						}
-					}
-					if (sum == 0)
-						continue;
-					
-					ledShader.setVec3("ledColor", ledColor);
-					model = glm::mat4(1.0f);
-					model = glm::rotate(model, glm::radians(3.75f * -i), glm::vec3(0.0f, 1.0f, 0.0f));
-					model = glm::translate(model, glm::vec3(35.0f + j * 5.0f, 20.1f + 7.6*k, 0.0f));
-					model = glm::scale(model, glm::vec3(2.0f, 1.0f, 2.0f));
-					ledShader.setMat4("model", model);
-					glDrawArrays(GL_TRIANGLES, 0, 36);
-				}
-			}
+		uint32_t frame_seq;
+		const frameBuffer* led_frame = selectLedFrame(arduino_buffer, &frame_seq);
+		uint32_t view_hash = viewStateHash();
+		if (SKIP_IDLE_FRAMES && !view_dirty && uploaded == 0 && frame_seq == last_frame_seq && view_hash == last_view_hash)
+		{
+			//Last presented frame is still current, sleep until input or the next tick
+			glfwWaitEventsTimeout(IDLE_WAIT_TIMEOUT);
+			continue;
 		}
-		
+		last_frame_seq = frame_seq;
+		last_view_hash = view_hash;
+		view_dirty = false;
+
+		renderScene(scene, led_frame, 800.0f / 600.0f);
+
+		PROFILE_BEGIN(swap_zone, "glfwSwapBuffers");
 		glfwSwapBuffers(window);
+		PROFILE_END(swap_zone);
 		glfwPollEvents();
 	}
+	for (int i = 0; i < 3; i++)
+	{
+		enclosure_models[i].unload();
+	}
 	glfwTerminate();
-	thread_data.thread_running = false;
-	th1.join();
+	stopThreads();
 	return 0;
-}
\ No newline at end of file
+}
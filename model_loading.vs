@@ -6,6 +6,8 @@ layout (location = 2) in vec2 aTexCoords;
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform vec3 posOffset;	// (0,0,0) unless the mesh is 16-bit quantized
+uniform vec3 posScale;	// (1,1,1) unless the mesh is 16-bit quantized
 
 out vec2 TexCoords;
 out vec3 Normal;
@@ -13,8 +15,9 @@ out vec3 FragPos;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vec3 pos = posOffset + posScale * aPos;
+    gl_Position = projection * view * model * vec4(pos, 1.0);
     Normal = aNormal;
     TexCoords = aTexCoords;
-    FragPos = vec3(model * vec4(aPos, 1.0));
+    FragPos = vec3(model * vec4(pos, 1.0));
 }
\ No newline at end of file
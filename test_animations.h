@@ -5,6 +5,8 @@
 #include <pov_display/FrameBuffer.h>
 #include "Vector3d.h"
 #include "Text.h"
+#include "SceneBudget.h"
+#include "Timeline.h"
 //#include "Events.h"
 #include <pov_display/Events.h>
 
@@ -19,6 +21,8 @@
 
 void textAnimation(doubleBuffer* frame_buffer)
 {
+    PROFILE_FUNCTION();
+    SCENE_BUDGET("textAnimation", 1);
     static const char* text[4] = { "CMU ECE",
                             "HELLO WORLD",
                             "EMBEDDED SYSTEMS ARE FUN",
@@ -27,7 +31,7 @@ void textAnimation(doubleBuffer* frame_buffer)
     static bool start = true;
     static uint8_t text_sel = 0;
     static uint8_t height = 0;
-    static uint16_t text_len = 0;
+    static int16_t text_width = 0;
     static uint8_t r, g, b;
 
     static uint16_t cnt = 0;
@@ -40,7 +44,7 @@ void textAnimation(doubleBuffer* frame_buffer)
         {
             text_sel = rand() % 4;
             height = rand() % HEIGHT;
-            text_len = strlen(text[text_sel]);
+            text_width = measureString(text[text_sel]);
             doubleBuffer::randColor(&r, &g, &b);
             idx = LENGTH + 5;
             start = false;
@@ -48,53 +52,58 @@ void textAnimation(doubleBuffer* frame_buffer)
         else
         {
             idx--;
-            if (idx <= (-2 * text_len - 5))
+            if (idx <= -text_width)
             {
                 start = true;
             }
         }
     }
-    writeString(text[text_sel], idx, height, r, g, b, frame_buffer);
+    writeStringCached(text[text_sel], idx, height, r, g, b, frame_buffer, FONT_PROPORTIONAL);
 }
 
+//Phase steps every 10 ticks for two rounds of the pinwheel, single buffered
+//for the second one. The last phase holds for one more step before the show
+//restarts, 1210 ticks like the old counter loop
+static const Keyframe PINWHEEL_PHASE_KEYS[] = { { 0, 0, EASE_LINEAR }, { 6000, 120, EASE_STEP }, { 6050, 120, EASE_STEP } };
+static const Keyframe PINWHEEL_MODE_KEYS[] = { { 0, 1, EASE_STEP }, { 3000, 0, EASE_STEP }, { 6050, 0, EASE_STEP } };
+static const TimelineTrack PINWHEEL_TRACKS[] = {
+    { TL_PHASE, PINWHEEL_PHASE_KEYS, 3 },
+    { TL_MODE, PINWHEEL_MODE_KEYS, 3 },
+};
+static const TimelineNode PINWHEEL_PARTS[] = { timelineTrack(&PINWHEEL_TRACKS[0]), timelineTrack(&PINWHEEL_TRACKS[1]) };
+static const TimelineNode PINWHEEL_SHOW = timelineParallel(PINWHEEL_PARTS, 2, TIMELINE_FOREVER);
+
 void pinWheelAnimation_0(doubleBuffer* frame_buffer)
 {
+    PROFILE_FUNCTION();
+    SCENE_BUDGET("pinWheelAnimation_0", 1);
     static const int8_t lookup[10] = { 0, 1, 2, 3, 4, 5, 4, 3, 2, 1 };
     static const uint16_t N_CYCLE = 60;
 
-    static uint16_t cnt = 0;
-    static const uint16_t delay_cnt = 10;
-
-    static bool start = true;
+    static TimelinePlayer show(&PINWHEEL_SHOW);
+    static uint32_t play = TIMELINE_ENDLESS;
+    static int32_t mode = -1;
     static uint8_t sel = 0;
     static uint8_t r_, g_, b_;
-    static uint16_t cycles = 0;
 
-    if (cnt++ % delay_cnt == 0)
+    if (show.plays() != play)
     {
-        if (start == true)
-        {
-            sel = rand() % 6;
-            doubleBuffer::randColor(&r_, &g_, &b_);
+        play = show.plays();
+        sel = rand() % 6;
+        doubleBuffer::randColor(&r_, &g_, &b_);
+    }
+    TimelineValues values = show.evaluate();
+    show.advance(TIMELINE_TICK_MS);
+    if (values.get(TL_MODE) != mode)
+    {
+        mode = values.get(TL_MODE);
+        if (mode)
             frame_buffer->forceDoubleBuffer();
-            cycles = 0;
-            start = false;
-        }
         else
-        {
-            cycles++;
-            if (cycles == N_CYCLE)
-            {
-                frame_buffer->forceSingleBuffer();
-            }
-            if (cycles >= 2 * N_CYCLE)
-            {
-                start = true;
-            }
-        }
+            frame_buffer->forceSingleBuffer();
     }
 
-    uint16_t cycles_ = cycles % N_CYCLE;
+    uint16_t cycles_ = values.get(TL_PHASE) % N_CYCLE;
     for (int i = 0; i < LENGTH; i++)
     {
         int W_0 = lookup[(i + cycles_) % 10];
@@ -107,32 +116,29 @@ void pinWheelAnimation_0(doubleBuffer* frame_buffer)
     }
 }
 
+//Phase steps every 10 ticks and wraps after 400
+static const Keyframe VORTEX_PHASE_KEYS[] = { { 0, 0, EASE_LINEAR }, { 20000, 400, EASE_STEP } };
+static const TimelineTrack VORTEX_TRACK = { TL_PHASE, VORTEX_PHASE_KEYS, 2 };
+static const TimelineNode VORTEX_SHOW = timelineTrack(&VORTEX_TRACK, TIMELINE_FOREVER);
+
 void vortexAnimation(doubleBuffer* frame_buffer)
 {
+    PROFILE_FUNCTION();
+    SCENE_BUDGET("vortexAnimation", 1);
     static const uint8_t lookup2[10] = { 0, 0, 0, 0, 0, 7, 7, 7, 7, 7 };
     static bool start = true;
 
-
     static uint8_t color_r, color_g, color_b;
-    static uint16_t cycles = 0;
-    static uint16_t cnt = 0;
-    static const uint16_t delay_cnt = 10;
+    static TimelinePlayer show(&VORTEX_SHOW);
 
-    if (cnt++ % delay_cnt == 0)
+    if (start == true)
     {
-        if (start == true)
-        {
-            cycles = 0;
-            frame_buffer->forceDoubleBuffer();
-            doubleBuffer::randColor(&color_r, &color_g, &color_b);
-            start = false;
-        }
-        else
-        {
-            cycles++;
-            cycles %= 400;
-        }
+        frame_buffer->forceDoubleBuffer();
+        doubleBuffer::randColor(&color_r, &color_g, &color_b);
+        start = false;
     }
+    uint16_t cycles = show.evaluate().get(TL_PHASE);
+    show.advance(TIMELINE_TICK_MS);
 
     if (cycles % 10 == 0)
         doubleBuffer::randColor(&color_r, &color_g, &color_b);
@@ -183,6 +189,8 @@ void multicolorFillAnimation(doubleBuffer* frame_buffer)
 }
 void pinWheelAnimation_1(doubleBuffer* frame_buffer)
 {
+    PROFILE_FUNCTION();
+    SCENE_BUDGET("pinWheelAnimation_1", 1);
     static const uint8_t lookup[10] = { 0, 1, 2, 3, 4, 5, 4, 3, 2, 1 };
     static bool start = true;
     static uint16_t cycles = 0;
@@ -214,69 +222,47 @@ void pinWheelAnimation_1(doubleBuffer* frame_buffer)
     }
 }
 
+//Columns of random height rise off the floor a layer every 35 ms, hold for a
+//second and sink back. Each play picks new heights and a color
+static const Keyframe PULSE_LEVEL_KEYS[] = {
+    { 0, 0, EASE_STEP },
+    { 1000, 0, EASE_LINEAR },
+    { 1175, 5, EASE_STEP },
+    { 2175, 4, EASE_LINEAR },
+    { 2280, 1, EASE_STEP },
+    { 2315, 1, EASE_STEP },
+};
+static const TimelineTrack PULSE_TRACK = { TL_LEVEL, PULSE_LEVEL_KEYS, sizeof(PULSE_LEVEL_KEYS) / sizeof(PULSE_LEVEL_KEYS[0]) };
+static const TimelineNode PULSE_SHOW = timelineTrack(&PULSE_TRACK, TIMELINE_FOREVER);
+
 void pulseAnimation(doubleBuffer* frame_buffer)
 {
-    uint8_t pixels[LENGTH][WIDTH];
-    uint8_t pixels_target[LENGTH][WIDTH];
-    frame_buffer->reset();
-    frame_buffer->clear();
+    PROFILE_FUNCTION();
+    SCENE_BUDGET("pulseAnimation", 1);
+    static uint8_t pixels_target[LENGTH][WIDTH];
+    static uint8_t r, g, b;
+    static TimelinePlayer show(&PULSE_SHOW);
+    static uint32_t play = TIMELINE_ENDLESS;
 
-    uint8_t r, g, b;
-    doubleBuffer::randColor(&r, &g, &b);
-    for (int i = 0; i < LENGTH; i++)
+    if (show.plays() != play)
     {
-        for (int j = 0; j < WIDTH; j++)
-        {
-            pixels[i][j] = 0;
-            pixels_target[i][j] = rand() % HEIGHT;
-            frame_buffer->setColors(i, j, 0, r, g, b);
-        }
-    }
-    frame_buffer->update();
-    delay(1000);
-
-
-    for (int k = 0; k < HEIGHT; k++)
-    {
-        frame_buffer->clear();
+        play = show.plays();
+        frame_buffer->reset();
+        doubleBuffer::randColor(&r, &g, &b);
         for (int i = 0; i < LENGTH; i++)
-        {
             for (int j = 0; j < WIDTH; j++)
-            {
-                if (k <= pixels_target[i][j])
-                {
-                    frame_buffer->setColors(i, j, k, r, g, b);
-                }
-                else
-                {
-                    frame_buffer->setColors(i, j, pixels_target[i][j], r, g, b);
-                }
-            }
-        }
-        frame_buffer->update();
-        delay(35);
+                pixels_target[i][j] = rand() % HEIGHT;
     }
-    delay(965);
+    int level = show.evaluate().get(TL_LEVEL);
+    show.advance(TIMELINE_TICK_MS);
 
-    for (int k = HEIGHT - 2; k >= 1; k--)
+    for (int i = 0; i < LENGTH; i++)
     {
-        frame_buffer->clear();
-        for (int i = 0; i < LENGTH; i++)
+        for (int j = 0; j < WIDTH; j++)
         {
-            for (int j = 0; j < WIDTH; j++)
-            {
-                if (k <= pixels_target[i][j])
-                {
-                    frame_buffer->setColors(i, j, k, r, g, b);
-                }
-                else
-                {
-                    frame_buffer->setColors(i, j, pixels_target[i][j], r, g, b);
-                }
-            }
+            int k = level <= pixels_target[i][j] ? level : pixels_target[i][j];
+            frame_buffer->setColors(i, j, k, r, g, b);
         }
-        frame_buffer->update();
-        delay(35);
     }
 }
 
@@ -350,30 +336,13 @@ void wobbly_words(doubleBuffer* frame_buffer)
                 b__ = 255;
             break;
         }
-        writeString(words[word_idx], 0, 0, r__, g__, b__, frame_buffer);
-        frameBuffer* fb = frame_buffer->getWriteBuffer();
-        for (int i = 0; i < LENGTH; i++)
-        {
-            int i_ = (i + offset) / 2 % 10;
-            int h_idx;
-            if (i_ < 6)
-            {
-                h_idx = i_;
-            }
-            else
-            {
-                h_idx = 10 - i_;
-            }
-            for (int j = 0; j < WIDTH; j++)
-            {
-                for (int k = 0; k < h_idx; k++)
-                {
-                    fb->fbuf_[i][j][k][RED] = fb->fbuf_[i][j][0][RED];
-                    fb->fbuf_[i][j][k][GREEN] = fb->fbuf_[i][j][0][GREEN];
-                    fb->fbuf_[i][j][k][BLUE] = fb->fbuf_[i][j][0][BLUE];
-                }
-            }
-        }
+        //Extruded up to 5 layers along a triangle wave that moves with offset
+        TextLayout layout = textLayout(TEXT_RADIAL, r__, g__, b__);
+        layout.effect = TEXT_FX_DEPTH_WAVE;
+        layout.amplitude = 5;
+        layout.period = 20;
+        layout.phase = offset;
+        layoutText(words[word_idx], 0, layout, frame_buffer);
         frame_buffer->update();
         offset++;
         if (offset >= LENGTH)
@@ -387,8 +356,42 @@ void wobbly_words(doubleBuffer* frame_buffer)
     }
 }
 
+//Upright text wrapped around the drum, two rows deep, riding a wave
+void uprightTextAnimation(doubleBuffer* frame_buffer)
+{
+    PROFILE_FUNCTION();
+    SCENE_BUDGET("uprightTextAnimation", 1);
+    static const char* text[3] = { "POV DISPLAY", "CMU ECE", "HELLO WORLD" };
+
+    static uint16_t cnt = 0;
+    static int16_t idx = 0;
+    static uint8_t text_sel = 0;
+    static uint8_t r = 0, g = 255, b = 255;
+
+    if (cnt % 4 == 0)
+        idx++;
+    if (cnt % 512 == 511)
+    {
+        text_sel = (text_sel + 1) % 3;
+        doubleBuffer::randColor(&r, &g, &b);
+    }
+
+    TextLayout layout = textLayout(TEXT_UPRIGHT, r, g, b);
+    layout.base = WIDTH - 2;
+    layout.depth = 2;
+    layout.effect = TEXT_FX_WAVE;
+    layout.amplitude = 1;
+    layout.period = 24;
+    layout.phase = cnt / 2;
+    layout.wrap = true;
+    layoutText(text[text_sel], idx, layout, frame_buffer);
+    cnt++;
+}
+
 void draw_triange_wave(doubleBuffer* frame_buffer)
 {
+    PROFILE_FUNCTION();
+    SCENE_BUDGET("draw_triange_wave", 1);
     for (int i = 0; i < LENGTH; i++)
     {
         uint8_t r, g, b;
@@ -589,9 +592,9 @@ void random_walk(doubleBuffer* frame_buffer)
                 {
                     for (int k = 0; k < HEIGHT; k++)
                     {
-                        fb->fbuf_[i][j][k][RED] >>= 1;
-                        fb->fbuf_[i][j][k][GREEN] >>= 1;
-                        fb->fbuf_[i][j][k][BLUE] >>= 1;
+                        uint8_t r, g, b;
+                        fb->getPixel(i, j, k, &r, &g, &b);
+                        fb->setPixel(i, j, k, r >> 1, g >> 1, b >> 1);
                     }
                 }
             }
@@ -643,7 +646,9 @@ void random_walk(doubleBuffer* frame_buffer)
             break;
         }
 
-        doubleBuffer::randColor(&fb->fbuf_[pos.x][pos.y][pos.z][RED], &fb->fbuf_[pos.x][pos.y][pos.z][GREEN], &fb->fbuf_[pos.x][pos.y][pos.z][BLUE]);
+        uint8_t r, g, b;
+        doubleBuffer::randColor(&r, &g, &b);
+        fb->setPixel(pos.x, pos.y, pos.z, r, g, b);
         shift_cnt++;
         shift_cnt %= 3;
         delay(33);
@@ -1059,6 +1064,8 @@ void MazeGame::init()
 }
 void MazeGame::update()
 {
+    PROFILE_ZONE("MazeGame::update");
+    SCENE_BUDGET("MazeGame", 1);
     handleInputs();
 
     player.update();
@@ -1078,6 +1085,8 @@ void MazeGame::update()
 }
 void MazeGame::draw(doubleBuffer* frame_buffer)
 {
+    PROFILE_ZONE("MazeGame::draw");
+    SCENE_BUDGET("MazeGame", 1);
     Vector3d offset = Vector3d(0, 0, 0);
     Vector3d player_pos = player.getPos();
     int target = 60;
@@ -1204,8 +1213,12 @@ int MazeGame::handleInputs()
     return 0;
 }
 
+//Quality 2 evaluates HSV per voxel column, 1 every 2nd slice, 0 every 4th
 void rainbow_swirl(doubleBuffer* frame_buffer)
 {
+    PROFILE_FUNCTION();
+    SCENE_BUDGET("rainbow_swirl", 3);
+    const int hue_step = 1 << (2 - scene_cost.quality());
     static const int width_offset = 60 / (WIDTH - 1);
     static const uint8_t height_transform[15] = { 2, 4, 4, 5, 5, 5, 5, 4, 4, 3, 2, 1, 1, 1, 1 };
     static const uint8_t trans_size = 15;
@@ -1213,6 +1226,7 @@ void rainbow_swirl(doubleBuffer* frame_buffer)
 
     static int hue_offset = 0;
     static uint8_t delay_cnt = 0;
+    uint8_t colors[WIDTH][NUM_COLORS];
     
     for (int i = 0; i < LENGTH; i++)
     {
@@ -1226,8 +1240,14 @@ void rainbow_swirl(doubleBuffer* frame_buffer)
 
         for (int j = 0; j < WIDTH; j++)
         {
-            Color color = Color::getColorHSV(hue + hue_offset + ((WIDTH - 1 - j) * width_offset), 255, 255);
-            frame_buffer->setColors(i, j, k, color.r, color.g, color.b);
+            if (i % hue_step == 0)
+            {
+                Color color = Color::getColorHSV(hue + hue_offset + ((WIDTH - 1 - j) * width_offset), 255, 255);
+                colors[j][RED] = color.r;
+                colors[j][GREEN] = color.g;
+                colors[j][BLUE] = color.b;
+            }
+            frame_buffer->setColors(i, j, k, colors[j][RED], colors[j][GREEN], colors[j][BLUE]);
         }
     }
 